@@ -1,4 +1,11 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+// Features and light count are defined by the shader permutation,
+// DIFFUSE_MAP, NORMAL_MAP, SPECULAR_MAP, AO_MAP, EMISSIVE_MAP and NUM_LIGHTS
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS gl_MaxLights
+#endif
 
 varying vec4 position;
 varying vec3 normal;
@@ -11,27 +18,21 @@ uniform sampler2D texSpecular;
 uniform sampler2D texAO;
 uniform sampler2D texEmissive;
 
-uniform float texDiffusePower;
-uniform float texNormalPower;
-uniform float texSpecularPower;
-uniform float texAOPower;
-uniform float texEmissivePower;
-
-uniform bool diffuseEnabled;
-uniform bool aoEnabled;
-uniform bool emissiveEnabled;
-uniform bool normalEnabled;
-uniform bool specularEnabled;
-
-uniform float gamma;
-
-struct MaterialInfo {
-  vec3 Ka;            // Ambient reflectivity
-  vec3 Kd;            // Diffuse reflectivity
-  vec3 Ks;            // Specular reflectivity
-  float Shininess;    // Specular shininess factor
+// MeshConstants in MeshViewApp.cpp, uploaded when a value changes
+layout(std140) uniform MeshConstants
+{
+	vec3 materialKa; // Ambient reflectivity
+	float gamma;
+	vec3 materialKd; // Diffuse reflectivity
+	float materialShininess; // Specular shininess factor
+	vec3 materialKs; // Specular reflectivity
+	float texEmissivePower;
+
+	float texDiffusePower;
+	float texNormalPower;
+	float texSpecularPower;
+	float texAOPower;
 };
-uniform MaterialInfo material;
 
 /*
 void main()
@@ -66,15 +67,15 @@ void phongModel2(int lightIndex, vec3 toCamera, vec3 pos, vec3 norm, out vec3 am
 	vec3 n_norm = normalize(norm);
 	
 	//vec3 refl = normalize(reflect(-toLight, norm));
-	vec3 ambient = vec3(gl_LightSource[lightIndex].ambient) * material.Ka;
+	vec3 ambient = vec3(gl_LightSource[lightIndex].ambient) * materialKa;
 	float sDotN = max(dot(toLight, norm), 0.0);
 	sDotN = clamp(sDotN, 0.1, 1.0);
-    vec3 diffuse = vec3(gl_LightSource[lightIndex].diffuse) * material.Kd * sDotN;
+    vec3 diffuse = vec3(gl_LightSource[lightIndex].diffuse) * materialKd * sDotN;
 	
 	spec = vec3(0.0);
     if(sDotN > 0.0)
-       spec = vec3(gl_LightSource[lightIndex].specular) * material.Ks *
-              pow(max(dot(n_norm, halfvector), 0.0), material.Shininess);
+       spec = vec3(gl_LightSource[lightIndex].specular) * materialKs *
+              pow(max(dot(n_norm, halfvector), 0.0), materialShininess);
 
 	ambAndDiff = ambient + diffuse;
 }
@@ -88,15 +89,15 @@ void phongModel(int lightIndex, vec3 toCamera, vec3 pos, vec3 norm, out vec3 amb
 		toLight = normalize(gl_LightSource[lightIndex].position.xyz - pos);
 	
 	vec3 refl = normalize(reflect(-toLight, norm));
-	vec3 ambient = vec3(gl_LightSource[lightIndex].ambient) * material.Ka;
+	vec3 ambient = vec3(gl_LightSource[lightIndex].ambient) * materialKa;
 	float sDotN = max(dot(toLight, norm), 0.0);
 	sDotN = clamp(sDotN, 0.1, 1.0);
-    vec3 diffuse = vec3(gl_LightSource[lightIndex].diffuse) * material.Kd * sDotN;
+    vec3 diffuse = vec3(gl_LightSource[lightIndex].diffuse) * materialKd * sDotN;
 	
 	spec = vec3(0.0);
     if(sDotN > 0.0)
-       spec = vec3(gl_LightSource[lightIndex].specular) * material.Ks *
-              pow(max(dot(refl, toCamera), 0.0), material.Shininess);
+       spec = vec3(gl_LightSource[lightIndex].specular) * materialKs *
+              pow(max(dot(refl, toCamera), 0.0), materialShininess);
 
 	ambAndDiff = ambient + diffuse;
 }
@@ -104,36 +105,46 @@ void phongModel(int lightIndex, vec3 toCamera, vec3 pos, vec3 norm, out vec3 amb
 void main()
 {
 	vec4 finalColor = vec4(0.0);
-	vec4 diffuseColor = texture2D(texDiffuse, gl_TexCoord[0].st) * texDiffusePower;
+
+#ifdef NORMAL_MAP
 	vec3 mappedNormal = 2.0 * texture2D(texNormal, gl_TexCoord[0].st).rgb - 1.0;
-	vec3 surfaceNormal = normalEnabled ? normalize((tangent * mappedNormal.x) + (bitangent * mappedNormal.y) + (normal * mappedNormal.z)) : normal;
+	vec3 surfaceNormal = normalize((tangent * mappedNormal.x) + (bitangent * mappedNormal.y) + (normal * mappedNormal.z));
+#else
+	vec3 surfaceNormal = normal;
+#endif
+
+#ifdef DIFFUSE_MAP
+	vec4 diffuseColor = texture2D(texDiffuse, gl_TexCoord[0].st) * texDiffusePower;
+#else
+	vec4 diffuseColor = vec4(1.0);
+#endif
+
+#if defined(DIFFUSE_MAP) && defined(AO_MAP)
+	vec4 aoFactor = texture2D(texAO, gl_TexCoord[0].st) * texAOPower;
+	diffuseColor = vec4(diffuseColor.rgb * aoFactor.r, diffuseColor.a);
+#endif
+
+#ifdef SPECULAR_MAP
+	vec4 specularColor = texture2D(texSpecular, gl_TexCoord[0].st) * texSpecularPower;
+#endif
 
 	vec3 toCamera = normalize(-position.xyz);
 
-	for(int i = 0; i < gl_MaxLights; i++)
+	for(int i = 0; i < NUM_LIGHTS; i++)
 	{
 		vec3 ambAndDiff, spec;
 	    phongModel2(i, toCamera, position.xyz, surfaceNormal, ambAndDiff, spec);
-		
-		if(aoEnabled)
-		{
-			vec4 aoFactor = texture2D(texAO, gl_TexCoord[0].st) * texAOPower;
-			diffuseColor = vec4(diffuseColor.rgb * aoFactor.r, diffuseColor.a);
-		}
 
-		if(diffuseEnabled)
-			finalColor += diffuseColor * vec4(ambAndDiff, 1.0);
-		else
-			finalColor += vec4(ambAndDiff, 1.0);
+		finalColor += diffuseColor * vec4(ambAndDiff, 1.0);
 		
-		if(specularEnabled)
-			finalColor += texture2D(texSpecular, gl_TexCoord[0].st) * texSpecularPower * vec4(spec, 1.0);
-		//else
-			//finalColor += vec4(spec, 1.0);
-		
-		if(emissiveEnabled)
-			finalColor += texture2D(texEmissive, gl_TexCoord[0].st) * texEmissivePower;
+#ifdef SPECULAR_MAP
+		finalColor += specularColor * vec4(spec, 1.0);
+#endif
 	}
+
+#ifdef EMISSIVE_MAP
+	finalColor += texture2D(texEmissive, gl_TexCoord[0].st) * texEmissivePower;
+#endif
 	
 	gl_FragColor = vec4(pow(finalColor.rgb, vec3(1.0/gamma)), finalColor.a);
 }
@@ -0,0 +1,53 @@
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+// PaletteBuffer::kMaxBones
+#define MAX_BONES 256
+
+// Upper three rows of the bone matrices
+layout(std140) uniform BonePalette
+{
+	vec4 bones[MAX_BONES * 3];
+};
+
+attribute vec4 boneIndices;
+attribute vec4 boneWeights;
+
+varying vec4 position;
+varying vec3 normal;
+varying vec3 tangent;
+varying vec3 bitangent;
+
+void main()
+{
+	vec4 vertex = gl_Vertex;
+	vec3 vertexNormal = gl_Normal;
+	vec3 vertexTangent = gl_MultiTexCoord7.xyz;
+
+	// Meshes without bones are drawn with zero weights
+	if(dot(boneWeights, vec4(1.0)) > 0.0)
+	{
+		vec4 row0 = vec4(0.0);
+		vec4 row1 = vec4(0.0);
+		vec4 row2 = vec4(0.0);
+		for(int i = 0; i < 4; ++i)
+		{
+			int bone = int(boneIndices[i]) * 3;
+			row0 += bones[bone] * boneWeights[i];
+			row1 += bones[bone + 1] * boneWeights[i];
+			row2 += bones[bone + 2] * boneWeights[i];
+		}
+
+		vertex = vec4(dot(row0, gl_Vertex), dot(row1, gl_Vertex), dot(row2, gl_Vertex), 1.0);
+		vertexNormal = vec3(dot(row0.xyz, gl_Normal), dot(row1.xyz, gl_Normal), dot(row2.xyz, gl_Normal));
+		vertexTangent = vec3(dot(row0.xyz, vertexTangent), dot(row1.xyz, vertexTangent), dot(row2.xyz, vertexTangent));
+	}
+
+	position = gl_ModelViewMatrix * vertex;
+	normal = normalize(gl_NormalMatrix * vertexNormal);
+	tangent = normalize(gl_NormalMatrix * vertexTangent);
+	bitangent = normalize(cross(normal, tangent));
+
+	gl_TexCoord[0] = gl_MultiTexCoord0;
+	gl_Position = gl_ModelViewProjectionMatrix * vertex;
+}
@@ -0,0 +1,807 @@
+// Loader and animation benchmarks of the headless core, written as JSON.
+//
+// MeshBenchmark [--assets DIR] [--iterations N] [--frames N] [--quick] [--output FILE] [--trace FILE]
+// MeshBenchmark --check-allocations [--frames N]
+// MeshBenchmark --check-baked
+//
+// Every model in assets/models is measured, followed by generated meshes and
+// rigs of increasing size. Logs go to standard error, the JSON report to
+// standard output unless --output is given. --trace also records the load
+// and animation phases as a Chrome trace.
+//
+// --check-allocations plays a generated rig instead and fails if an update
+// allocates once the animation has played through. --check-baked writes the
+// baked animation of a generated rig to disk, and fails if it does not load
+// back the same, or if a truncated copy loads at all.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include "AssetPath.h"
+#include "AssimpLoader.h"
+#include "Stopwatch.h"
+#include "Trace.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+using namespace mndl;
+using namespace mndl::assimp;
+
+// Version of the report layout, bumped when keys change meaning
+#define BENCHMARK_SCHEMA 1
+// Frames per second of the generated animation and of the playback loops
+#define BENCHMARK_FPS 60.0
+#define BENCHMARK_TWO_PI 6.28318530717958647692
+
+struct BenchmarkOptions
+{
+	BenchmarkOptions() : m_iterations(5), m_frames(240), m_quick(false), m_checkAllocations(false), m_checkBaked(false) {}
+
+	boost::filesystem::path m_assets;
+	boost::filesystem::path m_output;
+	boost::filesystem::path m_trace; // Chrome trace JSON, not recorded if empty
+	boost::filesystem::path m_temp; // generated models
+	size_t m_iterations; // loads per model, and iterations of the loader benchmarks
+	size_t m_frames; // animation frames played per model
+	bool m_quick; // skips the largest generated models
+	bool m_checkAllocations; // runs checkAllocations() instead of the benchmarks
+	bool m_checkBaked; // runs checkBaked() instead of the benchmarks
+};
+
+// Heap allocations of every thread, updates should not allocate once the animation is playing
+static std::atomic<size_t> s_numAllocations(0);
+
+void* operator new(size_t size)
+{
+	s_numAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+struct BenchmarkCase
+{
+	std::string m_name;
+	std::string m_kind; // "asset", "mesh" or "rig"
+	boost::filesystem::path m_fileName;
+};
+
+// Minimal streaming JSON writer, keys and values are separated as they are added.
+class JsonWriter
+{
+public:
+	JsonWriter(std::ostream& os) : m_os(os), m_first(true), m_depth(0) {}
+
+	void beginObject(const char* key = NULL)
+	{
+		begin(key, '{');
+	}
+
+	void endObject()
+	{
+		end('}');
+	}
+
+	void beginArray(const char* key = NULL)
+	{
+		begin(key, '[');
+	}
+
+	void endArray()
+	{
+		end(']');
+	}
+
+	void value(const char* key, const std::string& text)
+	{
+		separate(key);
+		writeString(text);
+	}
+
+	void value(const char* key, double number)
+	{
+		separate(key);
+
+		// NaN and infinity have no JSON representation
+		if(number != number || number > 1e300 || number < -1e300)
+		{
+			m_os << "null";
+			return;
+		}
+
+		char buffer[32];
+		sprintf(buffer, "%.6g", number);
+		m_os << buffer;
+	}
+
+	void value(const char* key, size_t number)
+	{
+		separate(key);
+		m_os << number;
+	}
+
+	void null(const char* key)
+	{
+		separate(key);
+		m_os << "null";
+	}
+
+private:
+	JsonWriter(JsonWriter const&);
+	void operator=(JsonWriter const&);
+
+	void begin(const char* key, char bracket)
+	{
+		separate(key);
+		m_os << bracket;
+		m_first = true;
+		++m_depth;
+	}
+
+	void end(char bracket)
+	{
+		--m_depth;
+		newLine();
+		m_os << bracket;
+		m_first = false;
+
+		if(m_depth == 0)
+			m_os << std::endl;
+	}
+
+	void separate(const char* key)
+	{
+		if(!m_first)
+			m_os << ',';
+
+		if(m_depth > 0)
+			newLine();
+
+		m_first = false;
+
+		if(key)
+		{
+			writeString(key);
+			m_os << ": ";
+		}
+	}
+
+	void newLine()
+	{
+		m_os << '\n' << std::string(m_depth, '\t');
+	}
+
+	void writeString(const std::string& text)
+	{
+		m_os << '"';
+
+		for(size_t i = 0; i < text.size(); ++i)
+		{
+			unsigned char c = static_cast<unsigned char>(text[i]);
+
+			if(c == '"' || c == '\\')
+			{
+				m_os << '\\' << c;
+			}
+			else if(c < 0x20)
+			{
+				char buffer[8];
+				sprintf(buffer, "\\u%04x", c);
+				m_os << buffer;
+			}
+			else
+			{
+				m_os << c;
+			}
+		}
+
+		m_os << '"';
+	}
+
+	std::ostream& m_os;
+	bool m_first;
+	int m_depth;
+};
+
+// Resident and peak resident memory of the process in KB.
+static void getMemoryUsage(size_t* residentKb, size_t* peakKb)
+{
+	*residentKb = 0;
+	*peakKb = 0;
+
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		*residentKb = counters.WorkingSetSize / 1024;
+		*peakKb = counters.PeakWorkingSetSize / 1024;
+	}
+#else
+	rusage usage;
+
+	// KB on Linux, bytes on OS X
+	if(getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+#ifdef __APPLE__
+		*peakKb = static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+		*peakKb = static_cast<size_t>(usage.ru_maxrss);
+#endif
+	}
+
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0;
+	size_t residentPages = 0;
+
+	if(statm >> pages >> residentPages)
+		*residentKb = residentPages * (static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 1024);
+#endif
+}
+
+static double getMedian(std::vector<double> values)
+{
+	if(values.empty())
+		return 0.0;
+
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) * 0.5;
+}
+
+// Flat grid of size x size vertices, two triangles per cell.
+static void writeGridObj(const boost::filesystem::path& fileName, size_t size)
+{
+	std::ofstream ofs(fileName.string().c_str());
+
+	for(size_t y = 0; y < size; ++y)
+	{
+		for(size_t x = 0; x < size; ++x)
+			ofs << "v " << x / float(size - 1) - 0.5f << " 0 " << y / float(size - 1) - 0.5f << "\n";
+	}
+
+	for(size_t y = 0; y + 1 < size; ++y)
+	{
+		for(size_t x = 0; x + 1 < size; ++x)
+		{
+			// OBJ indices start at 1
+			size_t i = y * size + x + 1;
+			ofs << "f " << i << " " << i + size << " " << i + 1 << "\n";
+			ofs << "f " << i + 1 << " " << i + size << " " << i + size + 1 << "\n";
+		}
+	}
+}
+
+// Upright strip of size x size vertices bent by a chain of numBones bones, in the Valve SMD format
+// which assimp imports with bone weights and keyframes. Every vertex blends its two nearest bones.
+static void writeRigSmd(const boost::filesystem::path& fileName, size_t size, size_t numBones, size_t numFrames)
+{
+	std::ofstream ofs(fileName.string().c_str());
+	const float height = 4.f;
+	const float segment = height / numBones;
+
+	ofs << "version 1\nnodes\n";
+
+	for(size_t b = 0; b < numBones; ++b)
+		ofs << b << " \"bone" << b << "\" " << static_cast<int>(b) - 1 << "\n";
+
+	// Frame 0 is the bind pose, the others swing every bone around z, out of phase with its parent
+	ofs << "end\nskeleton\n";
+
+	for(size_t f = 0; f < numFrames; ++f)
+	{
+		ofs << "time " << f << "\n";
+		double phase = BENCHMARK_TWO_PI * f / numFrames;
+
+		for(size_t b = 0; b < numBones; ++b)
+		{
+			float angle = f == 0 ? 0.f : static_cast<float>(0.3 * sin(phase + b * 0.5) / sqrt(double(numBones)));
+			ofs << b << " 0 " << (b == 0 ? 0.f : segment) << " 0 0 0 " << angle << "\n";
+		}
+	}
+
+	ofs << "end\ntriangles\n";
+
+	std::vector<std::string> vertices(size * size);
+
+	for(size_t y = 0; y < size; ++y)
+	{
+		float py = height * y / float(size - 1);
+		float bone = std::min(py / segment, numBones - 1.f);
+		size_t b0 = std::min(static_cast<size_t>(bone), numBones - 1);
+		size_t b1 = std::min(b0 + 1, numBones - 1);
+		float w1 = b0 == b1 ? 0.f : bone - b0;
+
+		for(size_t x = 0; x < size; ++x)
+		{
+			float px = x / float(size - 1) - 0.5f;
+			std::ostringstream line;
+			line << b0 << " " << px << " " << py << " 0 0 0 1 " << x / float(size - 1) << " " << y / float(size - 1)
+			     << " 2 " << b0 << " " << 1.f - w1 << " " << b1 << " " << w1 << "\n";
+			vertices[y * size + x] = line.str();
+		}
+	}
+
+	for(size_t y = 0; y + 1 < size; ++y)
+	{
+		for(size_t x = 0; x + 1 < size; ++x)
+		{
+			size_t i = y * size + x;
+			ofs << "default\n" << vertices[i] << vertices[i + 1] << vertices[i + size];
+			ofs << "default\n" << vertices[i + 1] << vertices[i + size + 1] << vertices[i + size];
+		}
+	}
+
+	ofs << "end\n";
+}
+
+static std::vector<BenchmarkCase> collectCases(const BenchmarkOptions& options)
+{
+	std::vector<BenchmarkCase> cases;
+	boost::system::error_code error;
+	boost::filesystem::path modelsDir = options.m_assets / "models";
+
+	// Bundled models, one directory per model
+	std::vector<boost::filesystem::path> files;
+
+	for(boost::filesystem::recursive_directory_iterator it(modelsDir, error), end; !error && it != end; it.increment(error))
+	{
+		std::string extension = it->path().extension().string();
+
+		if(boost::filesystem::is_regular_file(it->path(), error) && extension != ".mtl" && extension != ".png" && extension != ".jpg")
+			files.push_back(it->path());
+	}
+
+	std::sort(files.begin(), files.end());
+
+	for(size_t i = 0; i < files.size(); ++i)
+	{
+		BenchmarkCase c;
+		c.m_name = files[i].stem().string();
+		c.m_kind = "asset";
+		c.m_fileName = files[i];
+		cases.push_back(c);
+	}
+
+	if(files.empty())
+		std::clog << "no models found in " << modelsDir.string() << std::endl;
+
+	// Generated meshes and rigs, grid size and bones
+	const size_t meshSizes[] = { 64, 128, 256, 512 };
+	const size_t rigSizes[][2] = { { 64, 16 }, { 128, 64 }, { 256, 128 } };
+	const size_t numMeshes = sizeof(meshSizes) / sizeof(meshSizes[0]) - (options.m_quick ? 1 : 0);
+	const size_t numRigs = sizeof(rigSizes) / sizeof(rigSizes[0]) - (options.m_quick ? 1 : 0);
+
+	boost::filesystem::create_directories(options.m_temp, error);
+
+	for(size_t i = 0; i < numMeshes; ++i)
+	{
+		BenchmarkCase c;
+		std::ostringstream name;
+		name << "grid" << meshSizes[i];
+		c.m_name = name.str();
+		c.m_kind = "mesh";
+		c.m_fileName = options.m_temp / (c.m_name + ".obj");
+		writeGridObj(c.m_fileName, meshSizes[i]);
+		cases.push_back(c);
+	}
+
+	for(size_t i = 0; i < numRigs; ++i)
+	{
+		BenchmarkCase c;
+		std::ostringstream name;
+		name << "rig" << rigSizes[i][0] << "x" << rigSizes[i][1];
+		c.m_name = name.str();
+		c.m_kind = "rig";
+		c.m_fileName = options.m_temp / (c.m_name + ".smd");
+		writeRigSmd(c.m_fileName, rigSizes[i][0], rigSizes[i][1], static_cast<size_t>(BENCHMARK_FPS));
+		cases.push_back(c);
+	}
+
+	return cases;
+}
+
+static void runCase(const BenchmarkCase& benchmarkCase, const BenchmarkOptions& options, JsonWriter& json)
+{
+	std::clog << "benchmarking " << benchmarkCase.m_name << std::endl;
+
+	json.beginObject();
+	json.value("name", benchmarkCase.m_name);
+	json.value("kind", benchmarkCase.m_kind);
+	json.value("file", benchmarkCase.m_fileName.filename().string());
+
+	// Loads of a released model parse the file again, the cache only holds models in use
+	std::vector<double> importTimes, boundsTimes, convertTimes, rigTimes, totalTimes;
+	size_t residentBefore, residentAfter, peak;
+	AssimpModelRef model;
+
+	try
+	{
+		for(size_t i = 0; i < options.m_iterations; ++i)
+		{
+			model.reset();
+			getMemoryUsage(&residentBefore, &peak);
+
+			Stopwatch timer(true);
+			model = AssimpModel::load(benchmarkCase.m_fileName, false);
+			totalTimes.push_back(timer.getSeconds());
+
+			getMemoryUsage(&residentAfter, &peak);
+
+			const ModelLoadStats& stats = model->getLoadStats();
+			importTimes.push_back(stats.mImportTime);
+			boundsTimes.push_back(stats.mBoundsTime);
+			convertTimes.push_back(stats.mConvertTime);
+			rigTimes.push_back(stats.mRigTime);
+		}
+	}
+	catch(const std::exception& e)
+	{
+		std::clog << "failed to load " << benchmarkCase.m_fileName.string() << ": " << e.what() << std::endl;
+		json.value("error", std::string(e.what()));
+		json.endObject();
+		return;
+	}
+
+	AssimpLoader loader(model);
+	size_t numVertices = 0;
+	size_t numTriangles = 0;
+	size_t numSkinnedVertices = 0;
+	size_t numBones = 0;
+
+	for(size_t m = 0; m < model->getNumMeshes(); ++m)
+	{
+		const AssimpMeshRef& mesh = model->getMesh(m);
+		numVertices += mesh->mCachedTriMesh.getNumVertices();
+		numTriangles += mesh->mCachedTriMesh.getNumIndices() / 3;
+		numSkinnedVertices += mesh->mSkinData.mNumVertices;
+		numBones += mesh->mSkinData.mNumBones;
+	}
+
+	const RigRef& rig = model->getRig();
+	size_t numChannels = rig->getNumClips() > 0 ? rig->getClip(0)->getNumChannels() : 0;
+
+	json.beginObject("model");
+	json.value("meshes", model->getNumMeshes());
+	json.value("vertices", numVertices);
+	json.value("triangles", numTriangles);
+	json.value("skinned_vertices", numSkinnedVertices);
+	json.value("bones", numBones);
+	json.value("clips", rig->getNumClips());
+	json.value("channels", numChannels);
+	json.endObject();
+
+	json.beginObject("load_ms");
+	json.value("import", getMedian(importTimes) * 1000.0);
+	json.value("bounds", getMedian(boundsTimes) * 1000.0);
+	json.value("convert", getMedian(convertTimes) * 1000.0);
+	json.value("rig", getMedian(rigTimes) * 1000.0);
+	json.value("total", getMedian(totalTimes) * 1000.0);
+	json.value("total_min", *std::min_element(totalTimes.begin(), totalTimes.end()) * 1000.0);
+	json.endObject();
+
+	json.beginObject("memory_kb");
+	json.value("model_resident", residentAfter > residentBefore ? residentAfter - residentBefore : size_t(0));
+	json.value("process_peak", peak);
+	json.endObject();
+
+	if(numSkinnedVertices == 0 || rig->getNumClips() == 0)
+	{
+		json.null("animation");
+		json.null("skinning");
+		json.endObject();
+		return;
+	}
+
+	json.beginObject("animation");
+	json.value("channels_per_ms", loader.benchmarkAnimation(options.m_iterations * 20));
+	json.value("characters_per_ms", loader.benchmarkCrowd(200, options.m_iterations * 4));
+	json.endObject();
+
+	// Playback as in the viewer, animation and skinning on the shared worker threads
+	loader.enableAnimation();
+	loader.enableSkinning();
+	loader.setAnimation(0);
+
+	double duration = loader.getAnimationDuration(0);
+	size_t skinned = 0;
+	Stopwatch timer(true);
+
+	for(size_t f = 0; f < options.m_frames; ++f)
+	{
+		loader.setTime(duration > 0.0 ? fmod(f / BENCHMARK_FPS, duration) : 0.0);
+		loader.update();
+		loader.finishUpdate();
+		skinned += loader.getUpdateStats().mVerticesSkinned;
+	}
+
+	double playbackSeconds = timer.getSeconds();
+
+	json.beginObject("skinning");
+	json.value("kernel", std::string(getSkinningKernelName()));
+	json.value("threads", loader.getNumSkinningThreads() + 1);
+	json.value("vertices_per_s", loader.benchmarkSkinning(options.m_iterations * 20));
+	json.value("frame_ms", playbackSeconds * 1000.0 / options.m_frames);
+	json.value("playback_vertices_per_s", playbackSeconds > 0.0 ? skinned / playbackSeconds : 0.0);
+	json.endObject();
+
+	json.endObject();
+}
+
+// Plays the frames of a loader, returns the number of frames after the first pass through the clip that allocated
+static size_t playFrames(AssimpLoader& loader, size_t numFrames, const char* mode)
+{
+	double duration = loader.getAnimationDuration(0);
+	size_t warmupFrames = static_cast<size_t>(ceil(duration * BENCHMARK_FPS)) + 1;
+	size_t failedFrames = 0;
+
+	for(size_t f = 0; f < warmupFrames + numFrames; ++f)
+	{
+		loader.setTime(duration > 0.0 ? fmod(f / BENCHMARK_FPS, duration) : 0.0);
+
+		// worker threads included, finishUpdate() waits for them
+		size_t numAllocations = s_numAllocations;
+		loader.update();
+		loader.finishUpdate();
+		numAllocations = s_numAllocations - numAllocations;
+
+		if(f >= warmupFrames && numAllocations > 0)
+		{
+			std::clog << mode << " frame " << f << ": " << numAllocations << " allocations" << std::endl;
+			++failedFrames;
+		}
+	}
+
+	return failedFrames;
+}
+
+// Animation and skinning of a generated rig, live and baked, returns the exit code
+static int checkAllocations(const BenchmarkOptions& options)
+{
+	boost::system::error_code error;
+	boost::filesystem::create_directories(options.m_temp, error);
+	boost::filesystem::path fileName = options.m_temp / "allocations.smd";
+	writeRigSmd(fileName, 64, 16, static_cast<size_t>(BENCHMARK_FPS));
+
+	size_t failedFrames = 0;
+
+	try
+	{
+		AssimpModelRef model = AssimpModel::load(fileName, false);
+		AssimpLoader loader(model);
+		loader.enableAnimation();
+		loader.enableSkinning();
+		loader.setAnimation(0);
+
+		failedFrames += playFrames(loader, options.m_frames, "skinning");
+
+		loader.setBakedAnimation(BakedAnimation::create(model, 0));
+		failedFrames += playFrames(loader, options.m_frames, "baked");
+	}
+	catch(const std::exception& e)
+	{
+		std::clog << "failed to load " << fileName.string() << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::clog << failedFrames << " of " << options.m_frames * 2 << " frames allocated" << std::endl;
+	return failedFrames > 0 ? 1 : 0;
+}
+
+// Samples every baked mesh at a few times, frames and the blends between them
+static std::vector<float> sampleBaked(const BakedAnimation& baked)
+{
+	const size_t kStride = 6;
+	std::vector<float> values;
+	std::vector<float> vertices;
+
+	for(size_t i = 0; i < baked.getModel()->getNumMeshes(); ++i)
+	{
+		if(!baked.hasMesh(i))
+			continue;
+
+		size_t numVertices = baked.getModel()->getMesh(i)->mSkinData.mNumVertices;
+		vertices.resize(numVertices * kStride);
+		for(size_t t = 0; t < 8; ++t)
+		{
+			baked.sample(i, baked.getDuration() * t / 7.0, 0, numVertices, &vertices[0], &vertices[3], kStride);
+			values.insert(values.end(), vertices.begin(), vertices.end());
+		}
+	}
+
+	return values;
+}
+
+// Writes and loads back the baked animation of a generated rig, returns the exit code
+static int checkBaked(const BenchmarkOptions& options)
+{
+	boost::system::error_code error;
+	boost::filesystem::create_directories(options.m_temp, error);
+	boost::filesystem::path fileName = options.m_temp / "baked.smd";
+	boost::filesystem::path cacheName = options.m_temp / "baked.cache";
+	boost::filesystem::path truncatedName = options.m_temp / "truncated.cache";
+	writeRigSmd(fileName, 64, 16, static_cast<size_t>(BENCHMARK_FPS));
+
+	try
+	{
+		AssimpModelRef model = AssimpModel::load(fileName, false);
+		BakedAnimationRef baked = BakedAnimation::create(model, 0);
+		baked->write(cacheName);
+
+		BakedAnimationRef loaded = BakedAnimation::load(model, cacheName);
+		if(loaded->getNumFrames() != baked->getNumFrames() || loaded->getMemorySize() != baked->getMemorySize() ||
+		   sampleBaked(*loaded) != sampleBaked(*baked))
+		{
+			std::clog << cacheName.string() << " does not load back the baked animation" << std::endl;
+			return 1;
+		}
+
+		// a cache cut short has to be rejected before its frames are read
+		boost::filesystem::copy_file(cacheName, truncatedName, boost::filesystem::copy_option::overwrite_if_exists);
+		boost::filesystem::resize_file(truncatedName, boost::filesystem::file_size(cacheName) - 1);
+		try
+		{
+			BakedAnimation::load(model, truncatedName);
+			std::clog << truncatedName.string() << " loaded although it is truncated" << std::endl;
+			return 1;
+		}
+		catch(const AssimpLoaderExc&)
+		{
+		}
+
+		std::clog << baked->getNumFrames() << " frames, " << baked->getMemorySize() << " bytes loaded back" << std::endl;
+	}
+	catch(const std::exception& e)
+	{
+		std::clog << "failed to bake " << fileName.string() << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions* options)
+{
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if(arg == "--assets" && hasValue)
+			options->m_assets = argv[++i];
+		else if(arg == "--output" && hasValue)
+			options->m_output = argv[++i];
+		else if(arg == "--trace" && hasValue)
+			options->m_trace = argv[++i];
+		else if(arg == "--iterations" && hasValue)
+			options->m_iterations = std::max(atoi(argv[++i]), 1);
+		else if(arg == "--frames" && hasValue)
+			options->m_frames = std::max(atoi(argv[++i]), 1);
+		else if(arg == "--quick")
+			options->m_quick = true;
+		else if(arg == "--check-allocations")
+			options->m_checkAllocations = true;
+		else if(arg == "--check-baked")
+			options->m_checkBaked = true;
+		else
+			return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+
+	if(!parseOptions(argc, argv, &options))
+	{
+		std::cerr << "usage: " << argv[0] << " [--assets DIR] [--iterations N] [--frames N] [--quick] [--output FILE] [--trace FILE] [--check-allocations] [--check-baked]" << std::endl;
+		return 2;
+	}
+
+	if(options.m_assets.empty())
+		options.m_assets = findAssetPath("models").parent_path();
+
+	options.m_temp = boost::filesystem::temp_directory_path() / "MeshBenchmark";
+
+	if(options.m_checkAllocations || options.m_checkBaked)
+	{
+		int result = options.m_checkAllocations ? checkAllocations(options) : 0;
+		if(options.m_checkBaked && result == 0)
+			result = checkBaked(options);
+		boost::system::error_code error;
+		boost::filesystem::remove_all(options.m_temp, error);
+		return result;
+	}
+
+	std::ofstream file;
+	std::ostream* os = &std::cout;
+
+	if(!options.m_output.empty())
+	{
+		file.open(options.m_output.string().c_str());
+
+		if(!file)
+		{
+			std::cerr << "cannot write " << options.m_output.string() << std::endl;
+			return 1;
+		}
+
+		os = &file;
+	}
+
+	if(!options.m_trace.empty())
+	{
+		Trace::enable();
+		Trace::setThreadName("main");
+	}
+
+	std::vector<BenchmarkCase> cases = collectCases(options);
+	JsonWriter json(*os);
+
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	json.beginObject();
+	json.value("schema", size_t(BENCHMARK_SCHEMA));
+	json.value("date", std::string(date));
+	json.value("hardware_threads", size_t(std::thread::hardware_concurrency()));
+	json.value("max_influences", size_t(MNDL_SKINNING_MAX_INFLUENCES));
+	json.value("iterations", options.m_iterations);
+	json.value("frames", options.m_frames);
+	json.beginArray("cases");
+
+	for(size_t i = 0; i < cases.size(); ++i)
+		runCase(cases[i], options, json);
+
+	json.endArray();
+	json.endObject();
+
+	if(!options.m_trace.empty())
+	{
+		size_t numEvents = Trace::write(options.m_trace.string());
+		std::cerr << numEvents << " trace events written to " << options.m_trace.string() << std::endl;
+	}
+
+	boost::system::error_code error;
+	boost::filesystem::remove_all(options.m_temp, error);
+	return 0;
+}
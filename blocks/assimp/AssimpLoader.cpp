@@ -20,12 +20,12 @@
 
 #include <assert.h>
 
-#include "cinder/app/App.h"
-#include "cinder/ImageIo.h"
 #include "cinder/CinderMath.h"
 #include "cinder/Utilities.h"
 
 #include "AssimpLoader.h"
+#include "Stopwatch.h"
+#include "Trace.h"
 
 using namespace std;
 using namespace ci;
@@ -35,158 +35,202 @@ namespace mndl
 namespace assimp
 {
 
-static void fromAssimp(const aiMesh* aim, TriMesh* cim)
+//! Number of vertices skinned by one worker task.
+static const size_t kSkinningTaskSize = 4096;
+
+struct SkinningTask
 {
-	// copy vertices
-	for(unsigned i = 0; i < aim->mNumVertices; ++i)
-	{
-		cim->appendVertex(fromAssimp(aim->mVertices[i]));
-	}
+	AssimpMeshInstance* mMesh;
+	float* mOutput; /// mapped skinned buffer of the mesh
+	size_t mBegin;
+	size_t mEnd;
+};
+
+//! Skinning work of one update, split into mesh and vertex range tasks.
+struct SkinningJob
+{
+	SkinningJob() : mInFlight(false), mBakedTime(0.0), mFinishTime(0.0) {}
 
-	if(aim->HasNormals())
+	~SkinningJob()
 	{
-		for(unsigned i = 0; i < aim->mNumVertices; ++i)
-		{
-			cim->appendNormal(fromAssimp(aim->mNormals[i]));
-		}
-	}
-	else
-	{
-		cim->recalculateNormals();
+		finish();
 	}
 
-	if(aim->HasTangentsAndBitangents())
+	void finish()
 	{
-		for(unsigned i = 0; i < aim->mNumVertices; ++i)
+		if(mInFlight)
 		{
-			cim->appendTangent(fromAssimp(aim->mTangents[i]));
+			mPoolRef->wait(mJob);
+			mInFlight = false;
 		}
 	}
-	else
-	{
-		cim->recalculateTangents();
-	}
 
-	// aiVector3D *	mTextureCoords [AI_MAX_NUMBER_OF_TEXTURECOORDS]
-	// just one for now
-	if(aim->GetNumUVChannels() > 0)
-	{
-		for(unsigned i = 0; i < aim->mNumVertices; ++i)
-		{
-			cim->appendTexCoord(Vec2f(aim->mTextureCoords[0][i].x,
-			                          aim->mTextureCoords[0][i].y));
-		}
-	}
+	static void runTask(void* context, size_t task);
 
-	//aiColor4D *mColors [AI_MAX_NUMBER_OF_COLOR_SETS]
-	if(aim->GetNumColorChannels() > 0)
-	{
-		for(unsigned i = 0; i < aim->mNumVertices; ++i)
-		{
-			cim->appendColorRgba(fromAssimp(aim->mColors[0][i]));
-		}
-	}
+	WorkerJob mJob;
+	WorkerPoolRef mPoolRef; /// pool the job has been submitted to
+	bool mInFlight;
 
-	for(unsigned i = 0; i < aim->mNumFaces; ++i)
-	{
-		if(aim->mFaces[i].mNumIndices > 3)
-		{
-			throw AssimpLoaderExc("non-triangular face found: model " +
-			                      string(aim->mName.data) + ", face #" +
-			                      toString< unsigned >(i));
-		}
+	std::vector< AssimpMeshInstanceRef > mMeshes; /// keeps the meshes alive while tasks are in flight
+	std::vector< SkinningTask > mTasks;
+	BakedAnimationRef mBakedRef; /// frames played instead of blending the bones, if set
+	double mBakedTime;
+	std::atomic< size_t > mRemainingTasks;
 
-		cim->appendTriangle(aim->mFaces[ i ].mIndices[ 0 ],
-		                    aim->mFaces[ i ].mIndices[ 1 ],
-		                    aim->mFaces[ i ].mIndices[ 2 ]);
-	}
+	Stopwatch mTimer;
+	double mFinishTime; /// written by the last task
+};
 
+void SkinningJob::runTask(void* context, size_t task)
+{
+	MNDL_TRACE_SCOPE("skinVertices");
+
+	SkinningJob* job = static_cast< SkinningJob* >(context);
+	const SkinningTask& skinningTask = job->mTasks[ task ];
+	AssimpMeshInstance* mesh = skinningTask.mMesh;
 
+	// blend the bone matrices per vertex and write positions and normals straight into the vertex buffer
+	if(job->mBakedRef)
+		job->mBakedRef->sample(mesh->mIndex, job->mBakedTime, skinningTask.mBegin, skinningTask.mEnd,
+		                       skinningTask.mOutput, skinningTask.mOutput + 3, SkinnedBuffers::kStride);
+	else
+		skinVertices(&mesh->mBonePalette[ 0 ], mesh->mMeshRef->mSkinData, skinningTask.mBegin, skinningTask.mEnd,
+		             skinningTask.mOutput, skinningTask.mOutput + 3, SkinnedBuffers::kStride);
+
+	if(--job->mRemainingTasks == 0)
+		job->mFinishTime = job->mTimer.getSeconds();
 }
 
-AssimpLoader::AssimpLoader(fs::path filename, bool loadTextures) :
-	mMaterialsEnabled(false),
-	mTexturesEnabled(loadTextures),
-	mSkinningEnabled(false),
-	mAnimationEnabled(false),
-	mFilePath(filename),
-	mAnimationIndex(0),
-	mLoadTextures(loadTextures)
+//! Number of animation channels sampled by one worker task.
+static const size_t kChannelTaskSize = 32;
+
+//! Channel sampling of one animation update, each task writes the local transforms of its own channels.
+struct AnimationJob
 {
-	// FIXME: aiProcessPreset_TargetRealtime_MaxQuality contains
-	// aiProcess_Debone which is buggy in 3.0.1270
-	unsigned flags = aiProcess_Triangulate |
-	                 aiProcess_FlipUVs |
-	                 aiProcessPreset_TargetRealtime_Quality |
-	                 aiProcess_FindInstances |
-	                 aiProcess_ValidateDataStructure |
-	                 aiProcess_OptimizeMeshes;
+	AnimationJob() : mClip(NULL), mTicks(0.0) {}
+
+	static void runTask(void* context, size_t task);
+
+	WorkerJob mJob;
+	const AnimationClip* mClip;
+	double mTicks;
 
-	mImporterRef = shared_ptr< Assimp::Importer >(new Assimp::Importer());
-	mImporterRef->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
-	                                 aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-	mImporterRef->SetPropertyInteger(AI_CONFIG_PP_PTV_NORMALIZE, true);
+	std::vector< aiVector3D > mPositions; /// by channel, grown to the largest clip
+	std::vector< aiQuaternion > mRotations;
+	std::vector< aiVector3D > mScalings;
+};
 
-	mScene = mImporterRef->ReadFile(filename.string(), flags);
-	if(!mScene)
-		throw AssimpLoaderExc(mImporterRef->GetErrorString());
+void AnimationJob::runTask(void* context, size_t task)
+{
+	MNDL_TRACE_SCOPE("evaluateChannels");
 
-	calculateDimensions();
+	AnimationJob* job = static_cast< AnimationJob* >(context);
+	const AnimationClip& clip = *job->mClip;
 
-	loadAllMeshes();
-	mRootNode = loadNodes(mScene->mRootNode);
+	size_t begin = task * kChannelTaskSize;
+	size_t end = math< size_t >::min(begin + kChannelTaskSize, clip.getNumChannels());
+	for(size_t a = begin; a < end; ++a)
+	{
+		clip.sampleChannel(a, job->mTicks, &job->mPositions[ a ], &job->mRotations[ a ], &job->mScalings[ a ]);
+	}
 }
 
-void AssimpLoader::calculateDimensions()
+//! Worker threads shared by the loaders without a pool of their own.
+static mutex sWorkerPoolMutex;
+static weak_ptr< WorkerPool > sWorkerPool;
+
+static WorkerPoolRef getSharedWorkerPool()
 {
-	Vec3f aMin, aMax;
-	calculateBoundingBox(&aMin, &aMax);
-	mBoundingBox = AxisAlignedBox3f(aMin, aMax);
+	lock_guard< mutex > lock(sWorkerPoolMutex);
+	WorkerPoolRef poolRef = sWorkerPool.lock();
+	if(!poolRef)
+	{
+		// leave one core for the thread calling update and draw
+		unsigned numCores = thread::hardware_concurrency();
+		poolRef = WorkerPool::create(numCores > 1 ? numCores - 1 : 0);
+		sWorkerPool = poolRef;
+	}
+	return poolRef;
 }
 
-void AssimpLoader::calculateBoundingBox(ci::Vec3f* min, ci::Vec3f* max)
+AssimpLoader::AssimpLoader(fs::path filename, bool loadTextures) :
+	mModelRef(AssimpModel::load(filename, loadTextures)),
+	mMaterialsEnabled(false),
+	mTexturesEnabled(loadTextures),
+	mSkinningEnabled(false),
+	mAnimationEnabled(false),
+	mSkinningOverlap(false),
+	mSkinningMode(SKINNING_CPU),
+	mSkinningTime(0.0),
+	mAnimationIndex(0),
+	mAnimationTime(0.0),
+	mAnimationEvaluated(false),
+	mEvaluatedAnimationIndex(0),
+	mEvaluatedAnimationTime(0.0),
+	mPoseVersion(0),
+#ifndef MNDL_HEADLESS
+	mRenderQueueRef(RenderQueue::create()),
+#endif
+	mCullingEnabled(false),
+	mBakedEvaluated(false),
+	mBakedTime(0.0)
 {
-	aiMatrix4x4 trafo;
-
-	aiVector3D aiMin, aiMax;
-	aiMin.x = aiMin.y = aiMin.z =  1e10f;
-	aiMax.x = aiMax.y = aiMax.z = -1e10f;
-
-	calculateBoundingBoxForNode(mScene->mRootNode, &aiMin, &aiMax, &trafo);
-	*min = fromAssimp(aiMin);
-	*max = fromAssimp(aiMax);
+	init();
 }
 
-void AssimpLoader::calculateBoundingBoxForNode(const aiNode* nd, aiVector3D* min, aiVector3D* max, aiMatrix4x4* trafo)
+AssimpLoader::AssimpLoader(AssimpModelRef model) :
+	mModelRef(model),
+	mMaterialsEnabled(false),
+	mTexturesEnabled(model->getLoadTextures()),
+	mSkinningEnabled(false),
+	mAnimationEnabled(false),
+	mSkinningOverlap(false),
+	mSkinningMode(SKINNING_CPU),
+	mSkinningTime(0.0),
+	mAnimationIndex(0),
+	mAnimationTime(0.0),
+	mAnimationEvaluated(false),
+	mEvaluatedAnimationIndex(0),
+	mEvaluatedAnimationTime(0.0),
+	mPoseVersion(0),
+#ifndef MNDL_HEADLESS
+	mRenderQueueRef(RenderQueue::create()),
+#endif
+	mCullingEnabled(false),
+	mBakedEvaluated(false),
+	mBakedTime(0.0)
 {
-	aiMatrix4x4 prev;
-
-	prev = *trafo;
-	*trafo = *trafo * nd->mTransformation;
+	init();
+}
 
-	for(unsigned n = 0; n < nd->mNumMeshes; ++n)
+void AssimpLoader::init()
+{
+	// the pose dependent state of every mesh
+	for(size_t i = 0; i < mModelRef->getNumMeshes(); ++i)
 	{
-		const struct aiMesh* mesh = mScene->mMeshes[ nd->mMeshes[ n ] ];
-		for(unsigned t = 0; t < mesh->mNumVertices; ++t)
-		{
-			aiVector3D tmp = mesh->mVertices[ t ];
-			tmp *= (*trafo);
-
-			min->x = math<float>::min(min->x, tmp.x);
-			min->y = math<float>::min(min->y, tmp.y);
-			min->z = math<float>::min(min->z, tmp.z);
-			max->x = math<float>::max(max->x, tmp.x);
-			max->y = math<float>::max(max->y, tmp.y);
-			max->z = math<float>::max(max->z, tmp.z);
-		}
+		const AssimpMeshRef& assimpMeshRef = mModelRef->getMesh(i);
+
+		AssimpMeshInstanceRef meshInstanceRef(new AssimpMeshInstance());
+		meshInstanceRef->mMeshRef = assimpMeshRef;
+		meshInstanceRef->mIndex = i;
+		meshInstanceRef->mPaletteHash = 0;
+		meshInstanceRef->mPoseVersion = static_cast< size_t >(-1); // no palette yet, calculated by the first skinning
+		meshInstanceRef->mSkinnedBounds = assimpMeshRef->mBounds;
+		meshInstanceRef->mSkinPending = false;
+		if(!assimpMeshRef->mSkinData.empty())
+			meshInstanceRef->mSkinnedBuffersRef = SkinnedBuffers::create(assimpMeshRef->mSkinData.mNumVertices);
+		mModelMeshes.push_back(meshInstanceRef);
 	}
 
-	for(unsigned n = 0; n < nd->mNumChildren; ++n)
-	{
-		calculateBoundingBoxForNode(nd->mChildren[n], min, max, trafo);
-	}
+	mRootNode = loadNodes(mModelRef->getScene()->mRootNode);
+
+	resolveNodeReferences();
 
-	*trafo = prev;
+	mSkinningJobRef = shared_ptr< SkinningJob >(new SkinningJob());
+	mSkinningJobRef->mMeshes = mModelMeshes;
+	mAnimationJobRef = shared_ptr< AnimationJob >(new AnimationJob());
+
+	mWorkerPoolRef = getSharedWorkerPool();
 }
 
 AssimpNodeRef AssimpLoader::loadNodes(const aiNode* nd, AssimpNodeRef parentRef)
@@ -233,332 +277,86 @@ AssimpNodeRef AssimpLoader::loadNodes(const aiNode* nd, AssimpNodeRef parentRef)
 	return nodeRef;
 }
 
-AssimpMeshRef AssimpLoader::convertAiMesh(const aiMesh* mesh)
+void AssimpLoader::resolveNodeReferences()
 {
-	// the current AssimpMesh we will be populating data into.
-	AssimpMeshRef assimpMeshRef = AssimpMeshRef(new AssimpMesh());
-
-	assimpMeshRef->mName = fromAssimp(mesh->mName);
-
-	// Handle material info
-	aiMaterial* mtl = mScene->mMaterials[ mesh->mMaterialIndex ];
-
-	aiString name;
-	mtl->Get(AI_MATKEY_NAME, name);
-	app::console() << "material " << fromAssimp(name) << endl;
-
-	// Culling
-	int twoSided;
-	if((AI_SUCCESS == mtl->Get(AI_MATKEY_TWOSIDED, twoSided)) && twoSided)
-	{
-		assimpMeshRef->mTwoSided = true;
-		assimpMeshRef->mMaterial.setFace(GL_FRONT_AND_BACK);
-		app::console() << " two sided" << endl;
-	}
-	else
+	// bones, the palette is sized once, the last entry is used by vertices without weights
+	for(vector< AssimpMeshInstanceRef >::const_iterator meshIt = mModelMeshes.begin();
+	        meshIt != mModelMeshes.end(); ++meshIt)
 	{
-		assimpMeshRef->mTwoSided = false;
-		assimpMeshRef->mMaterial.setFace(GL_FRONT);
-	}
-
-	aiColor4D dcolor, scolor, acolor, ecolor;
-	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_DIFFUSE, dcolor))
-	{
-		assimpMeshRef->mMaterial.setDiffuse(fromAssimp(dcolor));
-		app::console() << " diffuse: " << fromAssimp(dcolor) << endl;
-	}
-
-	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_SPECULAR, scolor))
-	{
-		assimpMeshRef->mMaterial.setSpecular(fromAssimp(scolor));
-		app::console() << " specular: " << fromAssimp(scolor) << endl;
-	}
-
-	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_AMBIENT, acolor))
-	{
-		assimpMeshRef->mMaterial.setAmbient(fromAssimp(acolor));
-		app::console() << " ambient: " << fromAssimp(acolor) << endl;
-	}
-
-	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_EMISSIVE, ecolor))
-	{
-		assimpMeshRef->mMaterial.setEmission(fromAssimp(ecolor));
-		app::console() << " emission: " << fromAssimp(ecolor) << endl;
-	}
-
-	/*
-	// FIXME: not sensible data, obj .mtl Ns 96.078431 -> 384.314
-	float shininessStrength = 1;
-	if ( AI_SUCCESS == mtl->Get( AI_MATKEY_SHININESS_STRENGTH, shininessStrength ) )
-	{
-		app::console() << "shininess strength: " << shininessStrength << endl;
-	}
-	float shininess;
-	if ( AI_SUCCESS == mtl->Get( AI_MATKEY_SHININESS, shininess ) )
-	{
-		assimpMeshRef->mMaterial.setShininess( shininess * shininessStrength );
-		app::console() << "shininess: " << shininess * shininessStrength << "[" <<
-			shininess << "]" << endl;
-	}
-	*/
-
-	// TODO: handle blending
-#if 0
-	int blendMode;
-	if(AI_SUCCESS == aiGetMaterialInteger(mtl, AI_MATKEY_BLEND_FUNC, &blendMode))
-	{
-		if(blendMode==aiBlendMode_Default)
+		const AssimpMeshInstanceRef& meshInstanceRef = *meshIt;
+		const AssimpMesh& assimpMesh = *meshInstanceRef->mMeshRef;
+		const aiMesh* mesh = assimpMesh.mAiMesh;
+		if(!mesh->HasBones())
+			continue;
+
+		meshInstanceRef->mBoneNodes.resize(mesh->mNumBones);
+		for(unsigned a = 0; a < mesh->mNumBones; ++a)
 		{
-			meshHelper.blendMode=OF_BLENDMODE_ALPHA;
+			AssimpNodeRef nodeRef = getAssimpNode(fromAssimp(mesh->mBones[ a ]->mName));
+			if(!nodeRef)
+				throw AssimpLoaderExc("bone " + fromAssimp(mesh->mBones[ a ]->mName) +
+				                      " of mesh " + assimpMesh.mName + " not found.");
+			meshInstanceRef->mBoneNodes[ a ] = nodeRef.get();
 		}
-		else
-		{
-			meshHelper.blendMode=OF_BLENDMODE_ADD;
-		}
-	}
-#endif
 
-	// Load Textures
-	int texIndex = 0;
-	aiString texPath;
+		meshInstanceRef->mBonePalette.resize(assimpMesh.mSkinData.getPaletteSize());
+		setSkinMatrixIdentity(&meshInstanceRef->mBonePalette.back());
+	}
 
-	// TODO: handle other aiTextureTypes
-	if(mLoadTextures && AI_SUCCESS == mtl->GetTexture(aiTextureType_DIFFUSE, texIndex, &texPath))
+	// rig nodes, animation channels are bound to them
+	const Rig& rig = *mModelRef->getRig();
+	mRigNodes.resize(rig.getNumNodes());
+	for(size_t i = 0; i < rig.getNumNodes(); ++i)
 	{
-		app::console() << " diffuse texture " << texPath.data;
-		fs::path texFsPath(texPath.data);
-		fs::path realPath;
-
-		if(fs::exists(texFsPath))
-		{
-			realPath = texFsPath;
-		}
-		else
-		{
-			fs::path texFile = texFsPath.filename();
-			realPath = app::getAssetPath(texFile);
-
-			if(!realPath.empty())
-			{
-				app::console() << " [" << realPath.string() << "]" << endl;
-			}
-			else
-			{
-				app::console() << " not found " << endl;
-			}
-		}
+		mRigNodes[ i ] = getAssimpNode(rig.getNodeName(i)).get();
+	}
+}
 
-		app::console() << " [" << realPath.string() << "]" << endl;
+void AssimpLoader::updateAnimation(size_t animationIndex, double currentTime)
+{
+	MNDL_TRACE_SCOPE("AssimpLoader::updateAnimation");
 
-		// texture wrap
-		gl::Texture::Format format;
-		int uwrap;
-		if(AI_SUCCESS == mtl->Get(AI_MATKEY_MAPPINGMODE_U_DIFFUSE(0), uwrap))
-		{
-			switch(uwrap)
-			{
-				case aiTextureMapMode_Wrap:
-					format.setWrapS(GL_REPEAT);
-					break;
-
-				case aiTextureMapMode_Clamp:
-					format.setWrapS(GL_CLAMP);
-					break;
-
-				case aiTextureMapMode_Decal:
-					// If the texture coordinates for a pixel are outside [0...1]
-					// the texture is not applied to that pixel.
-					format.setWrapS(GL_CLAMP_TO_EDGE);
-					break;
-
-				case aiTextureMapMode_Mirror:
-					// A texture coordinate u|v becomes u%1|v%1 if (u-(u%1))%2
-					// is zero and 1-(u%1)|1-(v%1) otherwise.
-					// TODO
-					format.setWrapS(GL_REPEAT);
-					break;
-			}
-		}
-		int vwrap;
-		if(AI_SUCCESS == mtl->Get(AI_MATKEY_MAPPINGMODE_V_DIFFUSE(0), vwrap))
-		{
-			switch(vwrap)
-			{
-				case aiTextureMapMode_Wrap:
-					format.setWrapT(GL_REPEAT);
-					break;
-
-				case aiTextureMapMode_Clamp:
-					format.setWrapT(GL_CLAMP);
-					break;
-
-				case aiTextureMapMode_Decal:
-					// If the texture coordinates for a pixel are outside [0...1]
-					// the texture is not applied to that pixel.
-					format.setWrapT(GL_CLAMP_TO_EDGE);
-					break;
-
-				case aiTextureMapMode_Mirror:
-					// A texture coordinate u|v becomes u%1|v%1 if (u-(u%1))%2
-					// is zero and 1-(u%1)|1-(v%1) otherwise.
-					// TODO
-					format.setWrapT(GL_REPEAT);
-					break;
-			}
-		}
+	const Rig& rig = *mModelRef->getRig();
+	if(animationIndex >= rig.getNumClips())
+		return;
 
-		if(!realPath.empty())
-		{
-			assimpMeshRef->mTexture = gl::Texture(loadImage(realPath), format);
-		}
-	}
+	const AnimationClip& clip = *rig.getClip(animationIndex);
+	const size_t numChannels = clip.getNumChannels();
 
-	assimpMeshRef->mAiMesh = mesh;
-	fromAssimp(mesh, &assimpMeshRef->mCachedTriMesh);
-	assimpMeshRef->mCachedVboMesh = ci::gl::VboMesh::create(assimpMeshRef->mCachedTriMesh);
-	assimpMeshRef->mValidCache = true;
-	assimpMeshRef->mAnimatedPos.resize(mesh->mNumVertices);
-	if(mesh->HasNormals())
+	// sample the channels into local transforms, on the worker threads for rigs with many channels
+	AnimationJob& job = *mAnimationJobRef;
+	if(job.mPositions.size() < numChannels)
 	{
-		assimpMeshRef->mAnimatedNorm.resize(mesh->mNumVertices);
+		job.mPositions.resize(numChannels);
+		job.mRotations.resize(numChannels);
+		job.mScalings.resize(numChannels);
 	}
+	job.mClip = &clip;
+	job.mTicks = currentTime * clip.getTicksPerSecond();
 
-
-	assimpMeshRef->mIndices.resize(mesh->mNumFaces * 3);
-	unsigned j = 0;
-	for(unsigned x = 0; x < mesh->mNumFaces; ++x)
+	size_t numTasks = (numChannels + kChannelTaskSize - 1) / kChannelTaskSize;
+	if(numTasks > 1 && mWorkerPoolRef && mWorkerPoolRef->getNumThreads() > 0)
 	{
-		for(unsigned a = 0; a < mesh->mFaces[x].mNumIndices; ++a)
-		{
-			assimpMeshRef->mIndices[ j++ ] = mesh->mFaces[ x ].mIndices[ a ];
-		}
+		job.mJob.set(&AnimationJob::runTask, &job, numTasks);
+		mWorkerPoolRef->run(job.mJob);
 	}
-
-	return assimpMeshRef;
-}
-
-void AssimpLoader::loadAllMeshes()
-{
-	app::console() << "loading model " << mFilePath.filename().string() <<
-	               " [" << mFilePath.string() << "] " << endl;
-	for(unsigned i = 0; i < mScene->mNumMeshes; ++i)
+	else
 	{
-		string name = fromAssimp(mScene->mMeshes[ i ]->mName);
-		app::console() << "loading mesh " << i;
-		if(name != "")
-			app::console() << " [" << name << "]";
-		app::console() << endl;
-		AssimpMeshRef assimpMeshRef = convertAiMesh(mScene->mMeshes[ i ]);
-		mModelMeshes.push_back(assimpMeshRef);
+		for(size_t t = 0; t < numTasks; ++t)
+			AnimationJob::runTask(&job, t);
 	}
 
-#if 0
-	animationTime = -1;
-	setNormalizedTime(0);
-#endif
-
-	app::console() << "finished loading model " << mFilePath.filename().string() << endl;
-}
-
-void AssimpLoader::updateAnimation(size_t animationIndex, double currentTime)
-{
-	if(mScene->mNumAnimations == 0)
-		return;
-
-	const aiAnimation* mAnim = mScene->mAnimations[ animationIndex ];
-	double ticks = mAnim->mTicksPerSecond;
-	if(ticks == 0.0)
-		ticks = 1.0;
-	currentTime *= ticks;
-
-	// calculate the transformations for each animation channel
-	for(unsigned int a = 0; a < mAnim->mNumChannels; a++)
+	// the node hierarchy is not thread safe, merged in channel order as a serial pass would
+	for(size_t a = 0; a < numChannels; ++a)
 	{
-		const aiNodeAnim* channel = mAnim->mChannels[ a ];
-
-		AssimpNodeRef targetNode = getAssimpNode(fromAssimp(channel->mNodeName));
-
-		// ******** Position *****
-		aiVector3D presentPosition(0, 0, 0);
-		if(channel->mNumPositionKeys > 0)
-		{
-			// Look for present frame number. Search from last position if time is after the last time, else from beginning
-			// Should be much quicker than always looking from start for the average use case.
-			unsigned int frame = 0;// (currentTime >= lastAnimationTime) ? lastFramePositionIndex : 0;
-			while(frame < channel->mNumPositionKeys - 1)
-			{
-				if(currentTime < channel->mPositionKeys[frame+1].mTime)
-					break;
-				frame++;
-			}
-
-			// interpolate between this frame's value and next frame's value
-			unsigned int nextFrame = (frame + 1) % channel->mNumPositionKeys;
-			const aiVectorKey& key = channel->mPositionKeys[frame];
-			const aiVectorKey& nextKey = channel->mPositionKeys[nextFrame];
-			double diffTime = nextKey.mTime - key.mTime;
-			if(diffTime < 0.0)
-				diffTime += mAnim->mDuration;
-			if(diffTime > 0)
-			{
-				float factor = float((currentTime - key.mTime) / diffTime);
-				presentPosition = key.mValue + (nextKey.mValue - key.mValue) * factor;
-			}
-			else
-			{
-				presentPosition = key.mValue;
-			}
-		}
-
-		// ******** Rotation *********
-		aiQuaternion presentRotation(1, 0, 0, 0);
-		if(channel->mNumRotationKeys > 0)
-		{
-			unsigned int frame = 0;//(currentTime >= lastAnimationTime) ? lastFrameRotationIndex : 0;
-			while(frame < channel->mNumRotationKeys - 1)
-			{
-				if(currentTime < channel->mRotationKeys[frame+1].mTime)
-					break;
-				frame++;
-			}
-
-			// interpolate between this frame's value and next frame's value
-			unsigned int nextFrame = (frame + 1) % channel->mNumRotationKeys;
-			const aiQuatKey& key = channel->mRotationKeys[frame];
-			const aiQuatKey& nextKey = channel->mRotationKeys[nextFrame];
-			double diffTime = nextKey.mTime - key.mTime;
-			if(diffTime < 0.0)
-				diffTime += mAnim->mDuration;
-			if(diffTime > 0)
-			{
-				float factor = float((currentTime - key.mTime) / diffTime);
-				aiQuaternion::Interpolate(presentRotation, key.mValue, nextKey.mValue, factor);
-			}
-			else
-			{
-				presentRotation = key.mValue;
-			}
-		}
-
-		// ******** Scaling **********
-		aiVector3D presentScaling(1, 1, 1);
-		if(channel->mNumScalingKeys > 0)
-		{
-			unsigned int frame = 0;//(currentTime >= lastAnimationTime) ? lastFrameScaleIndex : 0;
-			while(frame < channel->mNumScalingKeys - 1)
-			{
-				if(currentTime < channel->mScalingKeys[frame+1].mTime)
-					break;
-				frame++;
-			}
-
-			// TODO: (thom) interpolation maybe? This time maybe even logarithmic, not linear
-			presentScaling = channel->mScalingKeys[frame].mValue;
-		}
-
-		targetNode->setOrientation(fromAssimp(presentRotation));
-		targetNode->setScale(fromAssimp(presentScaling));
-		targetNode->setPosition(fromAssimp(presentPosition));
+		size_t node = clip.getChannelNode(a);
+		if(node == Rig::kInvalidNode)
+			continue;
+
+		AssimpNode* targetNode = mRigNodes[ node ];
+		targetNode->setOrientation(fromAssimp(job.mRotations[ a ]));
+		targetNode->setScale(fromAssimp(job.mScalings[ a ]));
+		targetNode->setPosition(fromAssimp(job.mPositions[ a ]));
 	}
 }
 
@@ -593,7 +391,7 @@ TriMesh& AssimpLoader::getAssimpNodeMesh(const string& name, size_t n /* = 0 */)
 {
 	AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mCachedTriMesh;
+		return node->mMeshes[ n ]->mMeshRef->mCachedTriMesh;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
@@ -602,16 +400,17 @@ const TriMesh& AssimpLoader::getAssimpNodeMesh(const string& name, size_t n /* =
 {
 	const AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mCachedTriMesh;
+		return node->mMeshes[ n ]->mMeshRef->mCachedTriMesh;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
 
+#ifndef MNDL_HEADLESS
 gl::Texture& AssimpLoader::getAssimpNodeTexture(const string& name, size_t n /* = 0 */)
 {
 	AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mTexture;
+		return node->mMeshes[ n ]->mMeshRef->mTexture;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
@@ -620,7 +419,7 @@ const gl::Texture& AssimpLoader::getAssimpNodeTexture(const string& name, size_t
 {
 	const AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mTexture;
+		return node->mMeshes[ n ]->mMeshRef->mTexture;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
@@ -629,7 +428,7 @@ gl::Material& AssimpLoader::getAssimpNodeMaterial(const string& name, size_t n /
 {
 	AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mMaterial;
+		return node->mMeshes[ n ]->mMeshRef->mMaterial;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
@@ -638,16 +437,22 @@ const gl::Material& AssimpLoader::getAssimpNodeMaterial(const string& name, size
 {
 	const AssimpNodeRef node = getAssimpNode(name);
 	if(node && n < node->mMeshes.size())
-		return node->mMeshes[ n ]->mMaterial;
+		return node->mMeshes[ n ]->mMeshRef->mMaterial;
 	else
 		throw AssimpLoaderExc("node " + name + " not found.");
 }
+#endif
 
 void AssimpLoader::setNodeOrientation(const string& name, const Quatf& rot)
 {
 	AssimpNodeRef node = getAssimpNode(name);
 	if(node)
+	{
 		node->setOrientation(rot);
+		// animated nodes are overwritten again by the next update
+		mAnimationEvaluated = false;
+		++mPoseVersion;
+	}
 }
 
 Quatf AssimpLoader::getNodeOrientation(const string& name)
@@ -661,7 +466,7 @@ Quatf AssimpLoader::getNodeOrientation(const string& name)
 
 size_t AssimpLoader::getNumAnimations() const
 {
-	return mScene->mNumAnimations;
+	return mModelRef->getRig()->getNumClips();
 }
 
 void AssimpLoader::setAnimation(size_t n)
@@ -676,217 +481,593 @@ void AssimpLoader::setTime(double t)
 
 double AssimpLoader::getAnimationDuration(size_t n) const
 {
-	const aiAnimation* anim = mScene->mAnimations[ n ];
-	double ticks = anim->mTicksPerSecond;
-	if(ticks == 0.0)
-		ticks = 1.0;
-	return anim->mDuration / ticks;
+	return mModelRef->getRig()->getClip(n)->getDuration();
 }
 
-void AssimpLoader::updateSkinning()
+void AssimpLoader::calculateBonePalette(AssimpMeshInstance* meshInstance)
 {
-	vector< AssimpNodeRef >::const_iterator it = mMeshNodes.begin();
-	for(; it != mMeshNodes.end(); ++it)
+	const aiMesh* mesh = meshInstance->mMeshRef->mAiMesh;
+	std::vector< SkinMatrix >& palette = meshInstance->mBonePalette;
+
+	for(unsigned a = 0; a < mesh->mNumBones; ++a)
 	{
-		AssimpNodeRef nodeRef = *it;
+		// start with the mesh-to-bone matrix
+		// and append all node transformations down the parent chain until
+		// we're back at mesh coordinates again
+		toSkinMatrix(toAssimp(meshInstance->mBoneNodes[ a ]->getDerivedTransform()) *
+		             mesh->mBones[ a ]->mOffsetMatrix,
+		             &palette[ a ]);
+	}
+}
 
-		vector< AssimpMeshRef >::const_iterator meshIt = nodeRef->mMeshes.begin();
-		for(; meshIt != nodeRef->mMeshes.end(); ++meshIt)
+void AssimpLoader::updateSkinnedBounds(AssimpMeshInstance* meshInstance)
+{
+	float minPos[ 3 ], maxPos[ 3 ];
+	if(calculateSkinnedBounds(&meshInstance->mBonePalette[ 0 ], meshInstance->mMeshRef->mSkinData, minPos, maxPos))
+		meshInstance->mSkinnedBounds = AxisAlignedBox3f(Vec3f(minPos[ 0 ], minPos[ 1 ], minPos[ 2 ]),
+		                                                Vec3f(maxPos[ 0 ], maxPos[ 1 ], maxPos[ 2 ]));
+}
+
+void AssimpLoader::setCullingFrustum(const Frustumf& frustum, const Matrix44f& parentTransform)
+{
+	mCullingEnabled = true;
+	mCullingFrustum = frustum;
+	mCullingTransform = parentTransform;
+}
+
+bool AssimpLoader::isVisible(const AssimpMeshInstance& meshInstance) const
+{
+	if(!mCullingEnabled)
+		return true;
+
+	const AxisAlignedBox3f& bounds = mSkinningEnabled ? meshInstance.mSkinnedBounds : meshInstance.mMeshRef->mBounds;
+	return mCullingFrustum.intersects(bounds.transformed(mCullingTransform * mTransform));
+}
+
+void AssimpLoader::skinPendingMesh(AssimpMeshInstance* meshInstance)
+{
+	const SkinData& skinData = meshInstance->mMeshRef->mSkinData;
+
+	// pending until a buffer could be mapped
+	if(isPlayingBakedAnimation())
+	{
+		float* output = meshInstance->mSkinnedBuffersRef->map();
+		if(!output)
+			return;
+		mBakedAnimationRef->sample(meshInstance->mIndex, mBakedTime, 0, skinData.mNumVertices,
+		                           output, output + 3, SkinnedBuffers::kStride);
+		meshInstance->mSkinnedBuffersRef->unmap();
+
+		meshInstance->mPaletteHash = 0;
+		mAnimationEvaluated = false;
+		++mPoseVersion;
+	}
+	else if(mSkinningMode == SKINNING_GPU && meshInstance->mBonePalette.size() <= PaletteBuffer::kMaxBones)
+	{
+		if(!meshInstance->mPaletteBufferRef)
+			meshInstance->mPaletteBufferRef = PaletteBuffer::create();
+		meshInstance->mPaletteBufferRef->update(&meshInstance->mBonePalette[ 0 ], meshInstance->mBonePalette.size());
+		meshInstance->mPaletteHash = hashSkinMatrices(&meshInstance->mBonePalette[ 0 ], meshInstance->mBonePalette.size());
+	}
+	else
+	{
+		// a single mesh on the thread drawing it, the worker threads may still be busy with the next update
+		float* output = meshInstance->mSkinnedBuffersRef->map();
+		if(!output)
+			return;
+		skinVertices(&meshInstance->mBonePalette[ 0 ], skinData, 0, skinData.mNumVertices,
+		             output, output + 3, SkinnedBuffers::kStride);
+		meshInstance->mSkinnedBuffersRef->unmap();
+		meshInstance->mPaletteHash = hashSkinMatrices(&meshInstance->mBonePalette[ 0 ], meshInstance->mBonePalette.size());
+	}
+
+	meshInstance->mSkinPending = false;
+	++mUpdateStats.mMeshesSkinned;
+	++mUpdateStats.mMeshesSkinnedOnDraw;
+	mUpdateStats.mVerticesSkinned += skinData.mNumVertices;
+}
+
+AxisAlignedBox3f AssimpLoader::getSkinnedBoundingBox() const
+{
+	if(mModelMeshes.empty())
+		return AxisAlignedBox3f();
+
+	Vec3f minPos = getMeshBoundingBox(0).getMin();
+	Vec3f maxPos = getMeshBoundingBox(0).getMax();
+	for(size_t i = 1; i < mModelMeshes.size(); ++i)
+	{
+		const AxisAlignedBox3f& bounds = getMeshBoundingBox(i);
+		for(int c = 0; c < 3; ++c)
 		{
-			AssimpMeshRef assimpMeshRef = *meshIt;
-
-			// current mesh we are introspecting
-			const aiMesh* mesh = assimpMeshRef->mAiMesh;
-
-			// calculate bone matrices
-			std::vector< aiMatrix4x4 > boneMatrices(mesh->mNumBones);
-			for(unsigned a = 0; a < mesh->mNumBones; ++a)
-			{
-				const aiBone* bone = mesh->mBones[ a ];
-
-				// find the corresponding node by again looking recursively through
-				// the node hierarchy for the same name
-				AssimpNodeRef nodeRef = getAssimpNode(fromAssimp(bone->mName));
-				assert(nodeRef);
-				// start with the mesh-to-bone matrix
-				// and append all node transformations down the parent chain until
-				// we're back at mesh coordinates again
-				boneMatrices[ a ] = toAssimp(nodeRef->getDerivedTransform()) *
-				                    bone->mOffsetMatrix;
-			}
-
-			assimpMeshRef->mValidCache = false;
-
-			assimpMeshRef->mAnimatedPos.assign(assimpMeshRef->mAnimatedPos.size(),
-			                                   aiVector3D(0, 0, 0));
-			if(mesh->HasNormals())
-			{
-				assimpMeshRef->mAnimatedNorm.assign(assimpMeshRef->mAnimatedNorm.size(),
-				                                    aiVector3D(0, 0, 0));
-			}
-
-			// loop through all vertex weights of all bones
-			for(unsigned a = 0; a < mesh->mNumBones; ++a)
-			{
-				const aiBone* bone = mesh->mBones[a];
-				const aiMatrix4x4& posTrafo = boneMatrices[ a ];
-
-				for(unsigned b = 0; b < bone->mNumWeights; ++b)
-				{
-					const aiVertexWeight& weight = bone->mWeights[ b ];
-					size_t vertexId = weight.mVertexId;
-					const aiVector3D& srcPos = mesh->mVertices[vertexId];
-
-					assimpMeshRef->mAnimatedPos[vertexId] += weight.mWeight * (posTrafo * srcPos);
-				}
-
-				if(mesh->HasNormals())
-				{
-					// 3x3 matrix, contains the bone matrix without the
-					// translation, only with rotation and possibly scaling
-					aiMatrix3x3 normTrafo = aiMatrix3x3(posTrafo);
-					for(size_t b = 0; b < bone->mNumWeights; ++b)
-					{
-						const aiVertexWeight& weight = bone->mWeights[b];
-						size_t vertexId = weight.mVertexId;
-
-						const aiVector3D& srcNorm = mesh->mNormals[vertexId];
-						assimpMeshRef->mAnimatedNorm[vertexId] += weight.mWeight * (normTrafo * srcNorm);
-					}
-				}
-			}
+			minPos[ c ] = math< float >::min(minPos[ c ], bounds.getMin()[ c ]);
+			maxPos[ c ] = math< float >::max(maxPos[ c ], bounds.getMax()[ c ]);
 		}
 	}
+	return AxisAlignedBox3f(minPos, maxPos);
 }
 
-void AssimpLoader::updateMeshes()
+void AssimpLoader::startSkinning()
 {
-	vector< AssimpNodeRef >::iterator it = mMeshNodes.begin();
-	for(; it != mMeshNodes.end(); ++it)
+	MNDL_TRACE_SCOPE("AssimpLoader::startSkinning");
+
+	SkinningJob& job = *mSkinningJobRef;
+	job.mTasks.clear();
+	job.mBakedRef.reset();
+
+	for(size_t i = 0; i < job.mMeshes.size(); ++i)
 	{
-		AssimpNodeRef nodeRef = *it;
+		const AssimpMeshInstanceRef& meshInstanceRef = job.mMeshes[ i ];
+
+		// meshes without bones keep their rest pose
+		const SkinData& skinData = meshInstanceRef->mMeshRef->mSkinData;
+		if(skinData.empty())
+			continue;
+
+		// palettes fitting the uniform buffer are blended in the vertex shader
+		const bool gpuSkinning = mSkinningMode == SKINNING_GPU &&
+		                         meshInstanceRef->mBonePalette.size() <= PaletteBuffer::kMaxBones;
+		if(gpuSkinning && !meshInstanceRef->mPaletteBufferRef)
+			meshInstanceRef->mPaletteBufferRef = PaletteBuffer::create();
+
+		// nothing moved since the skinned buffer was filled
+		SkinnedBuffers& skinnedBuffers = *meshInstanceRef->mSkinnedBuffersRef;
+		const bool hasSkinnedData = gpuSkinning ? meshInstanceRef->mPaletteBufferRef->hasData() :
+		                            skinnedBuffers.hasData();
+		const bool poseChanged = meshInstanceRef->mPoseVersion != mPoseVersion;
+		if(hasSkinnedData && !poseChanged && !meshInstanceRef->mSkinPending)
+		{
+			++mUpdateStats.mMeshesSkipped;
+			mUpdateStats.mVerticesSkipped += skinData.mNumVertices;
+			continue;
+		}
 
-		vector< AssimpMeshRef >::iterator meshIt = nodeRef->mMeshes.begin();
-		for(; meshIt != nodeRef->mMeshes.end(); ++meshIt)
+		// the node hierarchy is not thread safe, bone matrices are calculated here
+		if(poseChanged)
 		{
-			AssimpMeshRef assimpMeshRef = *meshIt;
+			calculateBonePalette(meshInstanceRef.get());
+			updateSkinnedBounds(meshInstanceRef.get());
+			meshInstanceRef->mPoseVersion = mPoseVersion;
+		}
 
-			if(assimpMeshRef->mValidCache)
-				continue;
+		// nodes moved, but the bones of this mesh ended up where they were
+		uint64_t paletteHash = hashSkinMatrices(&meshInstanceRef->mBonePalette[ 0 ],
+		                                        meshInstanceRef->mBonePalette.size());
+		if(hasSkinnedData && paletteHash == meshInstanceRef->mPaletteHash)
+		{
+			meshInstanceRef->mSkinPending = false;
+			++mUpdateStats.mMeshesSkipped;
+			mUpdateStats.mVerticesSkipped += skinData.mNumVertices;
+			continue;
+		}
+
+		// out of view, skinned by the first draw it comes into view
+		if(!isVisible(*meshInstanceRef))
+		{
+			meshInstanceRef->mSkinPending = true;
+			++mUpdateStats.mMeshesCulled;
+			mUpdateStats.mVerticesCulled += skinData.mNumVertices;
+			continue;
+		}
+		meshInstanceRef->mSkinPending = false;
 
-			if(mSkinningEnabled)
-			{
-				// animated data
-				std::vector< Vec3f >& vertices = assimpMeshRef->mCachedTriMesh.getVertices();
-				for(size_t v = 0; v < vertices.size(); ++v)
-					vertices[v] = fromAssimp(assimpMeshRef->mAnimatedPos[ v ]);
-
-				std::vector< Vec3f >& normals = assimpMeshRef->mCachedTriMesh.getNormals();
-				for(size_t v = 0; v < normals.size(); ++v)
-					normals[v] = fromAssimp(assimpMeshRef->mAnimatedNorm[ v ]);
-			}
-			else
-			{
-				// original mesh data from assimp
-				const aiMesh* mesh = assimpMeshRef->mAiMesh;
-
-				std::vector< Vec3f >& vertices = assimpMeshRef->mCachedTriMesh.getVertices();
-				for(size_t v = 0; v < vertices.size(); ++v)
-					vertices[v] = fromAssimp(mesh->mVertices[ v ]);
-
-				std::vector< Vec3f >& normals = assimpMeshRef->mCachedTriMesh.getNormals();
-				for(size_t v = 0; v < normals.size(); ++v)
-					normals[v] = fromAssimp(mesh->mNormals[ v ]);
-			}
-
-			assimpMeshRef->mValidCache = true;
+		if(gpuSkinning)
+		{
+			meshInstanceRef->mPaletteBufferRef->update(&meshInstanceRef->mBonePalette[ 0 ],
+			                                           meshInstanceRef->mBonePalette.size());
+			meshInstanceRef->mPaletteHash = paletteHash;
+			++mUpdateStats.mMeshesSkinned;
+			mUpdateStats.mVerticesSkinned += skinData.mNumVertices;
+			continue;
+		}
+
+		// tried again by the next update or the draw showing it, the pose alone would not tell
+		float* output = skinnedBuffers.map();
+		if(!output)
+		{
+			meshInstanceRef->mSkinPending = true;
+			continue;
+		}
+
+		meshInstanceRef->mPaletteHash = paletteHash;
+		++mUpdateStats.mMeshesSkinned;
+		mUpdateStats.mVerticesSkinned += skinData.mNumVertices;
+
+		for(size_t begin = 0; begin < skinData.mNumVertices; begin += kSkinningTaskSize)
+		{
+			SkinningTask task;
+			task.mMesh = meshInstanceRef.get();
+			task.mOutput = output;
+			task.mBegin = begin;
+			task.mEnd = math< size_t >::min(begin + kSkinningTaskSize, skinData.mNumVertices);
+			job.mTasks.push_back(task);
 		}
 	}
+
+	submitSkinningJob();
 }
 
-void AssimpLoader::enableSkinning(bool enable /* = true */)
+void AssimpLoader::startBakedPlayback()
 {
-	if(mSkinningEnabled == enable)
+	MNDL_TRACE_SCOPE("AssimpLoader::startBakedPlayback");
+
+	SkinningJob& job = *mSkinningJobRef;
+	job.mTasks.clear();
+	job.mBakedRef = mBakedAnimationRef;
+	job.mBakedTime = mAnimationTime;
+
+	// the frames of the cache replace evaluating the animation and blending the bones
+	const bool unchanged = mBakedEvaluated && mBakedTime == mAnimationTime;
+	if(unchanged)
+		++mUpdateStats.mAnimationsSkipped;
+	else
+		++mUpdateStats.mAnimationsEvaluated;
+
+	bool written = false;
+	for(size_t i = 0; i < job.mMeshes.size(); ++i)
+	{
+		if(!mBakedAnimationRef->hasMesh(i))
+			continue;
+
+		const AssimpMeshInstanceRef& meshInstanceRef = job.mMeshes[ i ];
+		const size_t numVertices = meshInstanceRef->mMeshRef->mSkinData.mNumVertices;
+		SkinnedBuffers& skinnedBuffers = *meshInstanceRef->mSkinnedBuffersRef;
+		if(unchanged && skinnedBuffers.hasData() && !meshInstanceRef->mSkinPending)
+		{
+			++mUpdateStats.mMeshesSkipped;
+			mUpdateStats.mVerticesSkipped += numVertices;
+			continue;
+		}
+
+		meshInstanceRef->mSkinnedBounds = mBakedAnimationRef->getBounds(i);
+		if(!isVisible(*meshInstanceRef))
+		{
+			meshInstanceRef->mSkinPending = true;
+			++mUpdateStats.mMeshesCulled;
+			mUpdateStats.mVerticesCulled += numVertices;
+			continue;
+		}
+
+		float* output = skinnedBuffers.map();
+		if(!output)
+		{
+			meshInstanceRef->mSkinPending = true;
+			continue;
+		}
+
+		// live skinning has to fill the buffer again when it takes over
+		meshInstanceRef->mSkinPending = false;
+		meshInstanceRef->mPaletteHash = 0;
+		written = true;
+		++mUpdateStats.mMeshesSkinned;
+		mUpdateStats.mVerticesSkinned += numVertices;
+
+		for(size_t begin = 0; begin < numVertices; begin += kSkinningTaskSize)
+		{
+			SkinningTask task;
+			task.mMesh = meshInstanceRef.get();
+			task.mOutput = output;
+			task.mBegin = begin;
+			task.mEnd = math< size_t >::min(begin + kSkinningTaskSize, numVertices);
+			job.mTasks.push_back(task);
+		}
+	}
+
+	mBakedEvaluated = true;
+	mBakedTime = mAnimationTime;
+	if(written)
+	{
+		// the nodes still hold the last live pose, which no buffer shows anymore
+		mAnimationEvaluated = false;
+		++mPoseVersion;
+	}
+
+	submitSkinningJob();
+}
+
+void AssimpLoader::submitSkinningJob()
+{
+	SkinningJob& job = *mSkinningJobRef;
+	if(job.mTasks.empty())
 		return;
 
-	mSkinningEnabled = enable;
-	// invalidate mesh cache
-	vector< AssimpNodeRef >::const_iterator it = mMeshNodes.begin();
-	for(; it != mMeshNodes.end(); ++it)
+	job.mJob.set(&SkinningJob::runTask, &job, job.mTasks.size());
+	job.mRemainingTasks = job.mTasks.size();
+	job.mPoolRef = mWorkerPoolRef;
+	job.mTimer.start();
+	mWorkerPoolRef->submit(job.mJob);
+	job.mInFlight = true;
+}
+
+void AssimpLoader::finishUpdate()
+{
+	if(!mSkinningJobRef || !mSkinningJobRef->mInFlight)
+		return;
+
+	MNDL_TRACE_SCOPE("AssimpLoader::finishUpdate");
+
+	SkinningJob& job = *mSkinningJobRef;
+	job.finish();
+	mSkinningTime = job.mFinishTime;
+
+	// buffers are mapped and unmapped on the thread owning the GL context
+	vector< AssimpMeshInstanceRef >::const_iterator meshIt = job.mMeshes.begin();
+	for(; meshIt != job.mMeshes.end(); ++meshIt)
 	{
-		AssimpNodeRef nodeRef = *it;
+		if((*meshIt)->mSkinnedBuffersRef)
+			(*meshIt)->mSkinnedBuffersRef->unmap();
+	}
+}
 
-		vector< AssimpMeshRef >::const_iterator meshIt = nodeRef->mMeshes.begin();
-		for(; meshIt != nodeRef->mMeshes.end(); ++meshIt)
+void AssimpLoader::setNumSkinningThreads(size_t numThreads)
+{
+	if(mWorkerPoolRef && mWorkerPoolRef->getNumThreads() == numThreads)
+		return;
+
+	finishUpdate();
+	mWorkerPoolRef = WorkerPool::create(numThreads);
+}
+
+void AssimpLoader::setWorkerPool(WorkerPoolRef pool)
+{
+	finishUpdate();
+	mWorkerPoolRef = pool;
+}
+
+double AssimpLoader::benchmarkSkinning(size_t iterations)
+{
+	finishUpdate();
+
+	size_t numVertices = 0;
+	double seconds = 0.0;
+	std::vector< float > output;
+
+	for(vector< AssimpMeshInstanceRef >::const_iterator meshIt = mModelMeshes.begin();
+	        meshIt != mModelMeshes.end(); ++meshIt)
+	{
+		const AssimpMeshInstanceRef& meshInstanceRef = *meshIt;
+		const SkinData& skinData = meshInstanceRef->mMeshRef->mSkinData;
+		if(skinData.empty())
+			continue;
+
+		calculateBonePalette(meshInstanceRef.get());
+		output.resize(skinData.mNumVertices * SkinnedBuffers::kStride);
+
+		Stopwatch timer(true);
+		for(size_t i = 0; i < iterations; ++i)
 		{
-			AssimpMeshRef assimpMeshRef = *meshIt;
-			assimpMeshRef->mValidCache = false;
+			skinVertices(&meshInstanceRef->mBonePalette[ 0 ], skinData, 0, skinData.mNumVertices,
+			             &output[ 0 ], &output[ 3 ], SkinnedBuffers::kStride);
 		}
+		timer.stop();
+
+		seconds += timer.getSeconds();
+		numVertices += skinData.mNumVertices * iterations;
+	}
+
+	if(seconds <= 0.0)
+		return 0.0;
+	return numVertices / seconds;
+}
+
+double AssimpLoader::benchmarkBakedPlayback(size_t iterations)
+{
+	finishUpdate();
+
+	if(!mBakedAnimationRef)
+		return 0.0;
+
+	size_t numVertices = 0;
+	double seconds = 0.0;
+	std::vector< float > output;
+
+	for(size_t m = 0; m < mModelMeshes.size(); ++m)
+	{
+		if(!mBakedAnimationRef->hasMesh(m))
+			continue;
+
+		size_t meshVertices = mModelMeshes[ m ]->mMeshRef->mSkinData.mNumVertices;
+		output.resize(meshVertices * SkinnedBuffers::kStride);
+
+		Stopwatch timer(true);
+		for(size_t i = 0; i < iterations; ++i)
+		{
+			mBakedAnimationRef->sample(m, i / 60.0, 0, meshVertices, &output[ 0 ], &output[ 3 ], SkinnedBuffers::kStride);
+		}
+		timer.stop();
+
+		seconds += timer.getSeconds();
+		numVertices += meshVertices * iterations;
+	}
+
+	if(seconds <= 0.0)
+		return 0.0;
+	return numVertices / seconds;
+}
+
+double AssimpLoader::benchmarkAnimation(size_t iterations)
+{
+	finishUpdate();
+
+	const RigRef& rigRef = mModelRef->getRig();
+	if(mAnimationIndex >= rigRef->getNumClips())
+		return 0.0;
+
+	const AnimationClip& clip = *rigRef->getClip(mAnimationIndex);
+	double duration = clip.getDuration();
+
+	Stopwatch timer(true);
+	for(size_t i = 0; i < iterations; ++i)
+	{
+		double time = i / 60.0;
+		updateAnimation(mAnimationIndex, duration > 0.0 ? fmod(time, duration) : 0.0);
 	}
+	timer.stop();
+
+	// the nodes no longer hold the pose of the last update
+	mAnimationEvaluated = false;
+	++mPoseVersion;
+
+	double seconds = timer.getSeconds();
+	if(seconds <= 0.0)
+		return 0.0;
+	return clip.getNumChannels() * iterations / (seconds * 1000.0);
+}
+
+double AssimpLoader::benchmarkCrowd(size_t numCharacters, size_t iterations)
+{
+	finishUpdate();
+
+	const RigRef& rigRef = mModelRef->getRig();
+	if(rigRef->getPaletteSize() == 0 || numCharacters == 0)
+		return 0.0;
+
+	PoseBatchRef batchRef = PoseBatch::create(rigRef, mWorkerPoolRef);
+	std::vector< AnimationState > states(numCharacters);
+	std::vector< SkinMatrix > palettes(numCharacters * rigRef->getPaletteSize());
+
+	size_t numClips = rigRef->getNumClips();
+	double seconds = 0.0;
+	for(size_t i = 0; i < iterations; ++i)
+	{
+		// every character plays its own clip, a frame apart from the previous one
+		for(size_t c = 0; c < numCharacters; ++c)
+		{
+			size_t clip = numClips > 0 ? c % numClips : 0;
+			double duration = numClips > 0 ? rigRef->getClip(clip)->getDuration() : 0.0;
+			double time = (c + i) / 60.0;
+			states[ c ] = AnimationState(clip, duration > 0.0 ? fmod(time, duration) : 0.0);
+		}
+
+		Stopwatch timer(true);
+		batchRef->evaluate(&states[ 0 ], numCharacters, &palettes[ 0 ]);
+		timer.stop();
+		seconds += timer.getSeconds();
+	}
+
+	if(seconds <= 0.0)
+		return 0.0;
+	return numCharacters * iterations / (seconds * 1000.0);
+}
+
+void AssimpLoader::enableSkinning(bool enable /* = true */, SkinningMode mode /* = SKINNING_CPU */)
+{
+	if(mSkinningEnabled == enable && mSkinningMode == mode)
+		return;
+
+	finishUpdate();
+
+	// the buffers of the other mode do not hold the current pose
+	if(mSkinningMode != mode)
+	{
+		vector< AssimpMeshInstanceRef >::const_iterator meshIt = mModelMeshes.begin();
+		for(; meshIt != mModelMeshes.end(); ++meshIt)
+		{
+			(*meshIt)->mPaletteHash = 0;
+		}
+		++mPoseVersion;
+	}
+
+	mSkinningEnabled = enable;
+	mSkinningMode = mode;
+}
+
+void AssimpLoader::setBakedAnimation(BakedAnimationRef baked)
+{
+	if(baked && baked->getModel() != mModelRef)
+		throw AssimpLoaderExc("baked animation of another model.");
+	if(baked == mBakedAnimationRef)
+		return;
+
+	finishUpdate();
+	mBakedAnimationRef = baked;
+	mBakedEvaluated = false;
 }
 
 void AssimpLoader::update()
 {
+	MNDL_TRACE_SCOPE("AssimpLoader::update");
+
+	// the meshes of the previous update have been drawn by now
+	finishUpdate();
+
+	mUpdateStats = UpdateStats();
+
+	if(isPlayingBakedAnimation())
+	{
+		startBakedPlayback();
+		return;
+	}
+	mBakedEvaluated = false;
+
 	if(mAnimationEnabled)
-		updateAnimation(mAnimationIndex, mAnimationTime);
+	{
+		// paused or same time as before
+		if(mAnimationEvaluated && mEvaluatedAnimationIndex == mAnimationIndex &&
+		        mEvaluatedAnimationTime == mAnimationTime)
+		{
+			++mUpdateStats.mAnimationsSkipped;
+		}
+		else
+		{
+			updateAnimation(mAnimationIndex, mAnimationTime);
+			mAnimationEvaluated = true;
+			mEvaluatedAnimationIndex = mAnimationIndex;
+			mEvaluatedAnimationTime = mAnimationTime;
+			++mPoseVersion;
+			++mUpdateStats.mAnimationsEvaluated;
+		}
+	}
 
 	if(mSkinningEnabled)
-		updateSkinning();
+		startSkinning();
+}
 
-	updateMeshes();
+#ifndef MNDL_HEADLESS
+void AssimpLoader::draw(const RenderBaseState& base)
+{
+	mRenderQueueRef->clear();
+	submit(*mRenderQueueRef, base.mProgram);
+	mRenderQueueRef->draw(base);
 }
 
-void AssimpLoader::draw()
+void AssimpLoader::submit(RenderQueue& queue, GLuint program)
 {
-	glPushAttrib(GL_ALL_ATTRIB_BITS);
-	glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
-	gl::enable(GL_NORMALIZE);
+	MNDL_TRACE_SCOPE("AssimpLoader::submit");
+
+	if(!mSkinningOverlap)
+		finishUpdate();
+
+	RenderItem item;
+	item.mTransform = queue.addTransform(gl::getModelView() * mTransform);
+	item.mProgram = program;
+	item.mTextured = mTexturesEnabled;
+	item.mMaterials = mMaterialsEnabled;
+	item.mSkinned = mSkinningEnabled;
+	// baked frames are played from the skinned buffers in either mode
+	item.mGpuPalette = mSkinningEnabled && mSkinningMode == SKINNING_GPU && !isPlayingBakedAnimation();
 
 	vector< AssimpNodeRef >::const_iterator it = mMeshNodes.begin();
 	for(; it != mMeshNodes.end(); ++it)
 	{
-		AssimpNodeRef nodeRef = *it;
+		const AssimpNodeRef& nodeRef = *it;
 
-		vector< AssimpMeshRef >::const_iterator meshIt = nodeRef->mMeshes.begin();
+		vector< AssimpMeshInstanceRef >::const_iterator meshIt = nodeRef->mMeshes.begin();
 		for(; meshIt != nodeRef->mMeshes.end(); ++meshIt)
 		{
-			AssimpMeshRef assimpMeshRef = *meshIt;
-
-			// Texture Binding
-			if(mTexturesEnabled && assimpMeshRef->mTexture)
-			{
-				assimpMeshRef->mTexture.enableAndBind();
-			}
-
-			if(mMaterialsEnabled)
-			{
-				assimpMeshRef->mMaterial.apply();
-			}
-			else
-			{
-				gl::color(assimpMeshRef->mMaterial.getDiffuse());
-			}
-
-			// Culling
-			if(assimpMeshRef->mTwoSided)
-				gl::enable(GL_CULL_FACE);
-			else
-				gl::disable(GL_CULL_FACE);
-
-			//gl::draw(assimpMeshRef->mCachedTriMesh);
-			gl::draw(assimpMeshRef->mCachedVboMesh);
-
-			// Texture Binding
-			if(mTexturesEnabled && assimpMeshRef->mTexture)
-			{
-				assimpMeshRef->mTexture.unbind();
-			}
+			const AssimpMeshInstanceRef& meshInstanceRef = *meshIt;
+
+			// meshes out of view are neither skinned nor drawn
+			if(!isVisible(*meshInstanceRef))
+				continue;
+			if(mSkinningEnabled && meshInstanceRef->mSkinPending)
+				skinPendingMesh(meshInstanceRef.get());
+
+			item.mMesh = meshInstanceRef.get();
+			queue.add(item);
 		}
 	}
-
-	glPopClientAttrib();
-	glPopAttrib();
 }
+#endif
 
 }
 } // namespace mndl::assimp
@@ -28,9 +28,17 @@
 #include "cinder/TriMesh.h"
 #include "cinder/Stream.h"
 #include "cinder/AxisAlignedBox.h"
+#include "cinder/Frustum.h"
 
 #include "Node.h"
 #include "AssimpMesh.h"
+#include "AssimpModel.h"
+#include "BakedAnimation.h"
+#ifndef MNDL_HEADLESS
+#include "RenderQueue.h"
+#endif
+#include "Rig.h"
+#include "WorkerPool.h"
 
 namespace mndl
 {
@@ -111,28 +119,103 @@ class AssimpLoaderExc : public std::exception
 class AssimpNode : public mndl::Node
 {
 	public:
-		std::vector< AssimpMeshRef > mMeshes;
+		std::vector< AssimpMeshInstanceRef > mMeshes;
 };
 
 typedef std::shared_ptr< AssimpNode > AssimpNodeRef;
 
+struct SkinningJob;
+struct AnimationJob;
+
+//! Where AssimpLoader blends the bone matrices into the vertices.
+enum SkinningMode
+{
+	SKINNING_CPU, /// on the worker threads into mapped vertex buffers
+	SKINNING_GPU /// in the vertex shader, see assets/shaders/mesh_skinned.vert
+};
+
+//! Work done and skipped by the last AssimpLoader::update() and draw(), because the pose did not change or the mesh was out of view.
+struct UpdateStats
+{
+	UpdateStats() :
+		mAnimationsEvaluated(0), mAnimationsSkipped(0),
+		mMeshesSkinned(0), mMeshesSkipped(0), mMeshesCulled(0), mMeshesSkinnedOnDraw(0),
+		mVerticesSkinned(0), mVerticesSkipped(0), mVerticesCulled(0)
+	{}
+
+	size_t mAnimationsEvaluated;
+	size_t mAnimationsSkipped;
+	size_t mMeshesSkinned; /// including the meshes skinned on draw
+	size_t mMeshesSkipped;
+	size_t mMeshesCulled; /// out of view, not skinned
+	size_t mMeshesSkinnedOnDraw; /// came into view after update()
+	size_t mVerticesSkinned;
+	size_t mVerticesSkipped;
+	size_t mVerticesCulled;
+};
+
+//! An instance of an AssimpModel with its own pose, animation time and transform.
+/*! Loaders of the same file share the model, only the node hierarchy, bone
+    palettes and skinned vertex buffers are allocated per instance.
+    Built with MNDL_HEADLESS the loader animates and skins without a GL context,
+    into buffers in memory, and has no drawing, texture or material functions. */
 class AssimpLoader
 {
 	public:
 		AssimpLoader() {}
 
-		//! Constructs and does the parsing of the file from \a filename.
+		//! Constructs an instance of the model in \a filename, parsing the file unless it is already loaded.
 		AssimpLoader(ci::fs::path filename, bool loadTextures = true);
+		//! Constructs another instance of \a model.
+		explicit AssimpLoader(AssimpModelRef model);
+
+		//! Returns the shared model of this instance.
+		const AssimpModelRef& getModel() const
+		{
+			return mModelRef;
+		}
+
+		//! Sets the model transform applied when drawing.
+		void setTransform(const ci::Matrix44f& transform)
+		{
+			mTransform = transform;
+		}
+		const ci::Matrix44f& getTransform() const
+		{
+			return mTransform;
+		}
 
-		//! Updates model animation and skinning.
+		//! Updates model animation and starts skinning on the worker threads.
 		void update();
+		//! Waits for the skinning started by update(). Called by draw() unless skinning overlap is enabled.
+		void finishUpdate();
+#ifndef MNDL_HEADLESS
 		//! Draws all meshes in the model.
-		void draw();
+		/*! \a base is the GL state when draw() is called, restored when it returns. */
+		void draw(const RenderBaseState& base = RenderBaseState());
+		//! Adds the visible meshes to \a queue, with the current modelview matrix and \a program, 0 for the fixed function pipeline.
+		/*! Skins the meshes that were out of view so far. Unless skinning overlap is
+		    enabled the skinning started by update() has to be finished first, as
+		    by draw(). The loader must stay alive until the queue has been drawn. */
+		void submit(RenderQueue& queue, GLuint program);
+#endif
 
 		//! Returns the bounding box of the static, not skinned mesh.
 		ci::AxisAlignedBox3f getBoundingBox() const
 		{
-			return mBoundingBox;
+			return mModelRef ? mModelRef->getBoundingBox() : ci::AxisAlignedBox3f();
+		}
+		//! Returns the bounds of the meshes as drawn after the last update(), skinned if skinning is enabled.
+		/*! Unlike getBoundingBox() the bounds are in the space the meshes are drawn in,
+		    without node transforms and the model transform. Skinned meshes are bounded
+		    by their bone bounds transformed by the current palette, so the box is
+		    conservative but costs no per vertex work. */
+		ci::AxisAlignedBox3f getSkinnedBoundingBox() const;
+		//! Returns the bounds of the \a n'th mesh as drawn after the last update().
+		const ci::AxisAlignedBox3f& getMeshBoundingBox(size_t n) const
+		{
+			const AssimpMeshInstanceRef& meshInstanceRef = mModelMeshes[ n ];
+			return mSkinningEnabled ? meshInstanceRef->mSkinnedBounds : meshInstanceRef->mMeshRef->mBounds;
 		}
 
 		//! Sets the orientation of this node via a quaternion.
@@ -152,6 +235,7 @@ class AssimpLoader
 		//! Returns the \a n'th cinder::TriMesh contained by the node called \a name.
 		const ci::TriMesh& getAssimpNodeMesh(const std::string& name, size_t n = 0) const;
 
+#ifndef MNDL_HEADLESS
 		//! Returns the texture of the \a n'th mesh in the node called \a name.
 		ci::gl::Texture& getAssimpNodeTexture(const std::string& name, size_t n = 0);
 		//! Returns the texture of the \a n'th mesh in the node called \a name.
@@ -161,6 +245,7 @@ class AssimpLoader
 		ci::gl::Material& getAssimpNodeMaterial(const std::string& name, size_t n = 0);
 		//! Returns the material of the \a n'th mesh in the node called \a name.
 		const ci::gl::Material& getAssimpNodeMaterial(const std::string& name, size_t n = 0) const;
+#endif
 
 		//! Returns all node names in the model in a std::vector as std::string's.
 		const std::vector< std::string >& getNodeNames()
@@ -191,13 +276,76 @@ class AssimpLoader
 		}
 
 		//! Enables/disables skinning, when the model's bones distort the vertices.
-		void enableSkinning(bool enable = true);
+		/*! With SKINNING_GPU draw() expects a program with the BonePalette block and
+		    the boneIndices and boneWeights attributes of mesh_skinned.vert to be bound.
+		    Meshes with more than PaletteBuffer::kMaxBones bones are skinned on the CPU. */
+		void enableSkinning(bool enable = true, SkinningMode mode = SKINNING_CPU);
+		SkinningMode getSkinningMode() const
+		{
+			return mSkinningMode;
+		}
 		//! Disables skinning, when the model's bones distort the vertices.
 		void disableSkinning()
 		{
 			enableSkinning(false);
 		}
 
+		//! Sets the number of worker threads used for animation and skinning, 0 runs both on the calling thread.
+		void setNumSkinningThreads(size_t numThreads);
+		//! Returns the number of worker threads used for skinning.
+		size_t getNumSkinningThreads() const
+		{
+			return mWorkerPoolRef ? mWorkerPoolRef->getNumThreads() : 0;
+		}
+		//! Shares the worker threads of \a pool for skinning. Loaders share one pool unless set otherwise.
+		void setWorkerPool(WorkerPoolRef pool);
+		//! Returns the worker threads used for skinning.
+		const WorkerPoolRef& getWorkerPool() const
+		{
+			return mWorkerPoolRef;
+		}
+
+		//! Skins and draws only the meshes intersecting \a frustum.
+		/*! \a parentTransform is the transform draw() is called with, from the space
+		    of the model transform to the space of \a frustum. Meshes are tested with
+		    their skinned bounds, meshes coming into view after update() are skinned
+		    by the draw() showing them. */
+		void setCullingFrustum(const ci::Frustumf& frustum, const ci::Matrix44f& parentTransform = ci::Matrix44f());
+		//! Skins and draws every mesh again.
+		void disableCulling()
+		{
+			mCullingEnabled = false;
+		}
+		bool isCullingEnabled() const
+		{
+			return mCullingEnabled;
+		}
+
+		//! Enables/disables skinning during the drawing of the previous frame, meshes lag one update behind.
+		void enableSkinningOverlap(bool enable = true)
+		{
+			mSkinningOverlap = enable;
+		}
+		//! Returns the time between starting and finishing the last skinning pass in seconds.
+		double getSkinningTime() const
+		{
+			return mSkinningTime;
+		}
+
+		//! Returns the work done and skipped by the last update() and the draw() calls since.
+		const UpdateStats& getUpdateStats() const
+		{
+			return mUpdateStats;
+		}
+
+#ifndef MNDL_HEADLESS
+		//! Returns the draw calls and state changes of the last draw().
+		const RenderStats& getRenderStats() const
+		{
+			return mRenderQueueRef->getStats();
+		}
+#endif
+
 		//! Enables/disables animation.
 		void enableAnimation(bool enable = true)
 		{
@@ -214,27 +362,29 @@ class AssimpLoader
 		{
 			return mModelMeshes.size();
 		}
-		//! Returns the \a n'th mesh in the model.
+		//! Returns the \a n'th mesh in the model in its rest pose, shared by all instances.
 		ci::TriMesh& getMesh(size_t n)
 		{
-			return mModelMeshes[ n ]->mCachedTriMesh;
+			return mModelMeshes[ n ]->mMeshRef->mCachedTriMesh;
 		}
-		//! Returns the \a n'th mesh in the model.
+		//! Returns the \a n'th mesh in the model in its rest pose, shared by all instances.
 		const ci::TriMesh& getMesh(size_t n) const
 		{
-			return mModelMeshes[ n ]->mCachedTriMesh;
+			return mModelMeshes[ n ]->mMeshRef->mCachedTriMesh;
 		}
 
+#ifndef MNDL_HEADLESS
 		//! Returns the texture of the \a n'th mesh in the model.
 		ci::gl::Texture& getTexture(size_t n)
 		{
-			return mModelMeshes[ n ]->mTexture;
+			return mModelMeshes[ n ]->mMeshRef->mTexture;
 		}
 		//! Returns the texture of the \a n'th mesh in the model.
 		const ci::gl::Texture& getTexture(size_t n) const
 		{
-			return mModelMeshes[ n ]->mTexture;
+			return mModelMeshes[ n ]->mMeshRef->mTexture;
 		}
+#endif
 
 		//! Returns the number of animations in the scene.
 		size_t getNumAnimations() const;
@@ -245,45 +395,98 @@ class AssimpLoader
 		//! Returns the duration of the \a n'th animation.
 		double getAnimationDuration(size_t n) const;
 
+		//! Returns the immutable rig and clips of the model, for evaluating crowds with a PoseBatch.
+		const RigRef& getRig() const
+		{
+			return mModelRef->getRig();
+		}
+
 		//! Sets current animation time.
 		void setTime(double t);
 
+		//! Plays \a baked instead of evaluating the bones while its clip is the current animation and skinning is enabled.
+		/*! The node hierarchy is not animated during baked playback, orientations
+		    set by setNodeOrientation() take effect again with live skinning.
+		    Pass an empty reference to return to live skinning. */
+		void setBakedAnimation(BakedAnimationRef baked);
+		const BakedAnimationRef& getBakedAnimation() const
+		{
+			return mBakedAnimationRef;
+		}
+		//! Returns true if update() plays the vertices of the baked animation.
+		bool isPlayingBakedAnimation() const
+		{
+			return mBakedAnimationRef && mAnimationEnabled && mSkinningEnabled &&
+			       mBakedAnimationRef->getClip() == mAnimationIndex;
+		}
+
+		//! Skins every boned mesh \a iterations times in the current pose, returns vertices per second.
+		double benchmarkSkinning(size_t iterations = 100);
+		//! Evaluates the current animation at staggered times \a iterations times, returns channels per millisecond.
+		double benchmarkAnimation(size_t iterations = 100);
+		//! Plays the baked animation \a iterations times at staggered times, returns vertices per second.
+		double benchmarkBakedPlayback(size_t iterations = 100);
+		//! Evaluates the palettes of \a numCharacters instances with staggered times \a iterations times, returns characters per millisecond.
+		double benchmarkCrowd(size_t numCharacters = 200, size_t iterations = 100);
+
 	private:
-		void loadAllMeshes();
+		void init();
 		AssimpNodeRef loadNodes(const aiNode* nd, AssimpNodeRef parentRef = AssimpNodeRef());
-		AssimpMeshRef convertAiMesh(const aiMesh* mesh);
-
-		void calculateDimensions();
-		void calculateBoundingBox(ci::Vec3f* min, ci::Vec3f* max);
-		void calculateBoundingBoxForNode(const aiNode* nd, aiVector3D* min, aiVector3D* max, aiMatrix4x4* trafo);
 
 		void updateAnimation(size_t animationIndex, double currentTime);
-		void updateSkinning();
-		void updateMeshes();
-
-		std::shared_ptr< Assimp::Importer > mImporterRef; // mScene will be destroyed along with the Importer object
-		ci::fs::path mFilePath; /// model path
-		const aiScene* mScene;
-
-		ci::AxisAlignedBox3f mBoundingBox;
+		void resolveNodeReferences();
+		void calculateBonePalette(AssimpMeshInstance* meshInstance);
+		void updateSkinnedBounds(AssimpMeshInstance* meshInstance);
+		bool isVisible(const AssimpMeshInstance& meshInstance) const;
+		void skinPendingMesh(AssimpMeshInstance* meshInstance);
+		void startSkinning();
+		void startBakedPlayback();
+		void submitSkinningJob();
+
+		AssimpModelRef mModelRef; /// shared geometry, buffers, rig and clips
+		ci::Matrix44f mTransform;
 
 		AssimpNodeRef mRootNode; /// root node of scene
 
 		std::vector< AssimpNodeRef > mMeshNodes; /// nodes with meshes
-		std::vector< AssimpMeshRef > mModelMeshes; /// all meshes
+		std::vector< AssimpMeshInstanceRef > mModelMeshes; /// all meshes
 
 		std::vector< std::string > mNodeNames;
 		std::map< std::string, AssimpNodeRef > mNodeMap;
+		std::vector< AssimpNode* > mRigNodes; /// nodes by rig node index, owned by mNodeMap
 
 		bool mMaterialsEnabled;
 		bool mTexturesEnabled;
 		bool mSkinningEnabled;
 		bool mAnimationEnabled;
+		bool mSkinningOverlap;
+		SkinningMode mSkinningMode;
+
+		WorkerPoolRef mWorkerPoolRef;
+		std::shared_ptr< SkinningJob > mSkinningJobRef; /// shared by copies, waits for its tasks on destruction
+		std::shared_ptr< AnimationJob > mAnimationJobRef; /// channel sampling scratch space, shared by copies
+		double mSkinningTime;
 
 		size_t mAnimationIndex;
 		double mAnimationTime;
 
-		bool mLoadTextures;
+		bool mAnimationEvaluated; /// the pose matches mEvaluatedAnimationIndex and mEvaluatedAnimationTime
+		size_t mEvaluatedAnimationIndex;
+		double mEvaluatedAnimationTime;
+		size_t mPoseVersion; /// incremented whenever node transforms change
+
+#ifndef MNDL_HEADLESS
+		RenderQueueRef mRenderQueueRef; /// used by draw()
+#endif
+
+		bool mCullingEnabled;
+		ci::Frustumf mCullingFrustum;
+		ci::Matrix44f mCullingTransform; /// parent of mTransform to frustum space
+
+		BakedAnimationRef mBakedAnimationRef;
+		bool mBakedEvaluated; /// the skinned buffers hold the baked frame at mBakedTime
+		double mBakedTime;
+		UpdateStats mUpdateStats;
 };
 
 }
@@ -24,10 +24,16 @@
 //#include "assimp/aiMesh.h"
 
 #include "cinder/Cinder.h"
+#include "cinder/AxisAlignedBox.h"
 #include "cinder/TriMesh.h"
+#ifndef MNDL_HEADLESS
 #include "cinder/gl/Material.h"
 #include "cinder/gl/Texture.h"
-#include "cinder/gl/Vbo.h"
+#endif
+
+#include "MeshBuffers.h"
+#include "Node.h"
+#include "Skinning.h"
 
 namespace mndl
 {
@@ -35,27 +41,52 @@ namespace assimp
 {
 
 class AssimpMesh;
+class AssimpMeshInstance;
 typedef std::shared_ptr< AssimpMesh > AssimpMeshRef;
+typedef std::shared_ptr< AssimpMeshInstance > AssimpMeshInstanceRef;
 
+//! Mesh data shared by every instance of an AssimpModel.
 class AssimpMesh
 {
 	public:
 		const aiMesh* mAiMesh;
 
+#ifndef MNDL_HEADLESS
 		ci::gl::Texture mTexture;
+#endif
 
 		std::vector< uint32_t > mIndices;
 
+#ifndef MNDL_HEADLESS
 		ci::gl::Material mMaterial;
+#endif
 		bool mTwoSided;
 
-		std::vector< aiVector3D > mAnimatedPos;
-		std::vector< aiVector3D > mAnimatedNorm;
+		SkinData mSkinData;
 
 		std::string mName;
-		ci::TriMesh mCachedTriMesh;
-		ci::gl::VboMeshRef mCachedVboMesh;
-		bool mValidCache;
+		ci::TriMesh mCachedTriMesh; /// rest pose, skinned vertices only live in the instance buffers
+		ci::AxisAlignedBox3f mBounds; /// rest pose, in the space the mesh is drawn in
+#ifndef MNDL_HEADLESS
+		MeshBuffersRef mBuffersRef;
+#endif
+};
+
+//! Pose dependent state of an AssimpMesh in one AssimpLoader.
+class AssimpMeshInstance
+{
+	public:
+		AssimpMeshRef mMeshRef;
+		size_t mIndex; /// scene mesh index
+
+		std::vector< const mndl::Node* > mBoneNodes; /// resolved at load, owned by the loader
+		std::vector< SkinMatrix > mBonePalette;
+		uint64_t mPaletteHash; /// hash of the palette in the current skinned buffer
+		size_t mPoseVersion; /// loader pose version mBonePalette was calculated for
+		SkinnedBuffersRef mSkinnedBuffersRef; /// NULL for meshes without bones
+		PaletteBufferRef mPaletteBufferRef; /// created by the first update skinning on the GPU
+		ci::AxisAlignedBox3f mSkinnedBounds; /// of the last skinned pose, the rest bounds before
+		bool mSkinPending; /// out of view when the pose changed, skinned by the first draw showing it
 };
 
 }
@@ -0,0 +1,618 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+ Based on ofxAssimpModelLoader by Anton Marini, Memo Akten, Kyle McDonald
+ and Arturo Castro
+*/
+
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef MNDL_HEADLESS
+#include <iostream>
+#else
+#include "cinder/app/App.h"
+#include "cinder/ImageIo.h"
+#endif
+#include "cinder/CinderMath.h"
+#include "cinder/Utilities.h"
+
+#include "assimp/DefaultLogger.hpp"
+#include "assimp/LogStream.hpp"
+
+#include "AssimpLoader.h"
+#include "AssimpModel.h"
+#include "Stopwatch.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! Loaded models by path, dropped when the file changes.
+struct ModelCacheEntry
+{
+	std::weak_ptr< const AssimpModel > mModelRef; /// expires with the last instance
+	time_t mWriteTime;
+};
+
+static mutex sModelCacheMutex;
+static map< string, ModelCacheEntry > sModelCache;
+
+//! Log of the loading steps, standard error without the app, keeping standard output to the tool.
+static ostream& console()
+{
+#ifdef MNDL_HEADLESS
+	return clog;
+#else
+	return app::console();
+#endif
+}
+
+//! Traces the post-processing steps from the begin and end messages assimp logs around them.
+/*! ApplyPostProcessing() runs every step in one call, and its debug log is the only place the steps are reported. */
+class TraceLogStream : public Assimp::LogStream
+{
+	public:
+		//! Parses messages like "Debug, T0: TriangulateProcess begin".
+		void write(const char* message)
+		{
+			string text(message);
+			size_t pos = text.find(": ");
+			if(pos == string::npos)
+				return;
+			text = text.substr(pos + 2);
+
+			pos = text.find(' ');
+			string step = text.substr(0, pos);
+			if(pos == string::npos || step.find("Process") == string::npos)
+				return;
+
+			if(text.compare(pos + 1, 5, "begin") == 0)
+			{
+				finish();
+				if(Trace::isEnabled())
+				{
+					const char* name = Trace::intern(step);
+					Trace::begin(name);
+					lock_guard< mutex > lock(mMutex);
+					mSteps[ this_thread::get_id() ] = name;
+				}
+			}
+			else if(text.compare(pos + 1, 6, "finish") == 0 || text.compare(pos + 1, 3, "end") == 0)
+			{
+				lock_guard< mutex > lock(mMutex);
+				map< thread::id, const char* >::iterator it = mSteps.find(this_thread::get_id());
+				if(it != mSteps.end() && step == it->second)
+				{
+					Trace::end(it->second);
+					mSteps.erase(it);
+				}
+			}
+		}
+
+		//! Ends the step still open on the calling thread, not every step logs its end.
+		void finish()
+		{
+			lock_guard< mutex > lock(mMutex);
+			map< thread::id, const char* >::iterator it = mSteps.find(this_thread::get_id());
+			if(it != mSteps.end())
+			{
+				Trace::end(it->second);
+				mSteps.erase(it);
+			}
+		}
+
+	private:
+		mutex mMutex;
+		map< thread::id, const char* > mSteps; /// open step by loading thread
+};
+
+static TraceLogStream* sTraceLogStream = NULL;
+static once_flag sTraceLogOnce;
+
+//! Attaches the trace stream to the assimp log, verbose from then on, so only once tracing has been enabled.
+static void attachTraceLogStream()
+{
+	if(Assimp::DefaultLogger::isNullLogger())
+		Assimp::DefaultLogger::create(NULL, Assimp::Logger::VERBOSE, 0);
+
+	sTraceLogStream = new TraceLogStream(); // owned by the logger
+	Assimp::DefaultLogger::get()->attachStream(sTraceLogStream,
+	                                          Assimp::Logger::Debugging | Assimp::Logger::Info);
+}
+
+static void fromAssimp(const aiMesh* aim, TriMesh* cim)
+{
+	// copy vertices
+	for(unsigned i = 0; i < aim->mNumVertices; ++i)
+	{
+		cim->appendVertex(fromAssimp(aim->mVertices[i]));
+	}
+
+	if(aim->HasNormals())
+	{
+		for(unsigned i = 0; i < aim->mNumVertices; ++i)
+		{
+			cim->appendNormal(fromAssimp(aim->mNormals[i]));
+		}
+	}
+	else
+	{
+		cim->recalculateNormals();
+	}
+
+	if(aim->HasTangentsAndBitangents())
+	{
+		for(unsigned i = 0; i < aim->mNumVertices; ++i)
+		{
+			cim->appendTangent(fromAssimp(aim->mTangents[i]));
+		}
+	}
+	else
+	{
+		cim->recalculateTangents();
+	}
+
+	// aiVector3D *	mTextureCoords [AI_MAX_NUMBER_OF_TEXTURECOORDS]
+	// just one for now
+	if(aim->GetNumUVChannels() > 0)
+	{
+		for(unsigned i = 0; i < aim->mNumVertices; ++i)
+		{
+			cim->appendTexCoord(Vec2f(aim->mTextureCoords[0][i].x,
+			                          aim->mTextureCoords[0][i].y));
+		}
+	}
+
+	//aiColor4D *mColors [AI_MAX_NUMBER_OF_COLOR_SETS]
+	if(aim->GetNumColorChannels() > 0)
+	{
+		for(unsigned i = 0; i < aim->mNumVertices; ++i)
+		{
+			cim->appendColorRgba(fromAssimp(aim->mColors[0][i]));
+		}
+	}
+
+	for(unsigned i = 0; i < aim->mNumFaces; ++i)
+	{
+		if(aim->mFaces[i].mNumIndices > 3)
+		{
+			throw AssimpLoaderExc("non-triangular face found: model " +
+			                      string(aim->mName.data) + ", face #" +
+			                      toString< unsigned >(i));
+		}
+
+		cim->appendTriangle(aim->mFaces[ i ].mIndices[ 0 ],
+		                    aim->mFaces[ i ].mIndices[ 1 ],
+		                    aim->mFaces[ i ].mIndices[ 2 ]);
+	}
+
+
+}
+
+AssimpModelRef AssimpModel::load(const fs::path& filename, bool loadTextures)
+{
+	string key = filename.string() + (loadTextures ? "#textures" : "");
+	time_t writeTime = fs::exists(filename) ? fs::last_write_time(filename) : 0;
+
+	{
+		lock_guard< mutex > lock(sModelCacheMutex);
+		map< string, ModelCacheEntry >::iterator it = sModelCache.find(key);
+		if(it != sModelCache.end() && it->second.mWriteTime == writeTime)
+		{
+			AssimpModelRef modelRef = it->second.mModelRef.lock();
+			if(modelRef)
+				return modelRef;
+		}
+	}
+
+	// loaded outside the lock, so different models can load in parallel
+	AssimpModelRef modelRef;
+	{
+		MNDL_TRACE_SCOPE("AssimpModel::load");
+		modelRef = AssimpModelRef(new AssimpModel(filename, loadTextures));
+	}
+
+	lock_guard< mutex > lock(sModelCacheMutex);
+	ModelCacheEntry& entry = sModelCache[ key ];
+	entry.mModelRef = modelRef;
+	entry.mWriteTime = writeTime;
+	return modelRef;
+}
+
+AssimpModel::AssimpModel(const fs::path& filename, bool loadTextures) :
+	mFilePath(filename),
+	mLoadTextures(loadTextures)
+{
+	// FIXME: aiProcessPreset_TargetRealtime_MaxQuality contains
+	// aiProcess_Debone which is buggy in 3.0.1270
+	unsigned flags = aiProcess_Triangulate |
+	                 aiProcess_FlipUVs |
+	                 aiProcessPreset_TargetRealtime_Quality |
+	                 aiProcess_FindInstances |
+	                 aiProcess_ValidateDataStructure |
+	                 aiProcess_OptimizeMeshes;
+
+	mImporterRef = shared_ptr< Assimp::Importer >(new Assimp::Importer());
+	mImporterRef->SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
+	                                 aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+	mImporterRef->SetPropertyInteger(AI_CONFIG_PP_PTV_NORMALIZE, true);
+	// aiProcess_LimitBoneWeights, part of the preset, renormalizes to what the skinning kernel keeps
+	mImporterRef->SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, MNDL_SKINNING_MAX_INFLUENCES);
+
+	if(Trace::isEnabled())
+		call_once(sTraceLogOnce, attachTraceLogStream);
+
+	// read and post-processed separately to tell them apart in traces
+	Stopwatch timer(true);
+	{
+		MNDL_TRACE_SCOPE("ReadFile");
+		mScene = mImporterRef->ReadFile(filename.string(), 0);
+	}
+	if(mScene)
+	{
+		MNDL_TRACE_SCOPE("PostProcess");
+		mScene = mImporterRef->ApplyPostProcessing(flags);
+		if(sTraceLogStream)
+			sTraceLogStream->finish();
+	}
+	if(!mScene)
+		throw AssimpLoaderExc(mImporterRef->GetErrorString());
+	mLoadStats.mImportTime = timer.getSeconds();
+
+	timer.start();
+	{
+		MNDL_TRACE_SCOPE("calculateDimensions");
+		calculateDimensions();
+	}
+	mLoadStats.mBoundsTime = timer.getSeconds();
+
+	timer.start();
+	loadAllMeshes();
+	mLoadStats.mConvertTime = timer.getSeconds();
+
+	timer.start();
+	{
+		MNDL_TRACE_SCOPE("Rig::create");
+		mRigRef = Rig::create(mScene);
+	}
+	mLoadStats.mRigTime = timer.getSeconds();
+}
+
+void AssimpModel::calculateDimensions()
+{
+	Vec3f aMin, aMax;
+	calculateBoundingBox(&aMin, &aMax);
+	mBoundingBox = AxisAlignedBox3f(aMin, aMax);
+}
+
+void AssimpModel::calculateBoundingBox(ci::Vec3f* min, ci::Vec3f* max)
+{
+	aiMatrix4x4 trafo;
+
+	aiVector3D aiMin, aiMax;
+	aiMin.x = aiMin.y = aiMin.z =  1e10f;
+	aiMax.x = aiMax.y = aiMax.z = -1e10f;
+
+	calculateBoundingBoxForNode(mScene->mRootNode, &aiMin, &aiMax, &trafo);
+	*min = fromAssimp(aiMin);
+	*max = fromAssimp(aiMax);
+}
+
+void AssimpModel::calculateBoundingBoxForNode(const aiNode* nd, aiVector3D* min, aiVector3D* max, aiMatrix4x4* trafo)
+{
+	aiMatrix4x4 prev;
+
+	prev = *trafo;
+	*trafo = *trafo * nd->mTransformation;
+
+	for(unsigned n = 0; n < nd->mNumMeshes; ++n)
+	{
+		const struct aiMesh* mesh = mScene->mMeshes[ nd->mMeshes[ n ] ];
+		for(unsigned t = 0; t < mesh->mNumVertices; ++t)
+		{
+			aiVector3D tmp = mesh->mVertices[ t ];
+			tmp *= (*trafo);
+
+			min->x = math<float>::min(min->x, tmp.x);
+			min->y = math<float>::min(min->y, tmp.y);
+			min->z = math<float>::min(min->z, tmp.z);
+			max->x = math<float>::max(max->x, tmp.x);
+			max->y = math<float>::max(max->y, tmp.y);
+			max->z = math<float>::max(max->z, tmp.z);
+		}
+	}
+
+	for(unsigned n = 0; n < nd->mNumChildren; ++n)
+	{
+		calculateBoundingBoxForNode(nd->mChildren[n], min, max, trafo);
+	}
+
+	*trafo = prev;
+}
+
+AssimpMeshRef AssimpModel::convertAiMesh(const aiMesh* mesh)
+{
+	MNDL_TRACE_SCOPE("convertAiMesh");
+
+	// the current AssimpMesh we will be populating data into.
+	AssimpMeshRef assimpMeshRef = AssimpMeshRef(new AssimpMesh());
+
+	assimpMeshRef->mName = fromAssimp(mesh->mName);
+
+	// Handle material info
+	aiMaterial* mtl = mScene->mMaterials[ mesh->mMaterialIndex ];
+
+	aiString name;
+	mtl->Get(AI_MATKEY_NAME, name);
+	console() << "material " << fromAssimp(name) << endl;
+
+	// Culling
+	int twoSided;
+	if((AI_SUCCESS == mtl->Get(AI_MATKEY_TWOSIDED, twoSided)) && twoSided)
+	{
+		assimpMeshRef->mTwoSided = true;
+		console() << " two sided" << endl;
+	}
+	else
+	{
+		assimpMeshRef->mTwoSided = false;
+	}
+
+#ifndef MNDL_HEADLESS
+	assimpMeshRef->mMaterial.setFace(assimpMeshRef->mTwoSided ? GL_FRONT_AND_BACK : GL_FRONT);
+#endif
+
+	aiColor4D dcolor, scolor, acolor, ecolor;
+	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_DIFFUSE, dcolor))
+	{
+#ifndef MNDL_HEADLESS
+		assimpMeshRef->mMaterial.setDiffuse(fromAssimp(dcolor));
+#endif
+		console() << " diffuse: " << fromAssimp(dcolor) << endl;
+	}
+
+	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_SPECULAR, scolor))
+	{
+#ifndef MNDL_HEADLESS
+		assimpMeshRef->mMaterial.setSpecular(fromAssimp(scolor));
+#endif
+		console() << " specular: " << fromAssimp(scolor) << endl;
+	}
+
+	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_AMBIENT, acolor))
+	{
+#ifndef MNDL_HEADLESS
+		assimpMeshRef->mMaterial.setAmbient(fromAssimp(acolor));
+#endif
+		console() << " ambient: " << fromAssimp(acolor) << endl;
+	}
+
+	if(AI_SUCCESS == mtl->Get(AI_MATKEY_COLOR_EMISSIVE, ecolor))
+	{
+#ifndef MNDL_HEADLESS
+		assimpMeshRef->mMaterial.setEmission(fromAssimp(ecolor));
+#endif
+		console() << " emission: " << fromAssimp(ecolor) << endl;
+	}
+
+	/*
+	// FIXME: not sensible data, obj .mtl Ns 96.078431 -> 384.314
+	float shininessStrength = 1;
+	if ( AI_SUCCESS == mtl->Get( AI_MATKEY_SHININESS_STRENGTH, shininessStrength ) )
+	{
+		console() << "shininess strength: " << shininessStrength << endl;
+	}
+	float shininess;
+	if ( AI_SUCCESS == mtl->Get( AI_MATKEY_SHININESS, shininess ) )
+	{
+		assimpMeshRef->mMaterial.setShininess( shininess * shininessStrength );
+		console() << "shininess: " << shininess * shininessStrength << "[" <<
+			shininess << "]" << endl;
+	}
+	*/
+
+	// TODO: handle blending
+#if 0
+	int blendMode;
+	if(AI_SUCCESS == aiGetMaterialInteger(mtl, AI_MATKEY_BLEND_FUNC, &blendMode))
+	{
+		if(blendMode==aiBlendMode_Default)
+		{
+			meshHelper.blendMode=OF_BLENDMODE_ALPHA;
+		}
+		else
+		{
+			meshHelper.blendMode=OF_BLENDMODE_ADD;
+		}
+	}
+#endif
+
+	// Load Textures, decoding images needs the platform layer of Cinder
+#ifndef MNDL_HEADLESS
+	int texIndex = 0;
+	aiString texPath;
+
+	// TODO: handle other aiTextureTypes
+	if(mLoadTextures && AI_SUCCESS == mtl->GetTexture(aiTextureType_DIFFUSE, texIndex, &texPath))
+	{
+		console() << " diffuse texture " << texPath.data;
+		fs::path texFsPath(texPath.data);
+		fs::path realPath;
+
+		if(fs::exists(texFsPath))
+		{
+			realPath = texFsPath;
+		}
+		else
+		{
+			fs::path texFile = texFsPath.filename();
+			realPath = app::getAssetPath(texFile);
+
+			if(!realPath.empty())
+			{
+				console() << " [" << realPath.string() << "]" << endl;
+			}
+			else
+			{
+				console() << " not found " << endl;
+			}
+		}
+
+		console() << " [" << realPath.string() << "]" << endl;
+
+		// texture wrap
+		gl::Texture::Format format;
+		int uwrap;
+		if(AI_SUCCESS == mtl->Get(AI_MATKEY_MAPPINGMODE_U_DIFFUSE(0), uwrap))
+		{
+			switch(uwrap)
+			{
+				case aiTextureMapMode_Wrap:
+					format.setWrapS(GL_REPEAT);
+					break;
+
+				case aiTextureMapMode_Clamp:
+					format.setWrapS(GL_CLAMP);
+					break;
+
+				case aiTextureMapMode_Decal:
+					// If the texture coordinates for a pixel are outside [0...1]
+					// the texture is not applied to that pixel.
+					format.setWrapS(GL_CLAMP_TO_EDGE);
+					break;
+
+				case aiTextureMapMode_Mirror:
+					// A texture coordinate u|v becomes u%1|v%1 if (u-(u%1))%2
+					// is zero and 1-(u%1)|1-(v%1) otherwise.
+					// TODO
+					format.setWrapS(GL_REPEAT);
+					break;
+			}
+		}
+		int vwrap;
+		if(AI_SUCCESS == mtl->Get(AI_MATKEY_MAPPINGMODE_V_DIFFUSE(0), vwrap))
+		{
+			switch(vwrap)
+			{
+				case aiTextureMapMode_Wrap:
+					format.setWrapT(GL_REPEAT);
+					break;
+
+				case aiTextureMapMode_Clamp:
+					format.setWrapT(GL_CLAMP);
+					break;
+
+				case aiTextureMapMode_Decal:
+					// If the texture coordinates for a pixel are outside [0...1]
+					// the texture is not applied to that pixel.
+					format.setWrapT(GL_CLAMP_TO_EDGE);
+					break;
+
+				case aiTextureMapMode_Mirror:
+					// A texture coordinate u|v becomes u%1|v%1 if (u-(u%1))%2
+					// is zero and 1-(u%1)|1-(v%1) otherwise.
+					// TODO
+					format.setWrapT(GL_REPEAT);
+					break;
+			}
+		}
+
+		if(!realPath.empty())
+		{
+			MNDL_TRACE_SCOPE("loadTexture");
+			assimpMeshRef->mTexture = gl::Texture(loadImage(realPath), format);
+		}
+	}
+#endif
+
+	assimpMeshRef->mAiMesh = mesh;
+	fromAssimp(mesh, &assimpMeshRef->mCachedTriMesh);
+
+	// meshes are drawn without their node transforms
+	if(mesh->mNumVertices > 0)
+	{
+		aiVector3D aiMin = mesh->mVertices[ 0 ];
+		aiVector3D aiMax = aiMin;
+		for(unsigned t = 1; t < mesh->mNumVertices; ++t)
+		{
+			const aiVector3D& v = mesh->mVertices[ t ];
+			aiMin.x = math<float>::min(aiMin.x, v.x);
+			aiMin.y = math<float>::min(aiMin.y, v.y);
+			aiMin.z = math<float>::min(aiMin.z, v.z);
+			aiMax.x = math<float>::max(aiMax.x, v.x);
+			aiMax.y = math<float>::max(aiMax.y, v.y);
+			aiMax.z = math<float>::max(aiMax.z, v.z);
+		}
+		assimpMeshRef->mBounds = AxisAlignedBox3f(fromAssimp(aiMin), fromAssimp(aiMax));
+	}
+
+	if(mesh->HasBones())
+	{
+		if(mesh->mNumBones >= 0xffff)
+			throw AssimpLoaderExc("mesh " + assimpMeshRef->mName + " has " +
+			                      toString< unsigned >(mesh->mNumBones) + " bones.");
+		assimpMeshRef->mSkinData.build(mesh);
+	}
+
+#ifndef MNDL_HEADLESS
+	assimpMeshRef->mBuffersRef = MeshBuffers::create(assimpMeshRef->mCachedTriMesh, &assimpMeshRef->mSkinData);
+#endif
+
+	assimpMeshRef->mIndices.resize(mesh->mNumFaces * 3);
+	unsigned j = 0;
+	for(unsigned x = 0; x < mesh->mNumFaces; ++x)
+	{
+		for(unsigned a = 0; a < mesh->mFaces[x].mNumIndices; ++a)
+		{
+			assimpMeshRef->mIndices[ j++ ] = mesh->mFaces[ x ].mIndices[ a ];
+		}
+	}
+
+	return assimpMeshRef;
+}
+
+void AssimpModel::loadAllMeshes()
+{
+	console() << "loading model " << mFilePath.filename().string() <<
+	               " [" << mFilePath.string() << "] " << endl;
+	for(unsigned i = 0; i < mScene->mNumMeshes; ++i)
+	{
+		string name = fromAssimp(mScene->mMeshes[ i ]->mName);
+		console() << "loading mesh " << i;
+		if(name != "")
+			console() << " [" << name << "]";
+		console() << endl;
+		AssimpMeshRef assimpMeshRef = convertAiMesh(mScene->mMeshes[ i ]);
+		mMeshes.push_back(assimpMeshRef);
+	}
+
+#if 0
+	animationTime = -1;
+	setNormalizedTime(0);
+#endif
+
+	console() << "finished loading model " << mFilePath.filename().string() << endl;
+}
+
+}
+} // namespace mndl::assimp
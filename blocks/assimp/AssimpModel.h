@@ -0,0 +1,133 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "assimp/Importer.hpp"
+#include "assimp/scene.h"
+
+#include "cinder/Cinder.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Filesystem.h"
+
+#include "AssimpMesh.h"
+#include "Rig.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+class AssimpModel;
+typedef std::shared_ptr< const AssimpModel > AssimpModelRef;
+
+//! Time spent in the loading steps of an AssimpModel, in seconds.
+struct ModelLoadStats
+{
+	ModelLoadStats() :
+		mImportTime(0.0), mBoundsTime(0.0), mConvertTime(0.0), mRigTime(0.0)
+	{}
+
+	double mImportTime; /// reading and post-processing the file with assimp
+	double mBoundsTime; /// bounding box of the scene
+	double mConvertTime; /// meshes, skin data and, unless headless, textures
+	double mRigTime; /// rig and animation clips
+};
+
+//! Geometry, GPU buffers, textures, rig and clips of a model file, shared by its AssimpLoader instances.
+/*! Models are immutable once loaded. load() caches them by path, so loading
+    the same unmodified file again returns the model already in memory for as
+    long as an instance holds a reference to it. */
+class AssimpModel
+{
+	public:
+		//! Returns the model in \a filename, loading it unless it is cached.
+		/*! Without textures no GL calls are made, the mesh buffers are uploaded
+		    when first drawn, so models may be loaded on worker threads. Headless
+		    builds never load textures and create no mesh buffers. */
+		static AssimpModelRef load(const ci::fs::path& filename, bool loadTextures = true);
+
+		const ci::fs::path& getFilePath() const
+		{
+			return mFilePath;
+		}
+
+		const aiScene* getScene() const
+		{
+			return mScene;
+		}
+
+		bool getLoadTextures() const
+		{
+			return mLoadTextures;
+		}
+
+		//! Returns the bounding box of the static, not skinned mesh.
+		const ci::AxisAlignedBox3f& getBoundingBox() const
+		{
+			return mBoundingBox;
+		}
+
+		size_t getNumMeshes() const
+		{
+			return mMeshes.size();
+		}
+		//! Returns the \a n'th mesh of the scene.
+		const AssimpMeshRef& getMesh(size_t n) const
+		{
+			return mMeshes[ n ];
+		}
+
+		const RigRef& getRig() const
+		{
+			return mRigRef;
+		}
+
+		//! Returns the time spent loading the model.
+		const ModelLoadStats& getLoadStats() const
+		{
+			return mLoadStats;
+		}
+
+	private:
+		AssimpModel(const ci::fs::path& filename, bool loadTextures);
+		AssimpModel(const AssimpModel&);
+		void operator=(const AssimpModel&);
+
+		void calculateDimensions();
+		void calculateBoundingBox(ci::Vec3f* min, ci::Vec3f* max);
+		void calculateBoundingBoxForNode(const aiNode* nd, aiVector3D* min, aiVector3D* max, aiMatrix4x4* trafo);
+
+		void loadAllMeshes();
+		AssimpMeshRef convertAiMesh(const aiMesh* mesh);
+
+		std::shared_ptr< Assimp::Importer > mImporterRef; // mScene will be destroyed along with the Importer object
+		ci::fs::path mFilePath; /// model path
+		const aiScene* mScene;
+		bool mLoadTextures;
+
+		ci::AxisAlignedBox3f mBoundingBox;
+
+		std::vector< AssimpMeshRef > mMeshes; /// all meshes
+		RigRef mRigRef;
+		ModelLoadStats mLoadStats;
+};
+
+}
+} // namespace mndl::assimp
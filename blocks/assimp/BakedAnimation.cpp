@@ -0,0 +1,354 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <string.h>
+
+#include "cinder/CinderMath.h"
+#include "cinder/Utilities.h"
+
+#include "AssimpLoader.h"
+#include "BakedAnimation.h"
+
+using namespace std;
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! File signature of write(), the last character is the format version.
+static const char kBakedMagic[ 8 ] = { 'M', 'N', 'D', 'L', 'B', 'A', 'K', '1' };
+
+static const float kPositionSteps = 65535.0f;
+static const float kNormalSteps = 127.0f;
+
+template< typename T >
+static void writeValue(ofstream& ofs, const T& value)
+{
+	ofs.write(reinterpret_cast< const char* >(&value), sizeof(T));
+}
+
+template< typename T >
+static void readValue(ifstream& ifs, T* value)
+{
+	ifs.read(reinterpret_cast< char* >(value), sizeof(T));
+}
+
+template< typename T >
+static void writeArray(ofstream& ofs, const vector< T >& values)
+{
+	if(!values.empty())
+		ofs.write(reinterpret_cast< const char* >(&values[ 0 ]), values.size() * sizeof(T));
+}
+
+template< typename T >
+static void readArray(ifstream& ifs, vector< T >* values, size_t count)
+{
+	values->resize(count);
+	if(count > 0)
+		ifs.read(reinterpret_cast< char* >(&(*values)[ 0 ]), count * sizeof(T));
+}
+
+BakedAnimation::BakedAnimation(AssimpModelRef model) :
+	mModelRef(model),
+	mClip(0),
+	mSampleRate(0.0),
+	mDuration(0.0),
+	mNumFrames(0)
+{
+}
+
+BakedAnimationRef BakedAnimation::create(AssimpModelRef model, size_t clip, double sampleRate)
+{
+	shared_ptr< BakedAnimation > bakedRef(new BakedAnimation(model));
+	bakedRef->bake(clip, sampleRate);
+	return bakedRef;
+}
+
+BakedAnimationRef BakedAnimation::load(AssimpModelRef model, const fs::path& filename)
+{
+	shared_ptr< BakedAnimation > bakedRef(new BakedAnimation(model));
+	bakedRef->read(filename);
+	return bakedRef;
+}
+
+void BakedAnimation::bake(size_t clip, double sampleRate)
+{
+	const Rig& rig = *mModelRef->getRig();
+	if(clip >= rig.getNumClips())
+		throw AssimpLoaderExc("animation #" + toString(clip) + " not found.");
+	if(rig.getPaletteSize() == 0)
+		throw AssimpLoaderExc("model has no bones to bake.");
+	if(sampleRate <= 0.0)
+		throw AssimpLoaderExc("invalid sample rate " + toString(sampleRate) + ".");
+
+	mClip = clip;
+	mSampleRate = sampleRate;
+	mDuration = rig.getClip(clip)->getDuration();
+	mNumFrames = math< size_t >::max(static_cast< size_t >(ceil(mDuration * sampleRate)), 1);
+
+	// skin every frame in full precision first, the bounds are only known once all of them are done
+	const size_t kStride = SkinnedBuffers::kStride;
+	const size_t numMeshes = mModelRef->getNumMeshes();
+	mMeshes.resize(numMeshes);
+	vector< vector< float > > frames(numMeshes);
+	for(size_t i = 0; i < numMeshes; ++i)
+	{
+		const SkinData& skinData = mModelRef->getMesh(i)->mSkinData;
+		if(skinData.empty() || rig.getPaletteOffset(i) == Rig::kInvalidNode)
+			continue;
+
+		mMeshes[ i ].mNumVertices = skinData.mNumVertices;
+		frames[ i ].resize(mNumFrames * skinData.mNumVertices * kStride);
+	}
+
+	vector< SkinMatrix > palette(rig.getPaletteSize());
+	for(size_t f = 0; f < mNumFrames; ++f)
+	{
+		rig.evaluate(clip, f * mDuration / mNumFrames, &palette[ 0 ]);
+		for(size_t i = 0; i < numMeshes; ++i)
+		{
+			size_t numVertices = mMeshes[ i ].mNumVertices;
+			if(numVertices == 0)
+				continue;
+
+			float* frame = &frames[ i ][ f * numVertices * kStride ];
+			skinVertices(&palette[ rig.getPaletteOffset(i) ], mModelRef->getMesh(i)->mSkinData, 0, numVertices,
+			             frame, frame + 3, kStride);
+		}
+	}
+
+	for(size_t i = 0; i < numMeshes; ++i)
+	{
+		BakedMesh& mesh = mMeshes[ i ];
+		if(mesh.mNumVertices == 0)
+			continue;
+
+		const vector< float >& values = frames[ i ];
+		const size_t count = mNumFrames * mesh.mNumVertices;
+
+		Vec3f minPos(values[ 0 ], values[ 1 ], values[ 2 ]);
+		Vec3f maxPos = minPos;
+		for(size_t v = 0; v < count; ++v)
+		{
+			const float* p = &values[ v * kStride ];
+			for(int c = 0; c < 3; ++c)
+			{
+				minPos[ c ] = math< float >::min(minPos[ c ], p[ c ]);
+				maxPos[ c ] = math< float >::max(maxPos[ c ], p[ c ]);
+			}
+		}
+		mesh.mPositionMin = minPos;
+		mesh.mPositionScale = (maxPos - minPos) / kPositionSteps;
+
+		mesh.mPositions.resize(count * 3);
+		for(size_t v = 0; v < count; ++v)
+		{
+			const float* p = &values[ v * kStride ];
+			for(int c = 0; c < 3; ++c)
+			{
+				float scale = mesh.mPositionScale[ c ];
+				float q = scale > 0.0f ? (p[ c ] - minPos[ c ]) / scale : 0.0f;
+				mesh.mPositions[ v * 3 + c ] = static_cast< uint16_t >(math< float >::clamp(q + 0.5f, 0.0f, kPositionSteps));
+			}
+		}
+
+		mesh.mNormals.clear();
+		if(!mModelRef->getMesh(i)->mSkinData.mNormals.empty())
+		{
+			mesh.mNormals.resize(count * 3);
+			for(size_t v = 0; v < count; ++v)
+			{
+				const float* n = &values[ v * kStride + 3 ];
+				for(int c = 0; c < 3; ++c)
+				{
+					float q = math< float >::clamp(n[ c ], -1.0f, 1.0f) * kNormalSteps;
+					mesh.mNormals[ v * 3 + c ] = static_cast< int8_t >(q < 0.0f ? q - 0.5f : q + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+size_t BakedAnimation::getNumVertices() const
+{
+	size_t numVertices = 0;
+	for(vector< BakedMesh >::const_iterator it = mMeshes.begin(); it != mMeshes.end(); ++it)
+		numVertices += it->mNumVertices;
+	return numVertices;
+}
+
+size_t BakedAnimation::getMemorySize() const
+{
+	size_t size = 0;
+	for(vector< BakedMesh >::const_iterator it = mMeshes.begin(); it != mMeshes.end(); ++it)
+		size += it->mPositions.size() * sizeof(uint16_t) + it->mNormals.size() * sizeof(int8_t);
+	return size;
+}
+
+AxisAlignedBox3f BakedAnimation::getBounds(size_t meshIndex) const
+{
+	const BakedMesh& mesh = mMeshes[ meshIndex ];
+	return AxisAlignedBox3f(mesh.mPositionMin, mesh.mPositionMin + mesh.mPositionScale * kPositionSteps);
+}
+
+void BakedAnimation::sample(size_t meshIndex, double time, size_t begin, size_t end,
+                            float* outPos, float* outNorm, size_t outStride) const
+{
+	const BakedMesh& mesh = mMeshes[ meshIndex ];
+
+	// frames are spread evenly over the clip, the last one blends back into the first
+	double position = 0.0;
+	if(mDuration > 0.0)
+	{
+		position = fmod(time, mDuration) / mDuration * mNumFrames;
+		if(position < 0.0)
+			position += mNumFrames;
+	}
+	size_t frame = math< size_t >::min(static_cast< size_t >(position), mNumFrames - 1);
+	size_t nextFrame = (frame + 1) % mNumFrames;
+	float factor = static_cast< float >(position - frame);
+
+	// dequantize and interpolate in one step, min + scale * (q0 + (q1 - q0) * factor)
+	const float minPos[ 3 ] = { mesh.mPositionMin.x, mesh.mPositionMin.y, mesh.mPositionMin.z };
+	const float scale[ 3 ] = { mesh.mPositionScale.x, mesh.mPositionScale.y, mesh.mPositionScale.z };
+	const uint16_t* p0 = &mesh.mPositions[ frame * mesh.mNumVertices * 3 ];
+	const uint16_t* p1 = &mesh.mPositions[ nextFrame * mesh.mNumVertices * 3 ];
+	for(size_t v = begin; v < end; ++v)
+	{
+		float* dst = outPos + v * outStride;
+		for(int c = 0; c < 3; ++c)
+		{
+			float q0 = p0[ v * 3 + c ];
+			float q1 = p1[ v * 3 + c ];
+			dst[ c ] = minPos[ c ] + scale[ c ] * (q0 + (q1 - q0) * factor);
+		}
+	}
+
+	// the shaders normalize the interpolated normals
+	if(outNorm && !mesh.mNormals.empty())
+	{
+		const int8_t* n0 = &mesh.mNormals[ frame * mesh.mNumVertices * 3 ];
+		const int8_t* n1 = &mesh.mNormals[ nextFrame * mesh.mNumVertices * 3 ];
+		for(size_t v = begin; v < end; ++v)
+		{
+			float* dst = outNorm + v * outStride;
+			for(int c = 0; c < 3; ++c)
+			{
+				float q0 = n0[ v * 3 + c ];
+				float q1 = n1[ v * 3 + c ];
+				dst[ c ] = (q0 + (q1 - q0) * factor) * (1.0f / kNormalSteps);
+			}
+		}
+	}
+}
+
+void BakedAnimation::write(const fs::path& filename) const
+{
+	ofstream ofs(filename.string().c_str(), ios_base::binary);
+	if(!ofs)
+		throw AssimpLoaderExc("could not write baked animation " + filename.string() + ".");
+
+	ofs.write(kBakedMagic, sizeof(kBakedMagic));
+	writeValue(ofs, static_cast< uint32_t >(mClip));
+	writeValue(ofs, mSampleRate);
+	writeValue(ofs, mDuration);
+	writeValue(ofs, static_cast< uint32_t >(mNumFrames));
+	writeValue(ofs, static_cast< uint32_t >(mMeshes.size()));
+	for(vector< BakedMesh >::const_iterator it = mMeshes.begin(); it != mMeshes.end(); ++it)
+	{
+		const BakedMesh& mesh = *it;
+		writeValue(ofs, static_cast< uint32_t >(mesh.mNumVertices));
+		writeValue(ofs, static_cast< uint8_t >(mesh.mNormals.empty() ? 0 : 1));
+		writeValue(ofs, mesh.mPositionMin);
+		writeValue(ofs, mesh.mPositionScale);
+		writeArray(ofs, mesh.mPositions);
+		writeArray(ofs, mesh.mNormals);
+	}
+
+	if(!ofs)
+		throw AssimpLoaderExc("could not write baked animation " + filename.string() + ".");
+}
+
+void BakedAnimation::read(const fs::path& filename)
+{
+	ifstream ifs(filename.string().c_str(), ios_base::binary);
+	if(!ifs)
+		throw AssimpLoaderExc("could not open baked animation " + filename.string() + ".");
+
+	ifs.seekg(0, ios_base::end);
+	uint64_t remaining = static_cast< uint64_t >(ifs.tellg());
+	ifs.seekg(0, ios_base::beg);
+
+	char magic[ sizeof(kBakedMagic) ];
+	ifs.read(magic, sizeof(magic));
+	if(!ifs || memcmp(magic, kBakedMagic, sizeof(magic)) != 0)
+		throw AssimpLoaderExc(filename.string() + " is not a baked animation.");
+
+	uint32_t clip, numFrames, numMeshes;
+	readValue(ifs, &clip);
+	readValue(ifs, &mSampleRate);
+	readValue(ifs, &mDuration);
+	readValue(ifs, &numFrames);
+	readValue(ifs, &numMeshes);
+	mClip = clip;
+	mNumFrames = numFrames;
+
+	// the cache has to match the skinned meshes of the model it is played on,
+	// and hold as many frames as bake() takes of the clip at its sample rate
+	const Rig& rig = *mModelRef->getRig();
+	if(!ifs || mClip >= rig.getNumClips() || numMeshes != mModelRef->getNumMeshes() ||
+	   mDuration != rig.getClip(mClip)->getDuration() || !(mSampleRate > 0.0) ||
+	   numFrames != math< double >::max(ceil(mDuration * mSampleRate), 1.0))
+		throw AssimpLoaderExc(filename.string() + " does not match the model.");
+	remaining -= static_cast< uint64_t >(ifs.tellg());
+
+	mMeshes.resize(numMeshes);
+	for(size_t i = 0; i < numMeshes; ++i)
+	{
+		BakedMesh& mesh = mMeshes[ i ];
+		uint32_t numVertices;
+		uint8_t hasNormals;
+		readValue(ifs, &numVertices);
+		readValue(ifs, &hasNormals);
+		readValue(ifs, &mesh.mPositionMin);
+		readValue(ifs, &mesh.mPositionScale);
+
+		const SkinData& skinData = mModelRef->getMesh(i)->mSkinData;
+		if(!ifs || (numVertices != 0 && numVertices != skinData.mNumVertices))
+			throw AssimpLoaderExc(filename.string() + " does not match the model.");
+
+		// check the arrays against the rest of the file before allocating them
+		const uint64_t headerSize = sizeof(numVertices) + sizeof(hasNormals) + sizeof(mesh.mPositionMin) + sizeof(mesh.mPositionScale);
+		const uint64_t frameSize = static_cast< uint64_t >(numVertices) * 3 * (sizeof(uint16_t) + (hasNormals ? sizeof(int8_t) : 0));
+		if(remaining < headerSize || (frameSize > 0 && (remaining - headerSize) / frameSize < mNumFrames))
+			throw AssimpLoaderExc(filename.string() + " is truncated.");
+		remaining -= headerSize + frameSize * mNumFrames;
+
+		mesh.mNumVertices = numVertices;
+		readArray(ifs, &mesh.mPositions, mNumFrames * numVertices * 3);
+		readArray(ifs, &mesh.mNormals, hasNormals ? mNumFrames * numVertices * 3 : 0);
+	}
+
+	if(!ifs)
+		throw AssimpLoaderExc(filename.string() + " is truncated.");
+}
+
+}
+} // namespace mndl::assimp
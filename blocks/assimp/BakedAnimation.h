@@ -0,0 +1,129 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "cinder/Cinder.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Vector.h"
+
+#include "AssimpModel.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+class BakedAnimation;
+typedef std::shared_ptr< const BakedAnimation > BakedAnimationRef;
+
+//! Skinned vertices of a looping clip, sampled at a fixed rate and quantized.
+/*! Positions are stored as 16-bit offsets into the bounds of each mesh over
+    the whole clip and normals as 8-bit components, 9 bytes per vertex and
+    frame instead of the 24 of the skinned buffers. Playback interpolates
+    between the two frames around the requested time, the last frame blends
+    back into the first one. */
+class BakedAnimation
+{
+	public:
+		//! Bakes clip \a clip of \a model at \a sampleRate frames per second.
+		static BakedAnimationRef create(AssimpModelRef model, size_t clip, double sampleRate = 30.0);
+		//! Loads a cache of \a model written by write(), throws AssimpLoaderExc if it does not fit the model.
+		static BakedAnimationRef load(AssimpModelRef model, const ci::fs::path& filename);
+
+		//! Writes the cache to \a filename, throws AssimpLoaderExc on failure.
+		void write(const ci::fs::path& filename) const;
+
+		const AssimpModelRef& getModel() const
+		{
+			return mModelRef;
+		}
+
+		size_t getClip() const
+		{
+			return mClip;
+		}
+
+		double getSampleRate() const
+		{
+			return mSampleRate;
+		}
+
+		size_t getNumFrames() const
+		{
+			return mNumFrames;
+		}
+
+		//! Returns the duration of the clip in seconds.
+		double getDuration() const
+		{
+			return mDuration;
+		}
+
+		//! Returns the number of baked vertices per frame over all meshes.
+		size_t getNumVertices() const;
+		//! Returns the size of the frames in bytes.
+		size_t getMemorySize() const;
+
+		//! Returns true if the vertices of scene mesh \a mesh have been baked, meshes without bones are not.
+		bool hasMesh(size_t mesh) const
+		{
+			return mesh < mMeshes.size() && mMeshes[ mesh ].mNumVertices > 0;
+		}
+
+		//! Returns the bounds of scene mesh \a mesh over the whole clip.
+		ci::AxisAlignedBox3f getBounds(size_t mesh) const;
+
+		//! Writes vertices [\a begin, \a end) of scene mesh \a mesh at \a time seconds.
+		/*! Laid out like skinVertices(), \a outPos and \a outNorm point at vertex 0
+		    and advance \a outStride floats per vertex. \a outNorm may be NULL. */
+		void sample(size_t mesh, double time, size_t begin, size_t end,
+		            float* outPos, float* outNorm, size_t outStride) const;
+
+	private:
+		BakedAnimation(AssimpModelRef model);
+		BakedAnimation(const BakedAnimation&);
+		void operator=(const BakedAnimation&);
+
+		void bake(size_t clip, double sampleRate);
+		void read(const ci::fs::path& filename);
+
+		struct BakedMesh
+		{
+			BakedMesh() : mNumVertices(0) {}
+
+			size_t mNumVertices;
+			ci::Vec3f mPositionMin;
+			ci::Vec3f mPositionScale; /// size of one quantization step
+			std::vector< uint16_t > mPositions; /// x, y, z per vertex and frame
+			std::vector< int8_t > mNormals; /// x, y, z per vertex and frame, empty if the mesh has no normals
+		};
+
+		AssimpModelRef mModelRef;
+		size_t mClip;
+		double mSampleRate;
+		double mDuration;
+		size_t mNumFrames;
+		std::vector< BakedMesh > mMeshes; /// by scene mesh
+};
+
+}
+} // namespace mndl::assimp
@@ -0,0 +1,423 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "cinder/CinderMath.h"
+
+#include "MeshBuffers.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+#ifdef MNDL_HEADLESS
+
+// without a GL context the skinned vertices and palettes are kept in memory
+
+SkinnedBuffers::SkinnedBuffers(size_t numVertices) :
+	mNumVertices(numVertices),
+	mCurrent(kNumBuffers),
+	mMapped(kNumBuffers)
+{
+}
+
+SkinnedBuffers::~SkinnedBuffers()
+{
+}
+
+float* SkinnedBuffers::map()
+{
+	assert(mMapped == kNumBuffers);
+
+	if(mNumVertices == 0)
+		return NULL;
+
+	mData.resize(mNumVertices * kStride);
+	mMapped = 0;
+	return &mData[ 0 ];
+}
+
+void SkinnedBuffers::unmap()
+{
+	if(mMapped == kNumBuffers)
+		return;
+
+	mCurrent = mMapped;
+	mMapped = kNumBuffers;
+}
+
+PaletteBuffer::PaletteBuffer() :
+	mHasData(false)
+{
+}
+
+PaletteBuffer::~PaletteBuffer()
+{
+}
+
+void PaletteBuffer::update(const SkinMatrix* palette, size_t count)
+{
+	assert(count <= kMaxBones);
+
+	mPalette.assign(palette, palette + count);
+	mHasData = true;
+}
+
+#else
+
+static inline const GLvoid* bufferOffset(size_t offset)
+{
+	return reinterpret_cast< const GLvoid* >(offset);
+}
+
+//! Influences per vertex blended by mesh_skinned.vert.
+static const size_t kGpuInfluences = 4;
+
+MeshBuffers::MeshBuffers(const TriMesh& mesh, const SkinData* skin) :
+	mNumVertices(mesh.getNumVertices()),
+	mNumIndices(static_cast< GLsizei >(mesh.getNumIndices())),
+	mStaticBuffer(0),
+	mIndexBuffer(0)
+{
+	const vector< Vec3f >& vertices = mesh.getVertices();
+	const vector< Vec3f >& normals = mesh.getNormals();
+	const vector< Vec2f >& texCoords = mesh.getTexCoords();
+	const vector< Vec3f >& tangents = mesh.getTangents();
+	const vector< ColorAf >& colors = mesh.getColorsRGBA();
+
+	mHasNormals = normals.size() == mNumVertices;
+	mHasTexCoords = texCoords.size() == mNumVertices;
+	mHasTangents = tangents.size() == mNumVertices;
+	mHasColors = colors.size() == mNumVertices;
+	mHasBones = skin && !skin->empty() && skin->mNumVertices == mNumVertices;
+
+	// bone indices as floats for GLSL 1.20, weights renormalized if more influences are kept on the CPU
+	vector< float > boneIndices;
+	vector< float > boneWeights;
+	if(mHasBones)
+	{
+		boneIndices.resize(mNumVertices * kGpuInfluences);
+		boneWeights.resize(mNumVertices * kGpuInfluences);
+		for(size_t v = 0; v < mNumVertices; ++v)
+		{
+			const uint16_t* srcIndices = &skin->mBoneIndices[ v * MNDL_SKINNING_MAX_INFLUENCES ];
+			const float* srcWeights = &skin->mBoneWeights[ v * MNDL_SKINNING_MAX_INFLUENCES ];
+
+			float sum = 0.f;
+			for(size_t i = 0; i < kGpuInfluences; ++i)
+				sum += srcWeights[ i ];
+			float scale = sum > 0.f ? 1.f / sum : 0.f;
+
+			for(size_t i = 0; i < kGpuInfluences; ++i)
+			{
+				boneIndices[ v * kGpuInfluences + i ] = srcIndices[ i ];
+				boneWeights[ v * kGpuInfluences + i ] = srcWeights[ i ] * scale;
+			}
+		}
+	}
+
+	// attributes are stored one after the other
+	size_t size = mNumVertices * sizeof(Vec3f);
+	mNormalOffset = size;
+	size += mHasNormals ? mNumVertices * sizeof(Vec3f) : 0;
+	mTexCoordOffset = size;
+	size += mHasTexCoords ? mNumVertices * sizeof(Vec2f) : 0;
+	mTangentOffset = size;
+	size += mHasTangents ? mNumVertices * sizeof(Vec3f) : 0;
+	mColorOffset = size;
+	size += mHasColors ? mNumVertices * sizeof(ColorAf) : 0;
+	mBoneIndexOffset = size;
+	size += boneIndices.size() * sizeof(float);
+	mBoneWeightOffset = size;
+	size += boneWeights.size() * sizeof(float);
+
+	// staged in memory, no GL calls until the first draw
+	mStaticData.resize(size);
+	if(mNumVertices > 0)
+	{
+		memcpy(&mStaticData[ 0 ], &vertices[ 0 ], mNumVertices * sizeof(Vec3f));
+		if(mHasNormals)
+			memcpy(&mStaticData[ mNormalOffset ], &normals[ 0 ], mNumVertices * sizeof(Vec3f));
+		if(mHasTexCoords)
+			memcpy(&mStaticData[ mTexCoordOffset ], &texCoords[ 0 ], mNumVertices * sizeof(Vec2f));
+		if(mHasTangents)
+			memcpy(&mStaticData[ mTangentOffset ], &tangents[ 0 ], mNumVertices * sizeof(Vec3f));
+		if(mHasColors)
+			memcpy(&mStaticData[ mColorOffset ], &colors[ 0 ], mNumVertices * sizeof(ColorAf));
+		if(mHasBones)
+		{
+			memcpy(&mStaticData[ mBoneIndexOffset ], &boneIndices[ 0 ], boneIndices.size() * sizeof(float));
+			memcpy(&mStaticData[ mBoneWeightOffset ], &boneWeights[ 0 ], boneWeights.size() * sizeof(float));
+		}
+	}
+
+	mIndexData = mesh.getIndices();
+}
+
+void MeshBuffers::upload()
+{
+	MNDL_TRACE_SCOPE("MeshBuffers::upload");
+
+	glGenBuffers(1, &mStaticBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mStaticBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mStaticData.size(), mStaticData.empty() ? NULL : &mStaticData[ 0 ], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &mIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexData.size() * sizeof(uint32_t),
+	             mIndexData.empty() ? NULL : &mIndexData[ 0 ], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// the GL keeps its own copy
+	vector< char >().swap(mStaticData);
+	vector< uint32_t >().swap(mIndexData);
+}
+
+MeshBuffers::~MeshBuffers()
+{
+	if(mStaticBuffer)
+	{
+		glDeleteBuffers(1, &mStaticBuffer);
+		glDeleteBuffers(1, &mIndexBuffer);
+	}
+}
+
+SkinnedBuffers::SkinnedBuffers(size_t numVertices) :
+	mNumVertices(numVertices),
+	mCurrent(kNumBuffers),
+	mMapped(kNumBuffers)
+{
+	// buffers are created on the first map()
+	for(size_t i = 0; i < kNumBuffers; ++i)
+	{
+		mBuffers[ i ] = 0;
+		mFences[ i ] = 0;
+	}
+}
+
+SkinnedBuffers::~SkinnedBuffers()
+{
+	for(size_t i = 0; i < kNumBuffers; ++i)
+	{
+		if(mFences[ i ])
+			glDeleteSync(mFences[ i ]);
+	}
+	if(mBuffers[ 0 ])
+		glDeleteBuffers(kNumBuffers, mBuffers);
+}
+
+float* SkinnedBuffers::map()
+{
+	assert(mMapped == kNumBuffers);
+
+	const GLsizeiptr size = mNumVertices * kStride * sizeof(float);
+	if(!mBuffers[ 0 ])
+	{
+		glGenBuffers(kNumBuffers, mBuffers);
+		for(size_t i = 0; i < kNumBuffers; ++i)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, mBuffers[ i ]);
+			glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+		}
+	}
+
+	mMapped = (mCurrent + 1) % kNumBuffers;
+
+	// the GPU may still read the buffer drawn kNumBuffers - 1 frames ago,
+	// if the fence times out or fails the driver has to synchronize the map
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	if(mFences[ mMapped ])
+	{
+		GLenum result = glClientWaitSync(mFences[ mMapped ], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			access &= ~GL_MAP_UNSYNCHRONIZED_BIT;
+		glDeleteSync(mFences[ mMapped ]);
+		mFences[ mMapped ] = 0;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffers[ mMapped ]);
+	void* data = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, access);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if(!data)
+		mMapped = kNumBuffers;
+	return static_cast< float* >(data);
+}
+
+void SkinnedBuffers::unmap()
+{
+	if(mMapped == kNumBuffers)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffers[ mMapped ]);
+	if(glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE)
+		mCurrent = mMapped;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	mMapped = kNumBuffers;
+}
+
+void SkinnedBuffers::fence()
+{
+	if(mFences[ mCurrent ])
+		glDeleteSync(mFences[ mCurrent ]);
+	mFences[ mCurrent ] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+PaletteBuffer::PaletteBuffer() :
+	mSlot(kNumSlots - 1),
+	mHasData(false)
+{
+	GLint alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = math< GLint >::max(alignment, 1);
+
+	// every range holds the whole block, shorter palettes leave the tail unused
+	mSlotSize = kMaxBones * sizeof(SkinMatrix);
+	mSlotSize = (mSlotSize + alignment - 1) / alignment * alignment;
+
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, kNumSlots * mSlotSize, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+PaletteBuffer::~PaletteBuffer()
+{
+	glDeleteBuffers(1, &mBuffer);
+}
+
+void PaletteBuffer::update(const SkinMatrix* palette, size_t count)
+{
+	assert(count <= kMaxBones);
+
+	// the GPU may still read the ranges of the previous frames, the storage is never reallocated
+	mSlot = (mSlot + 1) % kNumSlots;
+	glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, mSlot * mSlotSize, count * sizeof(SkinMatrix), palette);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	mHasData = true;
+}
+
+void PaletteBuffer::bind(GLuint binding)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, mBuffer, mSlot * mSlotSize, mSlotSize);
+}
+
+void MeshBuffers::draw(SkinnedBuffers* skinned, const BoneAttribLocations* bones)
+{
+	const bool dynamic = skinned && skinned->hasData();
+	const bool boneAttribs = bones && mHasBones && bones->mIndices >= 0 && bones->mWeights >= 0;
+
+	if(!mStaticBuffer)
+		upload();
+
+	glBindBuffer(GL_ARRAY_BUFFER, mStaticBuffer);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	if(mHasNormals)
+		glEnableClientState(GL_NORMAL_ARRAY);
+
+	if(!dynamic)
+	{
+		glVertexPointer(3, GL_FLOAT, 0, bufferOffset(0));
+		if(mHasNormals)
+			glNormalPointer(GL_FLOAT, 0, bufferOffset(mNormalOffset));
+	}
+
+	if(mHasTexCoords)
+	{
+		glClientActiveTexture(GL_TEXTURE0);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, 0, bufferOffset(mTexCoordOffset));
+	}
+
+	// the mesh shaders read tangents from gl_MultiTexCoord7
+	if(mHasTangents)
+	{
+		glClientActiveTexture(GL_TEXTURE7);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(3, GL_FLOAT, 0, bufferOffset(mTangentOffset));
+	}
+
+	if(mHasColors)
+	{
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(4, GL_FLOAT, 0, bufferOffset(mColorOffset));
+	}
+
+	if(boneAttribs)
+	{
+		glEnableVertexAttribArray(bones->mIndices);
+		glVertexAttribPointer(bones->mIndices, kGpuInfluences, GL_FLOAT, GL_FALSE, 0, bufferOffset(mBoneIndexOffset));
+		glEnableVertexAttribArray(bones->mWeights);
+		glVertexAttribPointer(bones->mWeights, kGpuInfluences, GL_FLOAT, GL_FALSE, 0, bufferOffset(mBoneWeightOffset));
+	}
+
+	if(dynamic)
+	{
+		const GLsizei stride = SkinnedBuffers::kStride * sizeof(float);
+		glBindBuffer(GL_ARRAY_BUFFER, skinned->mBuffers[ skinned->mCurrent ]);
+		glVertexPointer(3, GL_FLOAT, stride, bufferOffset(0));
+		if(mHasNormals)
+			glNormalPointer(GL_FLOAT, stride, bufferOffset(3 * sizeof(float)));
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	glDrawElements(GL_TRIANGLES, mNumIndices, GL_UNSIGNED_INT, bufferOffset(0));
+
+	if(dynamic)
+		skinned->fence();
+
+	if(boneAttribs)
+	{
+		glDisableVertexAttribArray(bones->mWeights);
+		glDisableVertexAttribArray(bones->mIndices);
+	}
+	if(mHasColors)
+		glDisableClientState(GL_COLOR_ARRAY);
+	if(mHasTangents)
+	{
+		glClientActiveTexture(GL_TEXTURE7);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	if(mHasTexCoords)
+	{
+		glClientActiveTexture(GL_TEXTURE0);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	glClientActiveTexture(GL_TEXTURE0);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
+
+}
+} // namespace mndl::assimp
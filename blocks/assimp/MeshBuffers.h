@@ -0,0 +1,230 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/TriMesh.h"
+#ifndef MNDL_HEADLESS
+#include "cinder/gl/gl.h"
+#endif
+
+#include "Skinning.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+class MeshBuffers;
+class SkinnedBuffers;
+class PaletteBuffer;
+typedef std::shared_ptr< MeshBuffers > MeshBuffersRef;
+typedef std::shared_ptr< SkinnedBuffers > SkinnedBuffersRef;
+typedef std::shared_ptr< PaletteBuffer > PaletteBufferRef;
+
+#ifndef MNDL_HEADLESS
+//! Generic attribute locations of the bone indices and weights read by a skinning vertex shader.
+struct BoneAttribLocations
+{
+	BoneAttribLocations() : mIndices(-1), mWeights(-1) {}
+
+	GLint mIndices;
+	GLint mWeights;
+};
+#endif
+
+//! Ring of vertex buffers holding the skinned positions and normals of one mesh instance.
+/*! Each buffer is fenced after drawing, so mapping the next one does not
+    stall on buffers the GPU is still reading. Headless builds skin into a
+    single buffer in memory, read back with getData(). */
+class SkinnedBuffers
+{
+	public:
+		//! Number of buffers in the ring.
+		static const size_t kNumBuffers = 3;
+		//! Floats per vertex, position followed by normal.
+		static const size_t kStride = 6;
+
+		static SkinnedBuffersRef create(size_t numVertices)
+		{
+			return SkinnedBuffersRef(new SkinnedBuffers(numVertices));
+		}
+
+		~SkinnedBuffers();
+
+		//! Maps the next buffer for writing, returns kStride floats per vertex.
+		float* map();
+		//! Unmaps the buffer returned by map() and draws from it from now on.
+		void unmap();
+
+		//! Returns true if a buffer has been filled.
+		bool hasData() const
+		{
+			return mCurrent < kNumBuffers;
+		}
+
+#ifdef MNDL_HEADLESS
+		//! Returns the positions and normals of the last unmapped buffer, kStride floats per vertex.
+		const float* getData() const
+		{
+			return mData.empty() ? NULL : &mData[ 0 ];
+		}
+#endif
+
+	private:
+		SkinnedBuffers(size_t numVertices);
+		SkinnedBuffers(const SkinnedBuffers&);
+		void operator=(const SkinnedBuffers&);
+
+		size_t mNumVertices;
+#ifdef MNDL_HEADLESS
+		std::vector< float > mData;
+#else
+		friend class MeshBuffers;
+
+		//! Fences the drawn buffer after its draw call has been issued.
+		void fence();
+
+		GLuint mBuffers[ kNumBuffers ];
+		GLsync mFences[ kNumBuffers ];
+#endif
+		size_t mCurrent; /// drawn buffer, kNumBuffers before the first one is filled
+		size_t mMapped; /// mapped buffer, kNumBuffers if none
+};
+
+//! Uniform buffer holding the bone palette of one mesh instance for skinning on the GPU.
+/*! The layout matches the std140 BonePalette block of mesh_skinned.vert,
+    three vec4 rows per bone. Updates go to the next of kNumSlots ranges of
+    one buffer allocated once, instead of the range the GPU may still read.
+    Headless builds keep the palette in memory. */
+class PaletteBuffer
+{
+	public:
+		//! Maximum number of palette entries, MAX_BONES in mesh_skinned.vert.
+		static const size_t kMaxBones = 256;
+		//! Number of palettes in the ring, as many frames as SkinnedBuffers keeps.
+		static const size_t kNumSlots = 3;
+
+		static PaletteBufferRef create()
+		{
+			return PaletteBufferRef(new PaletteBuffer());
+		}
+
+		~PaletteBuffer();
+
+		//! Uploads \a count palette entries, at most kMaxBones.
+		void update(const SkinMatrix* palette, size_t count);
+
+		//! Returns true if a palette has been uploaded.
+		bool hasData() const
+		{
+			return mHasData;
+		}
+
+#ifdef MNDL_HEADLESS
+		//! Returns the last uploaded palette.
+		const SkinMatrix* getData() const
+		{
+			return mPalette.empty() ? NULL : &mPalette[ 0 ];
+		}
+#else
+		//! Binds the last uploaded palette to the uniform buffer binding point \a binding.
+		void bind(GLuint binding);
+#endif
+
+	private:
+		PaletteBuffer();
+		PaletteBuffer(const PaletteBuffer&);
+		void operator=(const PaletteBuffer&);
+
+#ifdef MNDL_HEADLESS
+		std::vector< SkinMatrix > mPalette;
+#else
+		GLuint mBuffer;
+		GLsizeiptr mSlotSize; /// a whole BonePalette block, rounded up to the uniform buffer offset alignment
+		size_t mSlot; /// range of the last update
+#endif
+		bool mHasData;
+};
+
+#ifndef MNDL_HEADLESS
+
+//! Static GL buffers of a mesh, shared by every instance of the model.
+/*! The rest pose, texture coordinates, tangents, indices and, for skinned
+    meshes, the four strongest bone indices and weights are uploaded once, by
+    the first draw(). Creating the buffers makes no GL calls, so models can be
+    loaded on threads without a GL context. */
+class MeshBuffers
+{
+	public:
+		static MeshBuffersRef create(const ci::TriMesh& mesh, const SkinData* skin = NULL)
+		{
+			return MeshBuffersRef(new MeshBuffers(mesh, skin));
+		}
+
+		~MeshBuffers();
+
+		size_t getNumVertices() const
+		{
+			return mNumVertices;
+		}
+
+		//! Returns true if the mesh has vertex colors, which leave the current color undefined after drawing.
+		bool hasColors() const
+		{
+			return mHasColors;
+		}
+
+		//! Draws the mesh using the rest pose, or the positions and normals in \a skinned if it has been filled.
+		/*! Bone indices and weights are fed to the \a bones attributes, if given. */
+		void draw(SkinnedBuffers* skinned = NULL, const BoneAttribLocations* bones = NULL);
+
+	private:
+		MeshBuffers(const ci::TriMesh& mesh, const SkinData* skin);
+		MeshBuffers(const MeshBuffers&);
+		void operator=(const MeshBuffers&);
+
+		//! Creates the GL buffers from the staged data and releases it.
+		void upload();
+
+		size_t mNumVertices;
+		GLsizei mNumIndices;
+
+		std::vector< char > mStaticData; /// attributes waiting for upload()
+		std::vector< uint32_t > mIndexData;
+
+		GLuint mStaticBuffer;
+		GLuint mIndexBuffer;
+		size_t mNormalOffset;
+		size_t mTexCoordOffset;
+		size_t mTangentOffset;
+		size_t mColorOffset;
+		size_t mBoneIndexOffset;
+		size_t mBoneWeightOffset;
+		bool mHasNormals;
+		bool mHasTexCoords;
+		bool mHasTangents;
+		bool mHasColors;
+		bool mHasBones;
+};
+#endif
+
+}
+} // namespace mndl::assimp
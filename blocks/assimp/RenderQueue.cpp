@@ -0,0 +1,239 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <assert.h>
+
+#include "RenderQueue.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! Uniform buffer binding point of the BonePalette block.
+static const GLuint kBonePaletteBinding = 0;
+
+//! Bits of the sort key, from the most significant field to the least significant one.
+static const int kProgramBits = 12;
+static const int kTextureBits = 16;
+static const int kMaterialBits = 16;
+static const int kCullBits = 1;
+static const int kSequenceBits = 19;
+
+static uint64_t sKeyField(uint64_t value, int bits, int shift)
+{
+	return (value & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+static GLuint sTextureId(const RenderItem& item)
+{
+	const gl::Texture& texture = item.mMesh->mMeshRef->mTexture;
+	return item.mTextured && texture ? texture.getId() : 0;
+}
+
+static bool sItemLess(const RenderItem& a, const RenderItem& b)
+{
+	return a.mKey < b.mKey;
+}
+
+void RenderQueue::clear()
+{
+	mItems.clear();
+	mTransforms.clear();
+}
+
+size_t RenderQueue::addTransform(const Matrix44f& modelView)
+{
+	mTransforms.push_back(modelView);
+	return mTransforms.size() - 1;
+}
+
+void RenderQueue::add(const RenderItem& item)
+{
+	assert(item.mMesh && item.mTransform < mTransforms.size());
+
+	const AssimpMesh& assimpMesh = *item.mMesh->mMeshRef;
+	// materials are grouped by address, colliding low bits only cost a few extra changes
+	uintptr_t material = reinterpret_cast< uintptr_t >(&assimpMesh.mMaterial) / sizeof(void*);
+
+	int shift = 64;
+	uint64_t key = 0;
+	key |= sKeyField(item.mProgram, kProgramBits, shift -= kProgramBits);
+	key |= sKeyField(sTextureId(item), kTextureBits, shift -= kTextureBits);
+	key |= sKeyField(material, kMaterialBits, shift -= kMaterialBits);
+	key |= sKeyField(assimpMesh.mTwoSided ? 1 : 0, kCullBits, shift -= kCullBits);
+	// submission order breaks ties, keeping the sort stable
+	key |= sKeyField(mItems.size(), kSequenceBits, shift -= kSequenceBits);
+
+	mItems.push_back(item);
+	mItems.back().mKey = key;
+}
+
+size_t RenderQueue::countStateTransitions(const vector< RenderItem >& items)
+{
+	size_t transitions = 0;
+	for(size_t i = 1; i < items.size(); ++i)
+	{
+		const RenderItem& a = items[ i - 1 ];
+		const RenderItem& b = items[ i ];
+		const AssimpMesh& meshA = *a.mMesh->mMeshRef;
+		const AssimpMesh& meshB = *b.mMesh->mMeshRef;
+
+		if(a.mProgram != b.mProgram)
+			++transitions;
+		if(a.mTextured != b.mTextured || sTextureId(a) != sTextureId(b))
+			++transitions;
+		if(a.mMaterials != b.mMaterials || &meshA.mMaterial != &meshB.mMaterial)
+			++transitions;
+		if(meshA.mTwoSided != meshB.mTwoSided)
+			++transitions;
+	}
+	return transitions;
+}
+
+const BoneAttribLocations& RenderQueue::getBoneAttribs(GLuint program)
+{
+	map< GLuint, BoneAttribLocations >::const_iterator it = mProgramBones.find(program);
+	if(it != mProgramBones.end())
+		return it->second;
+
+	// bind the palette block and look up the bone attributes once per program,
+	// the fixed function pipeline has no bone attributes
+	BoneAttribLocations& boneAttribs = mProgramBones[ program ];
+	if(program)
+	{
+		GLuint block = glGetUniformBlockIndex(program, "BonePalette");
+		if(block != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(program, block, kBonePaletteBinding);
+			boneAttribs.mIndices = glGetAttribLocation(program, "boneIndices");
+			boneAttribs.mWeights = glGetAttribLocation(program, "boneWeights");
+		}
+	}
+	return boneAttribs;
+}
+
+//! Blends the palette meant for the GPU into the skinned buffers, for programs without the BonePalette block.
+static void sSkinOnCpu(const AssimpMeshInstance& meshInstance)
+{
+	const SkinData& skinData = meshInstance.mMeshRef->mSkinData;
+	float* output = meshInstance.mSkinnedBuffersRef->map();
+	if(!output)
+		return;
+	skinVertices(&meshInstance.mBonePalette[ 0 ], skinData, 0, skinData.mNumVertices,
+	             output, output + 3, SkinnedBuffers::kStride);
+	meshInstance.mSkinnedBuffersRef->unmap();
+}
+
+void RenderQueue::draw(const RenderBaseState& base)
+{
+	MNDL_TRACE_SCOPE("RenderQueue::draw");
+
+	mStats = RenderStats();
+	if(mItems.empty())
+		return;
+
+	size_t submittedTransitions = countStateTransitions(mItems);
+	sort(mItems.begin(), mItems.end(), sItemLess);
+	size_t sortedTransitions = countStateTransitions(mItems);
+
+	gl::pushModelView();
+
+	// only actual changes reach GL, MeshBuffers::draw() leaves the client state as it found it
+	mRenderState.begin(base);
+	mRenderState.setNormalize(true);
+
+	BoneAttribLocations boneAttribs = getBoneAttribs(base.mProgram);
+	GLuint program = base.mProgram;
+
+	vector< RenderItem >::const_iterator it = mItems.begin();
+	for(; it != mItems.end(); ++it)
+	{
+		const RenderItem& item = *it;
+		const AssimpMeshInstance& meshInstance = *item.mMesh;
+		const AssimpMesh& assimpMesh = *meshInstance.mMeshRef;
+
+		mRenderState.useProgram(item.mProgram);
+		if(program != item.mProgram)
+		{
+			boneAttribs = getBoneAttribs(item.mProgram);
+			program = item.mProgram;
+		}
+
+		mRenderState.modelView(&mTransforms[ item.mTransform ]);
+
+		// Texture Binding
+		if(item.mTextured)
+		{
+			if(assimpMesh.mTexture)
+				mRenderState.bindTexture(assimpMesh.mTexture);
+			else
+				mRenderState.disableTexture();
+		}
+
+		if(item.mMaterials)
+		{
+			mRenderState.material(&assimpMesh.mMaterial);
+		}
+		else
+		{
+			mRenderState.color(assimpMesh.mMaterial.getDiffuse());
+		}
+
+		// Culling
+		mRenderState.setCullFace(assimpMesh.mTwoSided);
+
+		const PaletteBufferRef& paletteBufferRef = meshInstance.mPaletteBufferRef;
+		const bool gpuPalette = item.mGpuPalette && paletteBufferRef && paletteBufferRef->hasData();
+		if(gpuPalette && boneAttribs.mWeights >= 0)
+		{
+			paletteBufferRef->bind(kBonePaletteBinding);
+			assimpMesh.mBuffersRef->draw(NULL, &boneAttribs);
+		}
+		else
+		{
+			// the skinned buffers were not filled in GPU mode, the program cannot blend the bones
+			if(gpuPalette && meshInstance.mSkinnedBuffersRef)
+				sSkinOnCpu(meshInstance);
+
+			// zero weights pass the vertices of the skinning shader through unchanged
+			if(boneAttribs.mWeights >= 0)
+				glVertexAttrib4f(boneAttribs.mWeights, 0.f, 0.f, 0.f, 0.f);
+
+			// skinned meshes are drawn from their instance buffers once they have been filled
+			assimpMesh.mBuffersRef->draw(item.mSkinned ? meshInstance.mSkinnedBuffersRef.get() : NULL);
+		}
+		mRenderState.countDrawCall();
+		if(assimpMesh.mBuffersRef->hasColors())
+			mRenderState.invalidateColor();
+	}
+
+	mRenderState.end();
+
+	gl::popModelView();
+
+	mStats = mRenderState.getStats();
+	mStats.mStateChangesSaved = submittedTransitions > sortedTransitions ? submittedTransitions - sortedTransitions : 0;
+}
+
+}
+} // namespace mndl::assimp
@@ -0,0 +1,115 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+#include "cinder/gl/gl.h"
+
+#include "AssimpMesh.h"
+#include "RenderState.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+class RenderQueue;
+typedef std::shared_ptr< RenderQueue > RenderQueueRef;
+
+//! A mesh submitted to a RenderQueue, with the state it is drawn with.
+struct RenderItem
+{
+	RenderItem() :
+		mKey(0), mMesh(NULL), mTransform(0), mProgram(0),
+		mTextured(false), mMaterials(false), mSkinned(false), mGpuPalette(false)
+	{}
+
+	uint64_t mKey; /// set by RenderQueue::add()
+	AssimpMeshInstance* mMesh;
+	size_t mTransform; /// index returned by RenderQueue::addTransform()
+	GLuint mProgram;
+	bool mTextured; /// binds the mesh texture
+	bool mMaterials; /// applies the mesh material instead of its diffuse color
+	bool mSkinned; /// draws from the skinned buffers once they have been filled
+	bool mGpuPalette; /// blends the bones of the palette buffer in the vertex shader
+};
+
+//! Meshes of any number of models and instances, drawn sorted by program, texture, material and culling.
+/*! AssimpLoader::submit() adds the visible meshes of a loader, draw() sorts
+    and executes them through a RenderState. The loaders must stay alive until
+    draw() returns. The queue keeps its storage between frames. */
+class RenderQueue
+{
+	public:
+		static RenderQueueRef create()
+		{
+			return RenderQueueRef(new RenderQueue());
+		}
+
+		//! Removes the items and transforms of the last frame.
+		void clear();
+
+		//! Adds a modelview matrix for items, returns its index.
+		size_t addTransform(const ci::Matrix44f& modelView);
+		//! Adds \a item, its key is derived from its state and submission order.
+		void add(const RenderItem& item);
+
+		size_t getNumItems() const
+		{
+			return mItems.size();
+		}
+
+		//! Sorts and draws the items with the modelview matrices they were submitted with.
+		/*! \a base is the GL state when draw() is called, restored when it returns. */
+		void draw(const RenderBaseState& base = RenderBaseState());
+
+		//! Forgets the palette bindings and bone attributes looked up for programs.
+		/*! Has to be called when programs drawn by the queue are deleted, GL may reuse their names. */
+		void forgetPrograms()
+		{
+			mProgramBones.clear();
+		}
+
+		//! Returns the draw calls and state changes of the last draw().
+		const RenderStats& getStats() const
+		{
+			return mStats;
+		}
+
+	private:
+		RenderQueue() {}
+		RenderQueue(const RenderQueue&);
+		void operator=(const RenderQueue&);
+
+		static size_t countStateTransitions(const std::vector< RenderItem >& items);
+		const BoneAttribLocations& getBoneAttribs(GLuint program);
+
+		std::vector< RenderItem > mItems;
+		std::vector< ci::Matrix44f > mTransforms;
+		std::map< GLuint, BoneAttribLocations > mProgramBones; /// by program, set up on first use
+		RenderState mRenderState;
+		RenderStats mStats;
+};
+
+}
+} // namespace mndl::assimp
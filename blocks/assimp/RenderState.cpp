@@ -0,0 +1,180 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+
+#include "RenderState.h"
+
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+RenderState::RenderState() :
+	mProgram(0),
+	mModelView(NULL),
+	mCullFace(false),
+	mNormalize(false),
+	mTextureId(0),
+	mTextureEnabled(false),
+	mColorValid(false),
+	mMaterial(NULL)
+{
+}
+
+void RenderState::begin(const RenderBaseState& base)
+{
+	mBase = base;
+
+	mProgram = base.mProgram;
+	mModelView = NULL;
+	mCullFace = base.mCullFace;
+	mNormalize = base.mNormalize;
+	mTextureEnabled = base.mTextureEnabled;
+	mTextureId = base.mTextureId;
+	mColor = base.mColor;
+	mColorValid = true;
+	mMaterial = base.mMaterial;
+
+	mStats = RenderStats();
+}
+
+void RenderState::end()
+{
+	useProgram(mBase.mProgram);
+	setCullFace(mBase.mCullFace);
+	setNormalize(mBase.mNormalize);
+
+	if(mTextureId != mBase.mTextureId)
+	{
+		glBindTexture(GL_TEXTURE_2D, mBase.mTextureId);
+		mTextureId = mBase.mTextureId;
+		++mStats.mStateChanges;
+	}
+	setCap(GL_TEXTURE_2D, mBase.mTextureEnabled, &mTextureEnabled);
+
+	color(mBase.mColor);
+
+	if(mMaterial != mBase.mMaterial)
+	{
+		if(mBase.mMaterial)
+			mBase.mMaterial->apply();
+		else
+			applyDefaultMaterial();
+		mMaterial = mBase.mMaterial;
+		++mStats.mStateChanges;
+	}
+}
+
+void RenderState::applyDefaultMaterial()
+{
+	const GLfloat ambient[] = { 0.2f, 0.2f, 0.2f, 1.f };
+	const GLfloat diffuse[] = { 0.8f, 0.8f, 0.8f, 1.f };
+	const GLfloat black[] = { 0.f, 0.f, 0.f, 1.f };
+	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, black);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, black);
+	glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 0.f);
+}
+
+void RenderState::setCap(GLenum cap, bool enable, bool* current)
+{
+	if(*current == enable)
+		return;
+
+	if(enable)
+		glEnable(cap);
+	else
+		glDisable(cap);
+	*current = enable;
+	++mStats.mStateChanges;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+	if(mProgram == program)
+		return;
+
+	glUseProgram(program);
+	mProgram = program;
+	++mStats.mStateChanges;
+}
+
+void RenderState::modelView(const Matrix44f* modelView)
+{
+	if(mModelView == modelView)
+		return;
+
+	glLoadMatrixf(modelView->m);
+	mModelView = modelView;
+	++mStats.mStateChanges;
+}
+
+void RenderState::setCullFace(bool enable)
+{
+	setCap(GL_CULL_FACE, enable, &mCullFace);
+}
+
+void RenderState::setNormalize(bool enable)
+{
+	setCap(GL_NORMALIZE, enable, &mNormalize);
+}
+
+void RenderState::bindTexture(const gl::Texture& texture)
+{
+	assert(texture.getTarget() == GL_TEXTURE_2D);
+
+	setCap(GL_TEXTURE_2D, true, &mTextureEnabled);
+	if(mTextureId != texture.getId())
+	{
+		glBindTexture(GL_TEXTURE_2D, texture.getId());
+		mTextureId = texture.getId();
+		++mStats.mStateChanges;
+	}
+}
+
+void RenderState::disableTexture()
+{
+	setCap(GL_TEXTURE_2D, false, &mTextureEnabled);
+}
+
+void RenderState::color(const ColorAf& color)
+{
+	if(mColorValid && mColor.r == color.r && mColor.g == color.g && mColor.b == color.b && mColor.a == color.a)
+		return;
+
+	glColor4f(color.r, color.g, color.b, color.a);
+	mColor = color;
+	mColorValid = true;
+	++mStats.mStateChanges;
+}
+
+void RenderState::material(const gl::Material* material)
+{
+	if(mMaterial == material)
+		return;
+
+	material->apply();
+	mMaterial = material;
+	++mStats.mStateChanges;
+}
+
+}
+} // namespace mndl::assimp
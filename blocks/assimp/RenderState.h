@@ -0,0 +1,133 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Color.h"
+#include "cinder/Matrix.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Material.h"
+#include "cinder/gl/Texture.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! Draw calls and GL state changes issued by the last RenderQueue::draw().
+struct RenderStats
+{
+	RenderStats() : mDrawCalls(0), mStateChanges(0), mStateChangesSaved(0) {}
+
+	size_t mDrawCalls;
+	size_t mStateChanges;
+	size_t mStateChangesSaved; /// program, texture, material and culling changes avoided by sorting
+};
+
+//! GL state the caller knows to be current when drawing starts, restored when drawing ends.
+/*! Defaults to the initial state of GL. */
+struct RenderBaseState
+{
+	RenderBaseState() :
+		mProgram(0), mCullFace(false), mNormalize(false), mTextureEnabled(false), mTextureId(0),
+		mColor(1.f, 1.f, 1.f, 1.f), mMaterial(NULL)
+	{}
+
+	GLuint mProgram;
+	bool mCullFace;
+	bool mNormalize;
+	bool mTextureEnabled; /// GL_TEXTURE_2D of the active unit
+	GLuint mTextureId; /// GL_TEXTURE_2D binding of the active unit
+	ci::ColorAf mColor;
+	const ci::gl::Material* mMaterial; /// NULL for the default material of GL
+};
+
+//! Shadow copy of the GL state changed while drawing meshes, passing only actual changes on to GL.
+/*! begin() takes the current state from the caller and end() restores it,
+    replacing a full glPushAttrib()/glPopAttrib() without querying GL. In
+    between, the tracked state must only be changed through the tracker. The
+    modelview matrix is not restored, the caller pushes and pops it around
+    begin() and end(). */
+class RenderState
+{
+	public:
+		RenderState();
+
+		//! Starts tracking from \a base, which has to match the current GL state, and resets the stats.
+		void begin(const RenderBaseState& base);
+		//! Restores the state passed to begin().
+		void end();
+
+		//! Makes \a program current, 0 for the fixed function pipeline.
+		void useProgram(GLuint program);
+		//! Loads \a modelView unless it was the last one loaded.
+		void modelView(const ci::Matrix44f* modelView);
+
+		//! Enables or disables GL_CULL_FACE.
+		void setCullFace(bool enable);
+		//! Enables or disables GL_NORMALIZE.
+		void setNormalize(bool enable);
+
+		//! Enables GL_TEXTURE_2D on the active unit and binds \a texture, a 2D texture as loaded by AssimpModel.
+		void bindTexture(const ci::gl::Texture& texture);
+		//! Disables GL_TEXTURE_2D on the active unit.
+		void disableTexture();
+
+		void color(const ci::ColorAf& color);
+		//! Forgets the current color, after drawing with a color array.
+		void invalidateColor()
+		{
+			mColorValid = false;
+		}
+		//! Applies \a material unless it was the last one applied.
+		void material(const ci::gl::Material* material);
+
+		void countDrawCall()
+		{
+			++mStats.mDrawCalls;
+		}
+
+		const RenderStats& getStats() const
+		{
+			return mStats;
+		}
+
+	private:
+		void setCap(GLenum cap, bool enable, bool* current);
+		static void applyDefaultMaterial();
+
+		RenderBaseState mBase;
+
+		GLuint mProgram;
+		const ci::Matrix44f* mModelView;
+
+		bool mCullFace;
+		bool mNormalize;
+
+		GLuint mTextureId; /// GL_TEXTURE_2D binding of the active unit
+		bool mTextureEnabled;
+
+		ci::ColorAf mColor;
+		bool mColorValid;
+		const ci::gl::Material* mMaterial; /// NULL for the default material of GL
+
+		RenderStats mStats;
+};
+
+}
+} // namespace mndl::assimp
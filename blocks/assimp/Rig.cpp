@@ -0,0 +1,324 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+
+#include "cinder/Matrix.h"
+
+#include "AssimpLoader.h"
+#include "Rig.h"
+
+using namespace std;
+using namespace ci;
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! Number of instances evaluated by one PoseBatch task.
+static const size_t kPoseTaskSize = 16;
+
+//! Returns the last key not after \a ticks, or the first key if all of them are.
+template< typename KeyT >
+static size_t findKey(const vector< KeyT >& keys, double ticks)
+{
+	size_t lo = 0;
+	size_t hi = keys.size() - 1;
+	while(lo < hi)
+	{
+		size_t mid = (lo + hi + 1) / 2;
+		if(keys[ mid ].mTime <= ticks)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+//! Returns the interpolation factor between \a key and \a nextKey, 0 if they coincide.
+template< typename KeyT >
+static float keyFactor(const KeyT& key, const KeyT& nextKey, double ticks, double duration)
+{
+	double diffTime = nextKey.mTime - key.mTime;
+	if(diffTime < 0.0)
+		diffTime += duration;
+	if(diffTime > 0)
+		return float((ticks - key.mTime) / diffTime);
+	return 0.f;
+}
+
+AnimationClip::AnimationClip(const aiAnimation* anim, const Rig& rig) :
+	mName(fromAssimp(anim->mName)),
+	mDuration(anim->mDuration),
+	mTicksPerSecond(anim->mTicksPerSecond != 0.0 ? anim->mTicksPerSecond : 1.0)
+{
+	mChannels.resize(anim->mNumChannels);
+	for(unsigned a = 0; a < anim->mNumChannels; ++a)
+	{
+		const aiNodeAnim* nodeAnim = anim->mChannels[ a ];
+		Channel& channel = mChannels[ a ];
+
+		channel.mNode = rig.findNode(fromAssimp(nodeAnim->mNodeName));
+		channel.mPositionKeys.assign(nodeAnim->mPositionKeys,
+		                             nodeAnim->mPositionKeys + nodeAnim->mNumPositionKeys);
+		channel.mRotationKeys.assign(nodeAnim->mRotationKeys,
+		                             nodeAnim->mRotationKeys + nodeAnim->mNumRotationKeys);
+		channel.mScalingKeys.assign(nodeAnim->mScalingKeys,
+		                            nodeAnim->mScalingKeys + nodeAnim->mNumScalingKeys);
+	}
+}
+
+void AnimationClip::sampleChannel(size_t channelIndex, double ticks,
+                                  aiVector3D* position, aiQuaternion* rotation, aiVector3D* scaling) const
+{
+	const Channel& channel = mChannels[ channelIndex ];
+
+	*position = aiVector3D(0, 0, 0);
+	if(!channel.mPositionKeys.empty())
+	{
+		// interpolate between this frame's value and next frame's value
+		size_t frame = findKey(channel.mPositionKeys, ticks);
+		size_t nextFrame = (frame + 1) % channel.mPositionKeys.size();
+		const aiVectorKey& key = channel.mPositionKeys[ frame ];
+		const aiVectorKey& nextKey = channel.mPositionKeys[ nextFrame ];
+		float factor = keyFactor(key, nextKey, ticks, mDuration);
+		*position = key.mValue + (nextKey.mValue - key.mValue) * factor;
+	}
+
+	*rotation = aiQuaternion(1, 0, 0, 0);
+	if(!channel.mRotationKeys.empty())
+	{
+		size_t frame = findKey(channel.mRotationKeys, ticks);
+		size_t nextFrame = (frame + 1) % channel.mRotationKeys.size();
+		const aiQuatKey& key = channel.mRotationKeys[ frame ];
+		const aiQuatKey& nextKey = channel.mRotationKeys[ nextFrame ];
+		float factor = keyFactor(key, nextKey, ticks, mDuration);
+		aiQuaternion::Interpolate(*rotation, key.mValue, nextKey.mValue, factor);
+	}
+
+	*scaling = aiVector3D(1, 1, 1);
+	if(!channel.mScalingKeys.empty())
+	{
+		// TODO: (thom) interpolation maybe? This time maybe even logarithmic, not linear
+		*scaling = channel.mScalingKeys[ findKey(channel.mScalingKeys, ticks) ].mValue;
+	}
+}
+
+void Rig::Pose::resize(size_t numNodes)
+{
+	mPositions.resize(numNodes);
+	mOrientations.resize(numNodes);
+	mScales.resize(numNodes);
+	mTransforms.resize(numNodes);
+}
+
+Rig::Rig(const aiScene* scene) :
+	mPaletteSize(0)
+{
+	addNodes(scene->mRootNode, kInvalidNode);
+
+	// bones of every skinned mesh followed by an identity entry
+	mPaletteOffsets.resize(scene->mNumMeshes, kInvalidNode);
+	for(unsigned i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* mesh = scene->mMeshes[ i ];
+		if(!mesh->HasBones())
+			continue;
+
+		mPaletteOffsets[ i ] = mBones.size();
+		for(unsigned a = 0; a < mesh->mNumBones; ++a)
+		{
+			const aiBone* bone = mesh->mBones[ a ];
+			size_t node = findNode(fromAssimp(bone->mName));
+			if(node == kInvalidNode)
+				throw AssimpLoaderExc("bone " + fromAssimp(bone->mName) + " of mesh " +
+				                      fromAssimp(mesh->mName) + " not found.");
+
+			Bone b;
+			b.mNode = node;
+			toSkinMatrix(bone->mOffsetMatrix, &b.mOffset);
+			mBones.push_back(b);
+			mNodes[ node ].mIsBone = true;
+		}
+
+		Bone identity;
+		identity.mNode = kInvalidNode;
+		setSkinMatrixIdentity(&identity.mOffset);
+		mBones.push_back(identity);
+	}
+	mPaletteSize = mBones.size();
+
+	for(unsigned i = 0; i < scene->mNumAnimations; ++i)
+	{
+		mClips.push_back(AnimationClip::create(scene->mAnimations[ i ], *this));
+	}
+}
+
+void Rig::addNodes(const aiNode* nd, size_t parent)
+{
+	NodeData node;
+	node.mName = fromAssimp(nd->mName);
+	node.mParent = parent;
+	node.mIsBone = false;
+
+	aiVector3D scaling;
+	aiQuaternion rotation;
+	aiVector3D position;
+	nd->mTransformation.Decompose(scaling, rotation, position);
+	node.mScale = fromAssimp(scaling);
+	node.mOrientation = fromAssimp(rotation);
+	node.mPosition = fromAssimp(position);
+
+	// later nodes of the same name win, as in AssimpLoader
+	size_t index = mNodes.size();
+	mNodes.push_back(node);
+	mNodeMap[ node.mName ] = index;
+
+	for(unsigned n = 0; n < nd->mNumChildren; ++n)
+	{
+		addNodes(nd->mChildren[ n ], index);
+	}
+}
+
+size_t Rig::findNode(const string& name) const
+{
+	map< string, size_t >::const_iterator it = mNodeMap.find(name);
+	if(it == mNodeMap.end())
+		return kInvalidNode;
+	return it->second;
+}
+
+void Rig::evaluate(size_t clip, double time, SkinMatrix* palette) const
+{
+	Pose pose;
+	pose.resize(mNodes.size());
+	evaluate(clip, time, &pose, palette);
+}
+
+void Rig::evaluate(size_t clipIndex, double time, Pose* pose, SkinMatrix* palette) const
+{
+	const size_t numNodes = mNodes.size();
+	for(size_t i = 0; i < numNodes; ++i)
+	{
+		pose->mPositions[ i ] = mNodes[ i ].mPosition;
+		pose->mOrientations[ i ] = mNodes[ i ].mOrientation;
+		pose->mScales[ i ] = mNodes[ i ].mScale;
+	}
+
+	// an unknown clip leaves the rest pose
+	if(clipIndex < mClips.size())
+	{
+		const AnimationClip& clip = *mClips[ clipIndex ];
+		double ticks = time * clip.getTicksPerSecond();
+		for(size_t a = 0; a < clip.getNumChannels(); ++a)
+		{
+			size_t node = clip.getChannelNode(a);
+			if(node == kInvalidNode)
+				continue;
+
+			aiVector3D position;
+			aiQuaternion rotation;
+			aiVector3D scaling;
+			clip.sampleChannel(a, ticks, &position, &rotation, &scaling);
+			pose->mPositions[ node ] = fromAssimp(position);
+			pose->mOrientations[ node ] = fromAssimp(rotation);
+			pose->mScales[ node ] = fromAssimp(scaling);
+		}
+	}
+
+	// parents precede their children, local transforms become derived ones in place,
+	// combined the same way as in mndl::Node
+	for(size_t i = 0; i < numNodes; ++i)
+	{
+		size_t parent = mNodes[ i ].mParent;
+		if(parent != kInvalidNode)
+		{
+			const Quatf& parentOrientation = pose->mOrientations[ parent ];
+			const Vec3f& parentScale = pose->mScales[ parent ];
+			pose->mOrientations[ i ] = pose->mOrientations[ i ] * parentOrientation;
+			pose->mScales[ i ] = parentScale * pose->mScales[ i ];
+			pose->mPositions[ i ] = (parentScale * pose->mPositions[ i ]) * parentOrientation;
+			pose->mPositions[ i ] += pose->mPositions[ parent ];
+		}
+
+		if(mNodes[ i ].mIsBone)
+		{
+			Matrix44f transform = Matrix44f::createScale(pose->mScales[ i ]);
+			transform *= pose->mOrientations[ i ].toMatrix44();
+			transform.setTranslate(pose->mPositions[ i ]);
+			toSkinMatrix(toAssimp(transform), &pose->mTransforms[ i ]);
+		}
+	}
+
+	for(size_t b = 0; b < mPaletteSize; ++b)
+	{
+		const Bone& bone = mBones[ b ];
+		if(bone.mNode == kInvalidNode)
+			palette[ b ] = bone.mOffset;
+		else
+			multiplySkinMatrices(pose->mTransforms[ bone.mNode ], bone.mOffset, &palette[ b ]);
+	}
+}
+
+PoseBatch::PoseBatch(RigRef rig, WorkerPoolRef pool) :
+	mRigRef(rig),
+	mWorkerPoolRef(pool),
+	mStates(NULL),
+	mCount(0),
+	mPalettes(NULL)
+{
+	if(!mWorkerPoolRef)
+		mWorkerPoolRef = WorkerPool::create(0);
+}
+
+void PoseBatch::evaluate(const AnimationState* states, size_t count, SkinMatrix* palettes)
+{
+	size_t numTasks = (count + kPoseTaskSize - 1) / kPoseTaskSize;
+	if(mPoses.size() < numTasks)
+	{
+		size_t first = mPoses.size();
+		mPoses.resize(numTasks);
+		for(size_t i = first; i < numTasks; ++i)
+			mPoses[ i ].resize(mRigRef->getNumNodes());
+	}
+
+	mStates = states;
+	mCount = count;
+	mPalettes = palettes;
+
+	mJob.set(&PoseBatch::runTask, this, numTasks);
+	mWorkerPoolRef->run(mJob);
+}
+
+void PoseBatch::runTask(void* context, size_t task)
+{
+	PoseBatch* batch = static_cast< PoseBatch* >(context);
+	const Rig& rig = *batch->mRigRef;
+	const size_t paletteSize = rig.getPaletteSize();
+
+	size_t begin = task * kPoseTaskSize;
+	size_t end = std::min(begin + kPoseTaskSize, batch->mCount);
+	for(size_t i = begin; i < end; ++i)
+	{
+		const AnimationState& state = batch->mStates[ i ];
+		rig.evaluate(state.mClip, state.mTime, &batch->mPoses[ task ], batch->mPalettes + i * paletteSize);
+	}
+}
+
+}
+} // namespace mndl::assimp
@@ -0,0 +1,254 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "assimp/anim.h"
+#include "assimp/scene.h"
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+#include "cinder/Quaternion.h"
+
+#include "Skinning.h"
+#include "WorkerPool.h"
+
+namespace mndl
+{
+namespace assimp
+{
+
+class Rig;
+class AnimationClip;
+class PoseBatch;
+
+typedef std::shared_ptr< const Rig > RigRef;
+typedef std::shared_ptr< const AnimationClip > AnimationClipRef;
+typedef std::shared_ptr< PoseBatch > PoseBatchRef;
+
+//! Keyframes of one aiAnimation, copied out of the scene and bound to the nodes of a Rig.
+class AnimationClip
+{
+	public:
+		static AnimationClipRef create(const aiAnimation* anim, const Rig& rig)
+		{
+			return AnimationClipRef(new AnimationClip(anim, rig));
+		}
+
+		const std::string& getName() const
+		{
+			return mName;
+		}
+
+		//! Returns the duration in seconds.
+		double getDuration() const
+		{
+			return mDuration / mTicksPerSecond;
+		}
+
+		double getTicksPerSecond() const
+		{
+			return mTicksPerSecond;
+		}
+
+		size_t getNumChannels() const
+		{
+			return mChannels.size();
+		}
+
+		//! Returns the rig node animated by \a channel, Rig::kInvalidNode if the rig has no such node.
+		size_t getChannelNode(size_t channel) const
+		{
+			return mChannels[ channel ].mNode;
+		}
+
+		//! Samples \a channel at \a ticks. Values without keys are left untouched.
+		void sampleChannel(size_t channel, double ticks,
+		                   aiVector3D* position, aiQuaternion* rotation, aiVector3D* scaling) const;
+
+	private:
+		AnimationClip(const aiAnimation* anim, const Rig& rig);
+		AnimationClip(const AnimationClip&);
+		void operator=(const AnimationClip&);
+
+		struct Channel
+		{
+			size_t mNode;
+			std::vector< aiVectorKey > mPositionKeys;
+			std::vector< aiQuatKey > mRotationKeys;
+			std::vector< aiVectorKey > mScalingKeys;
+		};
+
+		std::string mName;
+		double mDuration; /// in ticks
+		double mTicksPerSecond;
+		std::vector< Channel > mChannels;
+};
+
+//! Clip and time of one instance in a PoseBatch.
+struct AnimationState
+{
+	AnimationState() : mClip(0), mTime(0.0) {}
+	AnimationState(size_t clip, double time) : mClip(clip), mTime(time) {}
+
+	size_t mClip;
+	double mTime; /// in seconds
+};
+
+//! Immutable node hierarchy, bone bindings and animation clips of a scene.
+/*! Nodes are flattened in depth-first order, so every parent precedes its
+    children. The bone palettes of all skinned meshes are concatenated into
+    one palette of getPaletteSize() entries, each mesh palette ending with an
+    identity entry as expected by skinVertices(). */
+class Rig
+{
+	public:
+		static const size_t kInvalidNode = ~size_t(0);
+
+		static RigRef create(const aiScene* scene)
+		{
+			return RigRef(new Rig(scene));
+		}
+
+		size_t getNumNodes() const
+		{
+			return mNodes.size();
+		}
+		const std::string& getNodeName(size_t node) const
+		{
+			return mNodes[ node ].mName;
+		}
+		//! Returns the parent of \a node, kInvalidNode for the root.
+		size_t getNodeParent(size_t node) const
+		{
+			return mNodes[ node ].mParent;
+		}
+		//! Returns the node called \a name, kInvalidNode if there is none.
+		size_t findNode(const std::string& name) const;
+
+		size_t getNumClips() const
+		{
+			return mClips.size();
+		}
+		const AnimationClipRef& getClip(size_t clip) const
+		{
+			return mClips[ clip ];
+		}
+
+		//! Returns the number of matrices in a palette of all skinned meshes.
+		size_t getPaletteSize() const
+		{
+			return mPaletteSize;
+		}
+		//! Returns the offset of the palette of scene mesh \a mesh, kInvalidNode if it has no bones.
+		size_t getPaletteOffset(size_t mesh) const
+		{
+			return mPaletteOffsets[ mesh ];
+		}
+
+		//! Writes the palette of \a clip at \a time into getPaletteSize() matrices at \a palette.
+		void evaluate(size_t clip, double time, SkinMatrix* palette) const;
+
+	private:
+		Rig(const aiScene* scene);
+		Rig(const Rig&);
+		void operator=(const Rig&);
+
+		friend class PoseBatch;
+
+		void addNodes(const aiNode* nd, size_t parent);
+
+		struct NodeData
+		{
+			std::string mName;
+			size_t mParent;
+			ci::Vec3f mPosition;
+			ci::Quatf mOrientation;
+			ci::Vec3f mScale;
+			bool mIsBone; /// the derived transform is needed for the palette
+		};
+
+		struct Bone
+		{
+			size_t mNode;
+			SkinMatrix mOffset;
+		};
+
+		//! Per node scratch space of one evaluation.
+		struct Pose
+		{
+			std::vector< ci::Vec3f > mPositions;
+			std::vector< ci::Quatf > mOrientations;
+			std::vector< ci::Vec3f > mScales;
+			std::vector< SkinMatrix > mTransforms;
+
+			void resize(size_t numNodes);
+		};
+
+		void evaluate(size_t clip, double time, Pose* pose, SkinMatrix* palette) const;
+
+		std::vector< NodeData > mNodes;
+		std::map< std::string, size_t > mNodeMap;
+		std::vector< AnimationClipRef > mClips;
+
+		std::vector< Bone > mBones; /// palette entries, kInvalidNode nodes mark the identity entries
+		std::vector< size_t > mPaletteOffsets;
+		size_t mPaletteSize;
+};
+
+//! Evaluates the palettes of many independently timed instances of a Rig in parallel.
+/*! The batch keeps its job and scratch space between calls, so evaluating a
+    crowd of the same or fewer instances than before does not allocate. */
+class PoseBatch
+{
+	public:
+		static PoseBatchRef create(RigRef rig, WorkerPoolRef pool = WorkerPoolRef())
+		{
+			return PoseBatchRef(new PoseBatch(rig, pool));
+		}
+
+		const RigRef& getRig() const
+		{
+			return mRigRef;
+		}
+
+		//! Writes \a count palettes of Rig::getPaletteSize() matrices each, one after the other, to \a palettes.
+		void evaluate(const AnimationState* states, size_t count, SkinMatrix* palettes);
+
+	private:
+		PoseBatch(RigRef rig, WorkerPoolRef pool);
+		PoseBatch(const PoseBatch&);
+		void operator=(const PoseBatch&);
+
+		static void runTask(void* context, size_t task);
+
+		RigRef mRigRef;
+		WorkerPoolRef mWorkerPoolRef;
+		WorkerJob mJob;
+
+		std::vector< Rig::Pose > mPoses; /// one per task
+		const AnimationState* mStates;
+		size_t mCount;
+		SkinMatrix* mPalettes;
+};
+
+}
+} // namespace mndl::assimp
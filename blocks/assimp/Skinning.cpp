@@ -0,0 +1,318 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Skinning.h"
+
+#if !defined(MNDL_SKINNING_NO_SIMD)
+#if defined(__AVX__)
+#define MNDL_SKINNING_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MNDL_SKINNING_SSE
+#include <emmintrin.h>
+#endif
+#endif
+
+using namespace std;
+
+namespace mndl
+{
+namespace assimp
+{
+
+static const size_t kMaxInfluences = MNDL_SKINNING_MAX_INFLUENCES;
+
+void SkinData::build(const aiMesh* mesh)
+{
+	mNumVertices = mesh->mNumVertices;
+	mNumBones = mesh->mNumBones;
+
+	mPositions.resize(mNumVertices * 4);
+	for(size_t v = 0; v < mNumVertices; ++v)
+	{
+		mPositions[ v * 4 + 0 ] = mesh->mVertices[ v ].x;
+		mPositions[ v * 4 + 1 ] = mesh->mVertices[ v ].y;
+		mPositions[ v * 4 + 2 ] = mesh->mVertices[ v ].z;
+		mPositions[ v * 4 + 3 ] = 1.0f;
+	}
+
+	mNormals.clear();
+	if(mesh->HasNormals())
+	{
+		mNormals.resize(mNumVertices * 4);
+		for(size_t v = 0; v < mNumVertices; ++v)
+		{
+			mNormals[ v * 4 + 0 ] = mesh->mNormals[ v ].x;
+			mNormals[ v * 4 + 1 ] = mesh->mNormals[ v ].y;
+			mNormals[ v * 4 + 2 ] = mesh->mNormals[ v ].z;
+			mNormals[ v * 4 + 3 ] = 0.0f;
+		}
+	}
+
+	// unused slots point at the identity entry past the last bone
+	mBoneIndices.assign(mNumVertices * kMaxInfluences, uint16_t(mNumBones));
+	mBoneWeights.assign(mNumVertices * kMaxInfluences, 0.0f);
+
+	// scatter the bone-major weights into per vertex slots, sorted by weight
+	for(unsigned a = 0; a < mesh->mNumBones; ++a)
+	{
+		const aiBone* bone = mesh->mBones[ a ];
+		for(unsigned b = 0; b < bone->mNumWeights; ++b)
+		{
+			const aiVertexWeight& weight = bone->mWeights[ b ];
+			if(weight.mVertexId >= mNumVertices || weight.mWeight <= 0.0f)
+				continue;
+
+			uint16_t* indices = &mBoneIndices[ weight.mVertexId * kMaxInfluences ];
+			float* weights = &mBoneWeights[ weight.mVertexId * kMaxInfluences ];
+
+			size_t k = kMaxInfluences;
+			while(k > 0 && weights[ k - 1 ] < weight.mWeight)
+			{
+				if(k < kMaxInfluences)
+				{
+					weights[ k ] = weights[ k - 1 ];
+					indices[ k ] = indices[ k - 1 ];
+				}
+				--k;
+			}
+
+			if(k < kMaxInfluences)
+			{
+				weights[ k ] = weight.mWeight;
+				indices[ k ] = uint16_t(a);
+			}
+		}
+	}
+
+	for(size_t v = 0; v < mNumVertices; ++v)
+	{
+		uint16_t* indices = &mBoneIndices[ v * kMaxInfluences ];
+		float* weights = &mBoneWeights[ v * kMaxInfluences ];
+
+		float sum = 0.0f;
+		for(size_t k = 0; k < kMaxInfluences; ++k)
+			sum += weights[ k ];
+
+		if(sum > 0.0f)
+		{
+			for(size_t k = 0; k < kMaxInfluences; ++k)
+				weights[ k ] /= sum;
+		}
+		else
+		{
+			// vertices without weights keep their rest pose
+			indices[ 0 ] = uint16_t(mNumBones);
+			weights[ 0 ] = 1.0f;
+		}
+	}
+
+	// rest bounds of the vertices each palette entry moves, skinned bounds are derived from these
+	mBoneBounds.resize(getPaletteSize() * 6);
+	for(size_t b = 0; b < getPaletteSize(); ++b)
+	{
+		float* bounds = &mBoneBounds[ b * 6 ];
+		bounds[ 0 ] = bounds[ 1 ] = bounds[ 2 ] = numeric_limits< float >::max();
+		bounds[ 3 ] = bounds[ 4 ] = bounds[ 5 ] = -numeric_limits< float >::max();
+	}
+	for(size_t v = 0; v < mNumVertices; ++v)
+	{
+		const float* p = &mPositions[ v * 4 ];
+		for(size_t k = 0; k < kMaxInfluences; ++k)
+		{
+			if(mBoneWeights[ v * kMaxInfluences + k ] <= 0.0f)
+				continue;
+
+			float* bounds = &mBoneBounds[ mBoneIndices[ v * kMaxInfluences + k ] * 6 ];
+			for(int c = 0; c < 3; ++c)
+			{
+				bounds[ c ] = min(bounds[ c ], p[ c ]);
+				bounds[ 3 + c ] = max(bounds[ 3 + c ], p[ c ]);
+			}
+		}
+	}
+}
+
+bool calculateSkinnedBounds(const SkinMatrix* palette, const SkinData& skin, float* outMin, float* outMax)
+{
+	bool empty = true;
+	for(size_t b = 0; b < skin.getPaletteSize(); ++b)
+	{
+		const float* bounds = &skin.mBoneBounds[ b * 6 ];
+		if(bounds[ 0 ] > bounds[ 3 ])
+			continue;
+
+		// transform the box as center and half extent, the extent by the absolute matrix
+		const float* m = palette[ b ].m;
+		float center[ 3 ], extent[ 3 ];
+		for(int c = 0; c < 3; ++c)
+		{
+			center[ c ] = (bounds[ c ] + bounds[ 3 + c ]) * 0.5f;
+			extent[ c ] = (bounds[ 3 + c ] - bounds[ c ]) * 0.5f;
+		}
+
+		for(int r = 0; r < 3; ++r)
+		{
+			const float* row = &m[ r * 4 ];
+			float c = row[ 0 ] * center[ 0 ] + row[ 1 ] * center[ 1 ] + row[ 2 ] * center[ 2 ] + row[ 3 ];
+			float e = fabs(row[ 0 ]) * extent[ 0 ] + fabs(row[ 1 ]) * extent[ 1 ] + fabs(row[ 2 ]) * extent[ 2 ];
+			if(empty)
+			{
+				outMin[ r ] = c - e;
+				outMax[ r ] = c + e;
+			}
+			else
+			{
+				outMin[ r ] = min(outMin[ r ], c - e);
+				outMax[ r ] = max(outMax[ r ], c + e);
+			}
+		}
+		empty = false;
+	}
+	return !empty;
+}
+
+#if defined(MNDL_SKINNING_AVX) || defined(MNDL_SKINNING_SSE)
+
+// returns ( r0.p, r1.p, r2.p, 0 )
+static inline __m128 transform(__m128 r0, __m128 r1, __m128 r2, __m128 p)
+{
+	__m128 x = _mm_mul_ps(r0, p);
+	__m128 y = _mm_mul_ps(r1, p);
+	__m128 z = _mm_mul_ps(r2, p);
+	__m128 w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	return _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
+}
+
+static inline void storeVec3(float* dst, __m128 v)
+{
+	_mm_storel_pi(reinterpret_cast< __m64* >(dst), v);
+	_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+void skinVertices(const SkinMatrix* palette, const SkinData& skin, size_t begin, size_t end,
+                  float* outPos, float* outNorm, size_t outStride)
+{
+	const bool hasNormals = outNorm && !skin.mNormals.empty();
+
+	for(size_t v = begin; v < end; ++v)
+	{
+		const uint16_t* indices = &skin.mBoneIndices[ v * kMaxInfluences ];
+		const float* weights = &skin.mBoneWeights[ v * kMaxInfluences ];
+
+		// blend the bone matrices, every vertex has at least one weight
+#if defined(MNDL_SKINNING_AVX)
+		const float* m = palette[ indices[ 0 ] ].m;
+		__m256 w8 = _mm256_set1_ps(weights[ 0 ]);
+		__m256 r01 = _mm256_mul_ps(w8, _mm256_loadu_ps(m));
+		__m128 r2 = _mm_mul_ps(_mm256_castps256_ps128(w8), _mm_loadu_ps(m + 8));
+		for(size_t k = 1; k < kMaxInfluences && weights[ k ] > 0.0f; ++k)
+		{
+			m = palette[ indices[ k ] ].m;
+			w8 = _mm256_set1_ps(weights[ k ]);
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(w8, _mm256_loadu_ps(m)));
+			r2 = _mm_add_ps(r2, _mm_mul_ps(_mm256_castps256_ps128(w8), _mm_loadu_ps(m + 8)));
+		}
+		__m128 r0 = _mm256_castps256_ps128(r01);
+		__m128 r1 = _mm256_extractf128_ps(r01, 1);
+#else
+		const float* m = palette[ indices[ 0 ] ].m;
+		__m128 w4 = _mm_set1_ps(weights[ 0 ]);
+		__m128 r0 = _mm_mul_ps(w4, _mm_loadu_ps(m));
+		__m128 r1 = _mm_mul_ps(w4, _mm_loadu_ps(m + 4));
+		__m128 r2 = _mm_mul_ps(w4, _mm_loadu_ps(m + 8));
+		for(size_t k = 1; k < kMaxInfluences && weights[ k ] > 0.0f; ++k)
+		{
+			m = palette[ indices[ k ] ].m;
+			w4 = _mm_set1_ps(weights[ k ]);
+			r0 = _mm_add_ps(r0, _mm_mul_ps(w4, _mm_loadu_ps(m)));
+			r1 = _mm_add_ps(r1, _mm_mul_ps(w4, _mm_loadu_ps(m + 4)));
+			r2 = _mm_add_ps(r2, _mm_mul_ps(w4, _mm_loadu_ps(m + 8)));
+		}
+#endif
+
+		// positions have w = 1 and pick up the translation, normals have w = 0
+		storeVec3(outPos + v * outStride,
+		          transform(r0, r1, r2, _mm_loadu_ps(&skin.mPositions[ v * 4 ])));
+		if(hasNormals)
+		{
+			storeVec3(outNorm + v * outStride,
+			          transform(r0, r1, r2, _mm_loadu_ps(&skin.mNormals[ v * 4 ])));
+		}
+	}
+}
+
+#else
+
+void skinVertices(const SkinMatrix* palette, const SkinData& skin, size_t begin, size_t end,
+                  float* outPos, float* outNorm, size_t outStride)
+{
+	const bool hasNormals = outNorm && !skin.mNormals.empty();
+
+	for(size_t v = begin; v < end; ++v)
+	{
+		const uint16_t* indices = &skin.mBoneIndices[ v * kMaxInfluences ];
+		const float* weights = &skin.mBoneWeights[ v * kMaxInfluences ];
+
+		float r[ 12 ];
+		const float* m = palette[ indices[ 0 ] ].m;
+		for(int i = 0; i < 12; ++i)
+			r[ i ] = weights[ 0 ] * m[ i ];
+		for(size_t k = 1; k < kMaxInfluences && weights[ k ] > 0.0f; ++k)
+		{
+			m = palette[ indices[ k ] ].m;
+			for(int i = 0; i < 12; ++i)
+				r[ i ] += weights[ k ] * m[ i ];
+		}
+
+		const float* p = &skin.mPositions[ v * 4 ];
+		float* dst = outPos + v * outStride;
+		dst[ 0 ] = r[ 0 ] * p[ 0 ] + r[ 1 ] * p[ 1 ] + r[ 2 ] * p[ 2 ] + r[ 3 ];
+		dst[ 1 ] = r[ 4 ] * p[ 0 ] + r[ 5 ] * p[ 1 ] + r[ 6 ] * p[ 2 ] + r[ 7 ];
+		dst[ 2 ] = r[ 8 ] * p[ 0 ] + r[ 9 ] * p[ 1 ] + r[ 10 ] * p[ 2 ] + r[ 11 ];
+
+		if(hasNormals)
+		{
+			const float* n = &skin.mNormals[ v * 4 ];
+			dst = outNorm + v * outStride;
+			dst[ 0 ] = r[ 0 ] * n[ 0 ] + r[ 1 ] * n[ 1 ] + r[ 2 ] * n[ 2 ];
+			dst[ 1 ] = r[ 4 ] * n[ 0 ] + r[ 5 ] * n[ 1 ] + r[ 6 ] * n[ 2 ];
+			dst[ 2 ] = r[ 8 ] * n[ 0 ] + r[ 9 ] * n[ 1 ] + r[ 10 ] * n[ 2 ];
+		}
+	}
+}
+
+#endif
+
+const char* getSkinningKernelName()
+{
+#if defined(MNDL_SKINNING_AVX)
+	return "AVX";
+#elif defined(MNDL_SKINNING_SSE)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+}
+} // namespace mndl::assimp
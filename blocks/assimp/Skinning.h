@@ -0,0 +1,130 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "assimp/mesh.h"
+
+//! Maximum number of bone influences kept per vertex, either 4 or 8.
+#ifndef MNDL_SKINNING_MAX_INFLUENCES
+#define MNDL_SKINNING_MAX_INFLUENCES 4
+#endif
+
+namespace mndl
+{
+namespace assimp
+{
+
+//! Affine bone transform, the upper three rows of an aiMatrix4x4.
+struct SkinMatrix
+{
+	float m[ 12 ];
+};
+
+inline void toSkinMatrix(const aiMatrix4x4& src, SkinMatrix* dst)
+{
+	const float* s = &src.a1;
+	for(int i = 0; i < 12; ++i)
+		dst->m[ i ] = s[ i ];
+}
+
+inline void setSkinMatrixIdentity(SkinMatrix* dst)
+{
+	for(int i = 0; i < 12; ++i)
+		dst->m[ i ] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+//! Sets \a dst to \a a * \a b, treating both as affine 4x4 matrices. \a dst must not alias \a a or \a b.
+inline void multiplySkinMatrices(const SkinMatrix& a, const SkinMatrix& b, SkinMatrix* dst)
+{
+	for(int r = 0; r < 3; ++r)
+	{
+		const float* ar = &a.m[ r * 4 ];
+		for(int c = 0; c < 4; ++c)
+		{
+			dst->m[ r * 4 + c ] = ar[ 0 ] * b.m[ c ] + ar[ 1 ] * b.m[ 4 + c ] + ar[ 2 ] * b.m[ 8 + c ];
+		}
+		dst->m[ r * 4 + 3 ] += ar[ 3 ];
+	}
+}
+
+//! Returns a 64-bit FNV-1a hash of \a count palette entries, used to detect unchanged poses.
+inline uint64_t hashSkinMatrices(const SkinMatrix* palette, size_t count)
+{
+	const unsigned char* bytes = reinterpret_cast< const unsigned char* >(palette);
+	const size_t size = count * sizeof(SkinMatrix);
+
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[ i ];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//! Vertex-major skinning data, converted from the bone-major aiBone weights at load time.
+class SkinData
+{
+	public:
+		SkinData() : mNumVertices(0), mNumBones(0) {}
+
+		//! Packs the strongest MNDL_SKINNING_MAX_INFLUENCES weights of every vertex in \a mesh.
+		void build(const aiMesh* mesh);
+
+		bool empty() const
+		{
+			return mNumVertices == 0;
+		}
+
+		//! Returns the number of palette entries the kernel expects, the last one is the identity.
+		size_t getPaletteSize() const
+		{
+			return mNumBones + 1;
+		}
+
+		size_t mNumVertices;
+		size_t mNumBones;
+
+		std::vector< float > mPositions; /// x, y, z, 1 per vertex
+		std::vector< float > mNormals; /// x, y, z, 0 per vertex, empty if the mesh has no normals
+
+		std::vector< uint16_t > mBoneIndices; /// MNDL_SKINNING_MAX_INFLUENCES per vertex
+		std::vector< float > mBoneWeights; /// sorted descending, zero padded, normalized
+		std::vector< float > mBoneBounds; /// rest pose min x, y, z and max x, y, z of the vertices of every palette entry, min > max if none
+};
+
+//! Skins vertices [\a begin, \a end) of \a skin with \a palette in a single pass.
+/*! Positions and normals are written to \a outPos and \a outNorm, which point at
+    vertex 0 and advance \a outStride floats per vertex. \a outNorm may be NULL. */
+void skinVertices(const SkinMatrix* palette, const SkinData& skin, size_t begin, size_t end,
+                  float* outPos, float* outNorm, size_t outStride);
+
+//! Calculates the bounds of \a skin skinned with \a palette from its bone bounds, without touching the vertices.
+/*! Every skinned vertex is a weighted average of its rest position transformed
+    by its bones, so the union of the transformed bone bounds contains it.
+    Returns false if the mesh has no vertices. */
+bool calculateSkinnedBounds(const SkinMatrix* palette, const SkinData& skin, float* outMin, float* outMax);
+
+//! Returns the name of the kernel compiled into skinVertices, "AVX", "SSE2" or "scalar".
+const char* getSkinningKernelName();
+
+}
+} // namespace mndl::assimp
@@ -0,0 +1,86 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef MNDL_HEADLESS
+#include <chrono>
+#else
+#include "cinder/Timer.h"
+#endif
+
+namespace mndl
+{
+
+//! Measures the load, skinning and benchmark times of the loader.
+/*! ci::Timer needs the platform layer of Cinder, headless builds use the
+    steady clock of the standard library instead. */
+class Stopwatch
+{
+	public:
+		explicit Stopwatch(bool startOnConstruction = false)
+#ifdef MNDL_HEADLESS
+			: mStopped(true)
+#endif
+		{
+			if(startOnConstruction)
+				start();
+		}
+
+		void start()
+		{
+#ifdef MNDL_HEADLESS
+			mStart = std::chrono::steady_clock::now();
+			mStopped = false;
+#else
+			mTimer.start();
+#endif
+		}
+
+		//! Freezes the elapsed time returned by getSeconds().
+		void stop()
+		{
+#ifdef MNDL_HEADLESS
+			mStop = std::chrono::steady_clock::now();
+			mStopped = true;
+#else
+			mTimer.stop();
+#endif
+		}
+
+		//! Returns the seconds elapsed between start() and stop(), or now if running.
+		double getSeconds() const
+		{
+#ifdef MNDL_HEADLESS
+			std::chrono::steady_clock::time_point end = mStopped ? mStop : std::chrono::steady_clock::now();
+			return std::chrono::duration< double >(end - mStart).count();
+#else
+			return mTimer.getSeconds();
+#endif
+		}
+
+	private:
+#ifdef MNDL_HEADLESS
+		std::chrono::steady_clock::time_point mStart;
+		std::chrono::steady_clock::time_point mStop;
+		bool mStopped;
+#else
+		ci::Timer mTimer;
+#endif
+};
+
+} // namespace mndl
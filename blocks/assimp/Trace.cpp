@@ -0,0 +1,249 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#define MNDL_TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#include <pthread.h>
+#define MNDL_TRACE_THREAD_LOCAL __thread
+#endif
+
+#include "Stopwatch.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace mndl
+{
+
+//! A complete scope, or one half of a scope recorded by Trace::begin() and end().
+struct TraceEvent
+{
+	const char* mName;
+	int64_t mStart; /// microseconds
+	uint32_t mDuration; /// microseconds, complete events only
+	char mPhase; /// 'X' complete, 'B' begin or 'E' end, as in the Chrome trace format
+};
+
+//! Ring of the events of one thread, written by that thread alone.
+/*! Buffers outlive their threads, so the events of finished worker threads
+    can still be written. A new thread takes over the buffer of a finished one. */
+struct ThreadBuffer
+{
+	ThreadBuffer(size_t index) : mHead(0), mRetired(false), mIndex(index) {}
+
+	TraceEvent mEvents[ Trace::kBufferSize ];
+	atomic< size_t > mHead; /// number of events ever recorded, published after the event is written
+	atomic< bool > mRetired; /// the thread has exited
+	size_t mIndex; /// thread id in the trace
+	string mName; /// guarded by sRegistryMutex
+};
+
+atomic< bool > Trace::sEnabled(false);
+
+static Stopwatch sClock(true);
+
+static mutex sRegistryMutex;
+static vector< ThreadBuffer* > sBuffers; /// never freed, guarded by sRegistryMutex
+static set< string > sNames; /// interned names, guarded by sRegistryMutex
+
+static MNDL_TRACE_THREAD_LOCAL ThreadBuffer* sThreadBuffer = NULL;
+
+// the thread local pointer has no destructor, exiting threads are reported by the platform
+#ifdef _WIN32
+static VOID WINAPI retireBuffer(PVOID buffer)
+{
+	if(buffer)
+		static_cast< ThreadBuffer* >(buffer)->mRetired.store(true, memory_order_release);
+}
+
+static DWORD sExitKey = FlsAlloc(retireBuffer);
+#else
+static void retireBuffer(void* buffer)
+{
+	if(buffer)
+		static_cast< ThreadBuffer* >(buffer)->mRetired.store(true, memory_order_release);
+}
+
+static pthread_key_t createExitKey()
+{
+	pthread_key_t key;
+	pthread_key_create(&key, retireBuffer);
+	return key;
+}
+
+static pthread_key_t sExitKey = createExitKey();
+#endif
+
+static ThreadBuffer* getThreadBuffer()
+{
+	if(sThreadBuffer)
+		return sThreadBuffer;
+
+	lock_guard< mutex > lock(sRegistryMutex);
+	for(size_t i = 0; i < sBuffers.size() && !sThreadBuffer; ++i)
+	{
+		bool retired = true;
+		if(sBuffers[ i ]->mRetired.compare_exchange_strong(retired, false, memory_order_acquire))
+		{
+			sThreadBuffer = sBuffers[ i ];
+			sThreadBuffer->mName.clear();
+		}
+	}
+
+	if(!sThreadBuffer)
+	{
+		sThreadBuffer = new ThreadBuffer(sBuffers.size());
+		sBuffers.push_back(sThreadBuffer);
+	}
+
+#ifdef _WIN32
+	FlsSetValue(sExitKey, sThreadBuffer);
+#else
+	pthread_setspecific(sExitKey, sThreadBuffer);
+#endif
+	return sThreadBuffer;
+}
+
+static void push(const char* name, int64_t start, int64_t duration, char phase)
+{
+	ThreadBuffer* buffer = getThreadBuffer();
+	size_t head = buffer->mHead.load(memory_order_relaxed);
+
+	TraceEvent& event = buffer->mEvents[ head % Trace::kBufferSize ];
+	event.mName = name;
+	event.mStart = start;
+	event.mDuration = static_cast< uint32_t >(duration);
+	event.mPhase = phase;
+
+	buffer->mHead.store(head + 1, memory_order_release);
+}
+
+void Trace::enable(bool enable)
+{
+	sEnabled.store(enable, memory_order_relaxed);
+}
+
+int64_t Trace::now()
+{
+	return static_cast< int64_t >(sClock.getSeconds() * 1.0e6);
+}
+
+void Trace::record(const char* name, int64_t start, int64_t duration)
+{
+	push(name, start, duration, 'X');
+}
+
+void Trace::begin(const char* name)
+{
+	if(isEnabled())
+		push(name, now(), 0, 'B');
+}
+
+void Trace::end(const char* name)
+{
+	if(isEnabled())
+		push(name, now(), 0, 'E');
+}
+
+const char* Trace::intern(const string& name)
+{
+	lock_guard< mutex > lock(sRegistryMutex);
+	return sNames.insert(name).first->c_str();
+}
+
+void Trace::setThreadName(const string& name)
+{
+	ThreadBuffer* buffer = getThreadBuffer();
+
+	lock_guard< mutex > lock(sRegistryMutex);
+	buffer->mName = name;
+}
+
+static void writeString(ostream& os, const char* text)
+{
+	os << '"';
+	for(const char* c = text; *c; ++c)
+	{
+		if(*c == '"' || *c == '\\')
+			os << '\\';
+		if(static_cast< unsigned char >(*c) >= 0x20)
+			os << *c;
+	}
+	os << '"';
+}
+
+size_t Trace::write(const string& fileName)
+{
+	ofstream ofs(fileName.c_str());
+	if(!ofs)
+		return 0;
+
+	ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	size_t numEvents = 0;
+	vector< TraceEvent > events;
+
+	lock_guard< mutex > lock(sRegistryMutex);
+	for(size_t b = 0; b < sBuffers.size(); ++b)
+	{
+		ThreadBuffer* buffer = sBuffers[ b ];
+
+		size_t head = buffer->mHead.load(memory_order_acquire);
+		size_t first = head > kBufferSize ? head - kBufferSize : 0;
+		events.clear();
+		for(size_t i = first; i < head; ++i)
+			events.push_back(buffer->mEvents[ i % kBufferSize ]);
+
+		// the owner may have gone on recording, events it overwrote meanwhile are dropped,
+		// including the one it may be writing now
+		size_t newHead = buffer->mHead.load(memory_order_acquire);
+		size_t valid = newHead + 1 > kBufferSize ? newHead + 1 - kBufferSize : 0;
+		size_t skip = valid > first ? min(valid - first, events.size()) : 0;
+
+		for(size_t i = skip; i < events.size(); ++i)
+		{
+			const TraceEvent& event = events[ i ];
+			ofs << (numEvents++ ? ",\n" : "") << "{\"name\":";
+			writeString(ofs, event.mName);
+			ofs << ",\"ph\":\"" << event.mPhase << "\",\"ts\":" << event.mStart;
+			if(event.mPhase == 'X')
+				ofs << ",\"dur\":" << event.mDuration;
+			ofs << ",\"pid\":1,\"tid\":" << buffer->mIndex << "}";
+		}
+
+		string name = buffer->mName.empty() ? "thread " + to_string(static_cast< unsigned long long >(buffer->mIndex)) : buffer->mName;
+		ofs << (numEvents + b ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->mIndex << ",\"args\":{\"name\":";
+		writeString(ofs, name.c_str());
+		ofs << "}}";
+	}
+
+	ofs << "\n]}\n";
+	return ofs ? numEvents : 0;
+}
+
+} // namespace mndl
@@ -0,0 +1,103 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+//! Records the enclosing scope as a trace event called \a name, a string literal or Trace::intern()'ed.
+/*! Defining MNDL_TRACE_DISABLED compiles the markers out, otherwise a marker
+    costs a relaxed atomic load while recording is disabled. */
+#ifdef MNDL_TRACE_DISABLED
+#define MNDL_TRACE_SCOPE(name)
+#else
+#define MNDL_TRACE_CONCAT_(a, b) a##b
+#define MNDL_TRACE_CONCAT(a, b) MNDL_TRACE_CONCAT_(a, b)
+#define MNDL_TRACE_SCOPE(name) mndl::TraceScope MNDL_TRACE_CONCAT(mndlTraceScope, __LINE__)(name)
+#endif
+
+namespace mndl
+{
+
+//! Scoped markers recorded into per thread ring buffers and written as Chrome trace JSON.
+/*! Every thread writes its own buffer without locks, the oldest events are
+    overwritten once kBufferSize events have been recorded. The JSON can be
+    opened in chrome://tracing or ui.perfetto.dev. */
+class Trace
+{
+	public:
+		//! Events kept per thread.
+		static const size_t kBufferSize = 16384;
+
+		//! Starts or stops recording on all threads.
+		static void enable(bool enable = true);
+		static bool isEnabled()
+		{
+			return sEnabled.load(std::memory_order_relaxed);
+		}
+
+		//! Returns the microseconds since the program started.
+		static int64_t now();
+
+		//! Records a scope of the calling thread that started at \a start and took \a duration microseconds.
+		static void record(const char* name, int64_t start, int64_t duration);
+		//! Records the beginning of a scope of the calling thread, closed by end().
+		/*! Unlike record() the two halves may be reported by different functions. */
+		static void begin(const char* name);
+		//! Records the end of the scope \a name started by begin() on the calling thread.
+		static void end(const char* name);
+
+		//! Returns a copy of \a name that stays valid until the program exits, for names built at run time.
+		static const char* intern(const std::string& name);
+
+		//! Names the calling thread in the trace, "thread N" otherwise.
+		static void setThreadName(const std::string& name);
+
+		//! Writes the events in the buffers of every thread to \a fileName, returns the number of events written.
+		/*! Recording may go on meanwhile, events overwritten while writing are left out. */
+		static size_t write(const std::string& fileName);
+
+	private:
+		static std::atomic< bool > sEnabled;
+};
+
+//! Records its lifetime as a trace event, see MNDL_TRACE_SCOPE.
+class TraceScope
+{
+	public:
+		explicit TraceScope(const char* name) :
+			mName(Trace::isEnabled() ? name : NULL),
+			mStart(mName ? Trace::now() : 0)
+		{}
+
+		~TraceScope()
+		{
+			if(mName)
+				Trace::record(mName, mStart, Trace::now() - mStart);
+		}
+
+	private:
+		TraceScope(const TraceScope&);
+		void operator=(const TraceScope&);
+
+		const char* mName;
+		int64_t mStart;
+};
+
+} // namespace mndl
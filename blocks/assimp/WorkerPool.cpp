@@ -0,0 +1,175 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+
+#include "WorkerPool.h"
+
+using namespace std;
+
+namespace mndl
+{
+
+WorkerJob::WorkerJob() :
+	mFn(NULL),
+	mContext(NULL),
+	mNumTasks(0),
+	mNextTask(0),
+	mPendingTasks(0),
+	mActiveWorkers(0),
+	mNext(NULL),
+	mQueued(false)
+{
+}
+
+void WorkerJob::set(TaskFn fn, void* context, size_t numTasks)
+{
+	assert(mPendingTasks == 0 && mActiveWorkers == 0 && !mQueued);
+
+	mFn = fn;
+	mContext = context;
+	mNumTasks = numTasks;
+	mNextTask = 0;
+	mPendingTasks = numTasks;
+}
+
+bool WorkerJob::runTask()
+{
+	size_t task = mNextTask++;
+	if(task >= mNumTasks)
+		return false;
+
+	mFn(mContext, task);
+	--mPendingTasks;
+	return true;
+}
+
+WorkerPool::WorkerPool(size_t numThreads) :
+	mQueueHead(NULL),
+	mQuit(false)
+{
+	for(size_t i = 0; i < numThreads; ++i)
+	{
+		mThreads.push_back(thread(&WorkerPool::threadMain, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard< mutex > lock(mMutex);
+		mQuit = true;
+	}
+	mWorkCondition.notify_all();
+
+	for(vector< thread >::iterator it = mThreads.begin(); it != mThreads.end(); ++it)
+	{
+		it->join();
+	}
+}
+
+void WorkerPool::submit(WorkerJob& job)
+{
+	if(job.mNumTasks == 0)
+		return;
+
+	// without workers the tasks run in wait()
+	if(mThreads.empty())
+		return;
+
+	{
+		lock_guard< mutex > lock(mMutex);
+		assert(!job.mQueued);
+		job.mQueued = true;
+		job.mNext = NULL;
+
+		WorkerJob** tail = &mQueueHead;
+		while(*tail)
+			tail = &(*tail)->mNext;
+		*tail = &job;
+	}
+
+	if(job.mNumTasks > 1)
+		mWorkCondition.notify_all();
+	else
+		mWorkCondition.notify_one();
+}
+
+void WorkerPool::wait(WorkerJob& job)
+{
+	while(job.runTask())
+		;
+
+	unique_lock< mutex > lock(mMutex);
+	unlinkJob(&job);
+	while(job.mPendingTasks != 0 || job.mActiveWorkers != 0)
+		mDoneCondition.wait(lock);
+}
+
+void WorkerPool::threadMain()
+{
+	for(;;)
+	{
+		WorkerJob* job = NULL;
+		{
+			unique_lock< mutex > lock(mMutex);
+			while(!mQuit && (job = acquireJob()) == NULL)
+				mWorkCondition.wait(lock);
+
+			if(job == NULL)
+				return;
+		}
+
+		while(job->runTask())
+			;
+
+		{
+			lock_guard< mutex > lock(mMutex);
+			--job->mActiveWorkers;
+			unlinkJob(job);
+		}
+		mDoneCondition.notify_all();
+	}
+}
+
+WorkerJob* WorkerPool::acquireJob()
+{
+	// jobs with every task already claimed are dropped from the queue
+	while(mQueueHead && mQueueHead->mNextTask >= mQueueHead->mNumTasks)
+		unlinkJob(mQueueHead);
+
+	if(mQueueHead)
+		++mQueueHead->mActiveWorkers;
+	return mQueueHead;
+}
+
+void WorkerPool::unlinkJob(WorkerJob* job)
+{
+	if(!job->mQueued)
+		return;
+
+	WorkerJob** link = &mQueueHead;
+	while(*link && *link != job)
+		link = &(*link)->mNext;
+	if(*link)
+		*link = job->mNext;
+
+	job->mNext = NULL;
+	job->mQueued = false;
+}
+
+} // namespace mndl
@@ -0,0 +1,120 @@
+/*
+ Copyright (C) 2011-2012 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mndl
+{
+
+class WorkerPool;
+
+typedef std::shared_ptr< WorkerPool > WorkerPoolRef;
+
+//! A batch of indexed tasks run by a WorkerPool.
+/*! The job is owned by the caller and reused between submissions, so
+    queueing work does not allocate. */
+class WorkerJob
+{
+	public:
+		typedef void (*TaskFn)(void* context, size_t task);
+
+		WorkerJob();
+
+		//! Sets up \a numTasks calls of \a fn( \a context, task ). The job must not be in flight.
+		void set(TaskFn fn, void* context, size_t numTasks);
+
+		//! Returns true if every task of the last submission has finished.
+		bool isDone() const
+		{
+			return mPendingTasks == 0;
+		}
+
+	private:
+		WorkerJob(const WorkerJob&);
+		void operator=(const WorkerJob&);
+
+		friend class WorkerPool;
+
+		//! Claims and runs the next task, returns false if none was left.
+		bool runTask();
+
+		TaskFn mFn;
+		void* mContext;
+		size_t mNumTasks;
+		std::atomic< size_t > mNextTask;
+		std::atomic< size_t > mPendingTasks;
+
+		size_t mActiveWorkers; /// guarded by the pool mutex
+		WorkerJob* mNext; /// intrusive queue link
+		bool mQueued;
+};
+
+//! Persistent worker threads executing WorkerJob's.
+class WorkerPool
+{
+	public:
+		static WorkerPoolRef create(size_t numThreads)
+		{
+			return WorkerPoolRef(new WorkerPool(numThreads));
+		}
+
+		//! Starts \a numThreads workers, with zero threads jobs run on the waiting thread.
+		explicit WorkerPool(size_t numThreads);
+		~WorkerPool();
+
+		size_t getNumThreads() const
+		{
+			return mThreads.size();
+		}
+
+		//! Queues \a job for the workers and returns immediately.
+		void submit(WorkerJob& job);
+		//! Helps running the tasks of \a job, then blocks until all of them finished.
+		void wait(WorkerJob& job);
+		//! Submits \a job and waits for it.
+		void run(WorkerJob& job)
+		{
+			submit(job);
+			wait(job);
+		}
+
+	private:
+		WorkerPool(const WorkerPool&);
+		void operator=(const WorkerPool&);
+
+		void threadMain();
+		WorkerJob* acquireJob();
+		void unlinkJob(WorkerJob* job);
+
+		std::vector< std::thread > mThreads;
+
+		std::mutex mMutex;
+		std::condition_variable mWorkCondition;
+		std::condition_variable mDoneCondition;
+
+		WorkerJob* mQueueHead;
+		bool mQuit;
+};
+
+} // namespace mndl
@@ -0,0 +1,39 @@
+#ifndef ASSETPATH_H
+#define ASSETPATH_H
+
+#include <boost/filesystem.hpp>
+
+#ifndef MNDL_HEADLESS
+#include "cinder/app/App.h"
+#endif
+
+// Parent directories searched for assets/ in headless builds, as far as the app searches from the executable
+#define ASSETPATH_MAX_DEPTH 5
+
+// Full path of fileName in the assets directory, empty if it does not exist there.
+// The app knows its assets directory, headless builds look for assets/ in the working directory and its parents.
+boost::filesystem::path findAssetPath(const boost::filesystem::path& fileName);
+
+boost::filesystem::path findAssetPath(const boost::filesystem::path& fileName)
+{
+#ifdef MNDL_HEADLESS
+	boost::system::error_code error;
+	boost::filesystem::path directory = boost::filesystem::current_path(error);
+
+	for(int i = 0; i <= ASSETPATH_MAX_DEPTH && !directory.empty(); ++i)
+	{
+		boost::filesystem::path path = directory / "assets" / fileName;
+
+		if(boost::filesystem::exists(path, error))
+			return path;
+
+		directory = directory.parent_path();
+	}
+
+	return boost::filesystem::path();
+#else
+	return ci::app::getAssetPath(fileName);
+#endif
+}
+
+#endif
@@ -6,9 +6,8 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/algorithm/string.hpp>
-#include "cinder/app/AppNative.h"
-
-using namespace ci::app;
+#include "cinder/Vector.h"
+#include "AssetPath.h"
 
 class Config
 {
@@ -56,7 +55,7 @@ Config::Config(const std::string& fileName)
 
 	if(!boost::filesystem::exists(boost::filesystem::path(fullPath)))
 	{
-		fullPath = getAssetPath(fileName).string();
+		fullPath = findAssetPath(fileName).string();
 	}
 
 	boost::property_tree::ini_parser::read_ini(fullPath, m_pt);
@@ -159,7 +158,7 @@ ci::Vec3f Config::getVec3f(const std::string& section, const std::string& value)
 		float y = ::atof(strs[1].c_str());
 		float z = ::atof(strs[2].c_str());
 
-		return Vec3f(x, y, z);
+		return ci::Vec3f(x, y, z);
 	}
 	else
 	{
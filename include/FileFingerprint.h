@@ -0,0 +1,210 @@
+#ifndef FILEFINGERPRINT_H
+#define FILEFINGERPRINT_H
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <boost/crc.hpp>
+#include "MappedFile.h"
+
+// Metadata of a file, compared before its contents are hashed.
+struct FileStamp
+{
+	FileStamp() : m_exists(false), m_size(0), m_modified(0), m_inode(0) {}
+
+	static FileStamp get(const boost::filesystem::path& fileName);
+
+	bool operator==(const FileStamp& other) const
+	{
+		return m_exists == other.m_exists && m_size == other.m_size &&
+		       m_modified == other.m_modified && m_inode == other.m_inode;
+	}
+
+	bool operator!=(const FileStamp& other) const
+	{
+		return !(*this == other);
+	}
+
+	bool m_exists;
+	uint64_t m_size;
+	uint64_t m_modified; // nanoseconds where the file system has them, seconds otherwise
+	uint64_t m_inode; // changes when an editor replaces the file, 0 on Windows
+};
+
+// XXH64 of size bytes at data.
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+// XXH64 of the contents of fileName, read through a memory mapping. 0 if it cannot be read.
+uint64_t hashFile(const boost::filesystem::path& fileName);
+// CRC32 of fileName read in 1 KB blocks, the former FileMonitor check, kept as benchmark reference.
+int crcFile(const boost::filesystem::path& fileName);
+
+FileStamp FileStamp::get(const boost::filesystem::path& fileName)
+{
+	FileStamp stamp;
+
+#ifdef _WIN32
+	struct _stat64 info;
+
+	if(_wstat64(fileName.wstring().c_str(), &info) != 0)
+		return stamp;
+
+	stamp.m_modified = static_cast<uint64_t>(info.st_mtime);
+#else
+	struct stat info;
+
+	if(stat(fileName.string().c_str(), &info) != 0)
+		return stamp;
+
+#ifdef __linux__
+	stamp.m_modified = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL + info.st_mtim.tv_nsec;
+#else
+	stamp.m_modified = static_cast<uint64_t>(info.st_mtime);
+#endif
+	stamp.m_inode = static_cast<uint64_t>(info.st_ino);
+#endif
+
+	stamp.m_exists = true;
+	stamp.m_size = static_cast<uint64_t>(info.st_size);
+	return stamp;
+}
+
+#define FILEFINGERPRINT_PRIME1 11400714785074694791ULL
+#define FILEFINGERPRINT_PRIME2 14029467366897019727ULL
+#define FILEFINGERPRINT_PRIME3 1609587929392839161ULL
+#define FILEFINGERPRINT_PRIME4 9650029242287828579ULL
+#define FILEFINGERPRINT_PRIME5 2870177450012600261ULL
+
+static inline uint64_t fingerprintRotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fingerprintRead64(const unsigned char* p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t fingerprintRead32(const unsigned char* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t fingerprintRound(uint64_t acc, uint64_t input)
+{
+	acc += input * FILEFINGERPRINT_PRIME2;
+	acc = fingerprintRotl(acc, 31);
+	return acc * FILEFINGERPRINT_PRIME1;
+}
+
+static inline uint64_t fingerprintMerge(uint64_t acc, uint64_t value)
+{
+	acc ^= fingerprintRound(0, value);
+	return acc * FILEFINGERPRINT_PRIME1 + FILEFINGERPRINT_PRIME4;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	// Little endian XXH64, four independent lanes over 32 byte stripes
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	uint64_t h;
+
+	if(size >= 32)
+	{
+		uint64_t v1 = seed + FILEFINGERPRINT_PRIME1 + FILEFINGERPRINT_PRIME2;
+		uint64_t v2 = seed + FILEFINGERPRINT_PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - FILEFINGERPRINT_PRIME1;
+		const unsigned char* limit = end - 32;
+
+		do
+		{
+			v1 = fingerprintRound(v1, fingerprintRead64(p));
+			v2 = fingerprintRound(v2, fingerprintRead64(p + 8));
+			v3 = fingerprintRound(v3, fingerprintRead64(p + 16));
+			v4 = fingerprintRound(v4, fingerprintRead64(p + 24));
+			p += 32;
+		}
+		while(p <= limit);
+
+		h = fingerprintRotl(v1, 1) + fingerprintRotl(v2, 7) + fingerprintRotl(v3, 12) + fingerprintRotl(v4, 18);
+		h = fingerprintMerge(h, v1);
+		h = fingerprintMerge(h, v2);
+		h = fingerprintMerge(h, v3);
+		h = fingerprintMerge(h, v4);
+	}
+	else
+	{
+		h = seed + FILEFINGERPRINT_PRIME5;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	for(; p + 8 <= end; p += 8)
+	{
+		h ^= fingerprintRound(0, fingerprintRead64(p));
+		h = fingerprintRotl(h, 27) * FILEFINGERPRINT_PRIME1 + FILEFINGERPRINT_PRIME4;
+	}
+
+	if(p + 4 <= end)
+	{
+		h ^= static_cast<uint64_t>(fingerprintRead32(p)) * FILEFINGERPRINT_PRIME1;
+		h = fingerprintRotl(h, 23) * FILEFINGERPRINT_PRIME2 + FILEFINGERPRINT_PRIME3;
+		p += 4;
+	}
+
+	for(; p < end; ++p)
+	{
+		h ^= (*p) * FILEFINGERPRINT_PRIME5;
+		h = fingerprintRotl(h, 11) * FILEFINGERPRINT_PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= FILEFINGERPRINT_PRIME2;
+	h ^= h >> 29;
+	h *= FILEFINGERPRINT_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t hashFile(const boost::filesystem::path& fileName)
+{
+	MappedFile file(fileName);
+
+	if(!file.isOpen())
+		return 0;
+
+	return hashBytes(file.getData(), file.getSize());
+}
+
+int crcFile(const boost::filesystem::path& fileName)
+{
+	boost::crc_32_type result;
+	std::streamsize const buffer_size = 1024;
+
+	std::ifstream ifs(fileName.string(), std::ios_base::binary);
+
+	if(ifs)
+	{
+		do
+		{
+			char buffer[buffer_size];
+			ifs.read(buffer, buffer_size);
+			size_t count = static_cast<size_t>(ifs.gcount());
+			result.process_bytes(buffer, count);
+		}
+		while(ifs);
+	}
+
+	return result.checksum();
+}
+
+#endif
@@ -1,15 +1,13 @@
 #ifndef FILEMONITOR_H
 #define FILEMONITOR_H
 
-#include <string>
-#include <fstream>
 #include <memory>
-#include <boost/crc.hpp>
-#include <boost/timer.hpp>
+#include <boost/filesystem.hpp>
+#include "FileWatcher.h"
 
 typedef std::shared_ptr<class FileMonitor> FileMonitorRef;
-#define FILEMONITOR_CHECK_INTERVAL 3
 
+// Reports changes of one file, found by the shared FileWatcher on its own thread.
 class FileMonitor
 {
 public:
@@ -18,63 +16,36 @@ public:
 		return FileMonitorRef(new FileMonitor(fileName));
 	}
 
+	~FileMonitor();
+
+	// Returns true once per change since the last call, main thread only.
 	bool hasChanged();
 
 private:
 	FileMonitor(const boost::filesystem::path& fileName);
+	FileMonitor(FileMonitor const&);
+	void operator=(FileMonitor const&);
+
 	boost::filesystem::path m_fileName;
-	int m_checksum;
-	boost::timer m_time;
-	const int getChecksum();
+	FileWatcherRef m_watcher;
+	int m_id;
 };
 
 FileMonitor::FileMonitor(const boost::filesystem::path& fileName)
 {
 	m_fileName = fileName;
-	m_checksum = getChecksum();
-	m_time.restart();
+	m_watcher = FileWatcher::get();
+	m_id = m_watcher->watch(m_fileName);
 }
 
-bool FileMonitor::hasChanged()
+FileMonitor::~FileMonitor()
 {
-	double elapsed = m_time.elapsed();
-
-	if(elapsed > FILEMONITOR_CHECK_INTERVAL)
-	{
-		m_time.restart();
-		int currentChecksum = getChecksum();
-
-		if(m_checksum != currentChecksum)
-		{
-			m_checksum = currentChecksum;
-			return true;
-		}
-	}
-
-	return false;
+	m_watcher->unwatch(m_id);
 }
 
-const int FileMonitor::getChecksum()
+bool FileMonitor::hasChanged()
 {
-	boost::crc_32_type result;
-	std::streamsize const buffer_size = 1024;
-
-	std::ifstream ifs(m_fileName.string(), std::ios_base::binary);
-
-	if(ifs)
-	{
-		do
-		{
-			char buffer[buffer_size];
-			ifs.read(buffer, buffer_size);
-			size_t count = static_cast<size_t>(ifs.gcount());
-			result.process_bytes(buffer, count);
-		}
-		while(ifs);
-	}
-
-	return result.checksum();
+	return m_watcher->hasChanged(m_id);
 }
 
 #endif
-
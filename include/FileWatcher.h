@@ -0,0 +1,330 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include "FileFingerprint.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+typedef std::shared_ptr<class FileWatcher> FileWatcherRef;
+
+// Seconds between two checks of the polling fallback
+#define FILEWATCHER_POLL_INTERVAL 0.5
+// Milliseconds without further events before a change is reported, editors save in several steps
+#define FILEWATCHER_DEBOUNCE 100
+// Capacity of the change queue, changes stay pending while it is full
+#define FILEWATCHER_QUEUE_SIZE 1024
+
+// Single producer, single consumer ring of watch ids, from the watcher thread to the main thread.
+class ChangeQueue
+{
+public:
+	ChangeQueue() : m_head(0), m_tail(0) {}
+
+	bool push(int id)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % FILEWATCHER_QUEUE_SIZE;
+
+		if(next == m_head.load(std::memory_order_acquire))
+			return false;
+
+		m_ids[tail] = id;
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(int* id)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+
+		if(head == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		*id = m_ids[head];
+		m_head.store((head + 1) % FILEWATCHER_QUEUE_SIZE, std::memory_order_release);
+		return true;
+	}
+
+private:
+	int m_ids[FILEWATCHER_QUEUE_SIZE];
+	std::atomic<size_t> m_head;
+	std::atomic<size_t> m_tail;
+};
+
+// Watches files on a background thread, with inotify where available and by polling otherwise.
+// Changes are debounced there and handed to the main thread, which asks with hasChanged().
+class FileWatcher
+{
+public:
+	// The watcher shared by all FileMonitors.
+	static FileWatcherRef get()
+	{
+		static FileWatcherRef instance(new FileWatcher());
+		return instance;
+	}
+
+	~FileWatcher();
+
+	// Starts watching fileName, returns the id passed to hasChanged() and unwatch().
+	int watch(const boost::filesystem::path& fileName);
+	void unwatch(int id);
+
+	// Main thread only. Returns true once per debounced change of watch id.
+	bool hasChanged(int id);
+
+	// False if changes are found by polling.
+	bool isEventDriven() const
+	{
+		return m_inotify >= 0;
+	}
+
+private:
+	FileWatcher();
+	FileWatcher(FileWatcher const&);
+	void operator=(FileWatcher const&);
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Watch
+	{
+		boost::filesystem::path m_fileName;
+		std::string m_name; // file name without directory, as reported by inotify
+		int m_directory; // inotify watch descriptor of the directory
+		bool m_active;
+		bool m_pending; // changed, waiting for the debounce interval to pass
+		Clock::time_point m_lastEvent;
+		FileStamp m_stamp; // polling fallback, the contents are only hashed when the stamp changes
+		uint64_t m_hash;
+	};
+
+	void run();
+	void readEvents();
+	void pollFiles();
+	void flushPending();
+
+	std::vector<Watch> m_watches;
+	std::mutex m_mutex; // guards m_watches, taken by watch() and unwatch() and the watcher thread
+	std::vector<bool> m_changed; // main thread only
+	ChangeQueue m_queue;
+	int m_inotify;
+	std::atomic<bool> m_running;
+	std::thread m_thread;
+};
+
+FileWatcher::FileWatcher()
+{
+	m_inotify = -1;
+#ifdef __linux__
+	m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	m_running = true;
+	m_thread = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+	m_running = false;
+	m_thread.join();
+
+#ifdef __linux__
+	if(m_inotify >= 0)
+		close(m_inotify);
+#endif
+}
+
+int FileWatcher::watch(const boost::filesystem::path& fileName)
+{
+	Watch watch;
+	watch.m_fileName = fileName;
+	watch.m_name = fileName.filename().string();
+	watch.m_directory = -1;
+	watch.m_active = true;
+	watch.m_pending = false;
+	watch.m_hash = 0;
+
+#ifdef __linux__
+	// The directory is watched, editors often replace a file instead of writing to it
+	if(m_inotify >= 0)
+	{
+		boost::filesystem::path directory = fileName.parent_path();
+
+		if(directory.empty())
+			directory = ".";
+
+		const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+		watch.m_directory = inotify_add_watch(m_inotify, directory.string().c_str(), mask);
+	}
+#endif
+
+	if(watch.m_directory < 0)
+	{
+		watch.m_stamp = FileStamp::get(fileName);
+		watch.m_hash = watch.m_stamp.m_exists ? hashFile(fileName) : 0;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_watches.push_back(watch);
+	m_changed.push_back(false);
+	return static_cast<int>(m_watches.size()) - 1;
+}
+
+void FileWatcher::unwatch(int id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_watches[id].m_active = false;
+	m_changed[id] = false;
+}
+
+bool FileWatcher::hasChanged(int id)
+{
+	int changedId;
+
+	while(m_queue.pop(&changedId))
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_watches[changedId].m_active)
+			m_changed[changedId] = true;
+	}
+
+	bool changed = m_changed[id];
+	m_changed[id] = false;
+	return changed;
+}
+
+void FileWatcher::run()
+{
+	Clock::time_point lastPoll = Clock::now();
+
+	while(m_running)
+	{
+#ifdef __linux__
+		if(m_inotify >= 0)
+		{
+			pollfd fd;
+			fd.fd = m_inotify;
+			fd.events = POLLIN;
+			fd.revents = 0;
+
+			if(poll(&fd, 1, FILEWATCHER_DEBOUNCE / 2) > 0)
+				readEvents();
+		}
+		else
+#endif
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(FILEWATCHER_DEBOUNCE / 2));
+		}
+
+		// Files outside an inotify watch are polled, all of them without inotify
+		if(std::chrono::duration<double>(Clock::now() - lastPoll).count() >= FILEWATCHER_POLL_INTERVAL)
+		{
+			pollFiles();
+			lastPoll = Clock::now();
+		}
+
+		flushPending();
+	}
+}
+
+void FileWatcher::readEvents()
+{
+#ifdef __linux__
+	char buffer[4096] __attribute__((aligned(__alignof__(inotify_event))));
+	ssize_t length;
+
+	while((length = read(m_inotify, buffer, sizeof(buffer))) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(char* p = buffer; p < buffer + length;)
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if(event->len == 0)
+				continue;
+
+			for(size_t i = 0; i < m_watches.size(); ++i)
+			{
+				Watch& watch = m_watches[i];
+
+				if(watch.m_active && watch.m_directory == event->wd && watch.m_name == event->name)
+				{
+					watch.m_pending = true;
+					watch.m_lastEvent = Clock::now();
+				}
+			}
+		}
+	}
+#endif
+}
+
+void FileWatcher::pollFiles()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for(size_t i = 0; i < m_watches.size(); ++i)
+	{
+		if(!m_watches[i].m_active || m_watches[i].m_directory >= 0)
+			continue;
+
+		// Files are read without the lock, watch() may reallocate the list meanwhile
+		boost::filesystem::path fileName = m_watches[i].m_fileName;
+		lock.unlock();
+		FileStamp stamp = FileStamp::get(fileName);
+		lock.lock();
+
+		// Unchanged metadata, the common case, costs a single stat
+		if(stamp == m_watches[i].m_stamp)
+			continue;
+
+		m_watches[i].m_stamp = stamp;
+		lock.unlock();
+		uint64_t hash = stamp.m_exists ? hashFile(fileName) : 0;
+		lock.lock();
+
+		// Touched but identical files are not reported
+		Watch& watch = m_watches[i];
+
+		if(watch.m_hash != hash)
+		{
+			watch.m_hash = hash;
+			watch.m_pending = true;
+			watch.m_lastEvent = Clock::now();
+		}
+	}
+}
+
+void FileWatcher::flushPending()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Clock::time_point now = Clock::now();
+
+	for(size_t i = 0; i < m_watches.size(); ++i)
+	{
+		Watch& watch = m_watches[i];
+
+		if(!watch.m_pending || now - watch.m_lastEvent < std::chrono::milliseconds(FILEWATCHER_DEBOUNCE))
+			continue;
+
+		// A full queue keeps the change pending for the next round
+		if(m_queue.push(static_cast<int>(i)))
+			watch.m_pending = false;
+	}
+}
+
+#endif
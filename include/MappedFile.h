@@ -0,0 +1,144 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <boost/filesystem.hpp>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file, unmapped when destroyed.
+class MappedFile
+{
+public:
+	MappedFile(const boost::filesystem::path& fileName);
+	~MappedFile();
+
+	// False if the file could not be opened or mapped. Empty files open without data.
+	bool isOpen() const
+	{
+		return m_open;
+	}
+
+	const void* getData() const
+	{
+		return m_data;
+	}
+
+	size_t getSize() const
+	{
+		return m_size;
+	}
+
+private:
+	MappedFile(MappedFile const&);
+	void operator=(MappedFile const&);
+
+	const void* m_data;
+	size_t m_size;
+	bool m_open;
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#endif
+};
+
+MappedFile::MappedFile(const boost::filesystem::path& fileName)
+{
+	m_data = NULL;
+	m_size = 0;
+	m_open = false;
+
+#ifdef _WIN32
+	m_mapping = NULL;
+	m_file = CreateFileW(fileName.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                     NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if(m_file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER size;
+
+	if(!GetFileSizeEx(m_file, &size))
+		return;
+
+	// empty files cannot be mapped
+	if(size.QuadPart == 0)
+	{
+		m_open = true;
+		return;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if(!m_mapping)
+		return;
+
+	m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(m_data)
+	{
+		m_size = static_cast<size_t>(size.QuadPart);
+		m_open = true;
+	}
+#else
+	int fd = open(fileName.string().c_str(), O_RDONLY);
+
+	if(fd < 0)
+		return;
+
+	struct stat info;
+
+	if(fstat(fd, &info) == 0)
+	{
+		if(info.st_size == 0)
+		{
+			// empty files cannot be mapped
+			m_open = true;
+		}
+		else
+		{
+			void* data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if(data != MAP_FAILED)
+			{
+				m_data = data;
+				m_size = static_cast<size_t>(info.st_size);
+				m_open = true;
+			}
+		}
+	}
+
+	// the mapping stays valid without the descriptor
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if(m_data)
+		UnmapViewOfFile(m_data);
+
+	if(m_mapping)
+		CloseHandle(m_mapping);
+
+	if(m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+#else
+	if(m_data)
+		munmap(const_cast<void*>(m_data), m_size);
+#endif
+}
+
+#endif
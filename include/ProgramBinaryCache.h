@@ -0,0 +1,313 @@
+#ifndef PROGRAMBINARYCACHE_H
+#define PROGRAMBINARYCACHE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <stdint.h>
+#include <boost/filesystem.hpp>
+#include "cinder/gl/gl.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/app/App.h"
+#include "cinder/Timer.h"
+
+typedef std::shared_ptr<class ProgramBinaryCache> ProgramBinaryCacheRef;
+
+#define PROGRAMBINARYCACHE_MAGIC "MNDLPRG1"
+
+// GlslProg taking ownership of a program linked by ProgramBinaryCache, from sources or with glProgramBinary.
+class BinaryGlslProg : public ci::gl::GlslProg
+{
+public:
+	BinaryGlslProg(GLuint handle)
+	{
+		mObj = std::shared_ptr<Obj>(new Obj);
+		mObj->mHandle = handle;
+	}
+};
+
+// Linked programs stored with glGetProgramBinary, keyed by their sources and the driver.
+// Sources are compiled when the driver has no binary formats or a stored binary no longer links.
+class ProgramBinaryCache
+{
+public:
+	static ProgramBinaryCacheRef create(const boost::filesystem::path& directory)
+	{
+		return ProgramBinaryCacheRef(new ProgramBinaryCache(directory));
+	}
+
+	// Returns the program of the sources, #defines included. Throws gl::GlslProgCompileExc.
+	ci::gl::GlslProgRef get(const std::string& vertexSource, const std::string& fragmentSource);
+
+	bool isSupported() const
+	{
+		return m_supported;
+	}
+
+	size_t getNumHits() const
+	{
+		return m_hits;
+	}
+
+	size_t getNumMisses() const
+	{
+		return m_misses;
+	}
+
+	// Compile time of the programs loaded from the cache minus the time it took to load them.
+	double getSecondsSaved() const
+	{
+		return m_secondsSaved;
+	}
+
+private:
+	ProgramBinaryCache(const boost::filesystem::path& directory);
+	ProgramBinaryCache(ProgramBinaryCache const&);
+	void operator=(ProgramBinaryCache const&);
+
+	static void hash(uint64_t& h, const std::string& text);
+	static void attachShader(GLuint handle, GLenum type, const std::string& source);
+	ci::gl::GlslProgRef compile(const std::string& vertexSource, const std::string& fragmentSource);
+	uint64_t makeKey(const std::string& vertexSource, const std::string& fragmentSource) const;
+	boost::filesystem::path getPath(uint64_t key) const;
+	ci::gl::GlslProgRef load(uint64_t key, double* compileSeconds);
+	void store(uint64_t key, const ci::gl::GlslProgRef& program, double compileSeconds);
+
+	boost::filesystem::path m_directory;
+	std::string m_driver;
+	bool m_supported;
+	size_t m_hits;
+	size_t m_misses;
+	double m_secondsSaved;
+};
+
+ProgramBinaryCache::ProgramBinaryCache(const boost::filesystem::path& directory)
+{
+	m_directory = directory;
+	m_hits = 0;
+	m_misses = 0;
+	m_secondsSaved = 0.0;
+
+	// A binary is only valid for the driver that created it
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+
+	for(size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i)
+	{
+		const GLubyte* value = glGetString(strings[i]);
+
+		if(value)
+			m_driver += reinterpret_cast<const char*>(value);
+		m_driver += '\n';
+	}
+
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	m_supported = numFormats > 0;
+
+	if(m_supported)
+	{
+		boost::system::error_code error;
+		boost::filesystem::create_directories(m_directory, error);
+		m_supported = boost::filesystem::is_directory(m_directory, error);
+	}
+}
+
+void ProgramBinaryCache::hash(uint64_t& h, const std::string& text)
+{
+	// FNV-1a, with a separator so that moving text between the parts changes the key
+	for(size_t i = 0; i < text.size(); ++i)
+	{
+		h ^= static_cast<unsigned char>(text[i]);
+		h *= 1099511628211ULL;
+	}
+
+	h ^= 0xff;
+	h *= 1099511628211ULL;
+}
+
+uint64_t ProgramBinaryCache::makeKey(const std::string& vertexSource, const std::string& fragmentSource) const
+{
+	uint64_t h = 14695981039346656037ULL;
+	hash(h, m_driver);
+	hash(h, vertexSource);
+	hash(h, fragmentSource);
+	return h;
+}
+
+void ProgramBinaryCache::attachShader(GLuint handle, GLenum type, const std::string& source)
+{
+	GLuint shader = glCreateShader(type);
+	const char* text = source.c_str();
+	glShaderSource(shader, 1, &text, NULL);
+	glCompileShader(shader);
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if(status != GL_TRUE)
+	{
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		std::string log(std::max<GLint>(length, 1), '\0');
+		glGetShaderInfoLog(shader, length, NULL, &log[0]);
+		glDeleteShader(shader);
+		throw ci::gl::GlslProgCompileExc(log, type);
+	}
+
+	// Deleted along with the program
+	glAttachShader(handle, shader);
+	glDeleteShader(shader);
+}
+
+// Compiled and linked as gl::GlslProg does, but the driver is asked to keep the binary.
+// Drivers honoring GL_PROGRAM_BINARY_RETRIEVABLE_HINT return no binary without it.
+ci::gl::GlslProgRef ProgramBinaryCache::compile(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	GLuint handle = glCreateProgram();
+	ci::gl::GlslProgRef program(new BinaryGlslProg(handle)); // deletes the program if a shader does not compile
+
+	attachShader(handle, GL_VERTEX_SHADER, vertexSource);
+	attachShader(handle, GL_FRAGMENT_SHADER, fragmentSource);
+
+	if(m_supported)
+		glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(handle);
+	return program;
+}
+
+boost::filesystem::path ProgramBinaryCache::getPath(uint64_t key) const
+{
+	char name[32];
+	sprintf(name, "%016llx.bin", static_cast<unsigned long long>(key));
+	return m_directory / name;
+}
+
+ci::gl::GlslProgRef ProgramBinaryCache::load(uint64_t key, double* compileSeconds)
+{
+	boost::filesystem::path path = getPath(key);
+	std::ifstream ifs(path.string().c_str(), std::ios_base::binary);
+
+	if(!ifs)
+		return ci::gl::GlslProgRef();
+
+	char magic[8];
+	uint64_t storedKey = 0;
+	uint32_t format = 0;
+	uint32_t length = 0;
+	ifs.read(magic, sizeof(magic));
+	ifs.read(reinterpret_cast<char*>(&storedKey), sizeof(storedKey));
+	ifs.read(reinterpret_cast<char*>(compileSeconds), sizeof(double));
+	ifs.read(reinterpret_cast<char*>(&format), sizeof(format));
+	ifs.read(reinterpret_cast<char*>(&length), sizeof(length));
+
+	if(!ifs || memcmp(magic, PROGRAMBINARYCACHE_MAGIC, sizeof(magic)) != 0 || storedKey != key || length == 0)
+		return ci::gl::GlslProgRef();
+
+	std::vector<char> binary(length);
+	ifs.read(&binary[0], length);
+
+	if(!ifs)
+		return ci::gl::GlslProgRef();
+
+	GLuint handle = glCreateProgram();
+	glProgramBinary(handle, format, &binary[0], static_cast<GLsizei>(length));
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(handle, GL_LINK_STATUS, &status);
+
+	if(status != GL_TRUE)
+	{
+		// e.g. rejected after a driver update, replaced by the next store
+		glDeleteProgram(handle);
+		return ci::gl::GlslProgRef();
+	}
+
+	return ci::gl::GlslProgRef(new BinaryGlslProg(handle));
+}
+
+void ProgramBinaryCache::store(uint64_t key, const ci::gl::GlslProgRef& program, double compileSeconds)
+{
+	GLint length = 0;
+	glGetProgramiv(program->getHandle(), GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if(length <= 0)
+	{
+		ci::app::console() << "Shader cache: the driver returned no program binary" << std::endl;
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program->getHandle(), length, &written, &format, &binary[0]);
+
+	if(written <= 0)
+	{
+		ci::app::console() << "Shader cache: glGetProgramBinary failed" << std::endl;
+		return;
+	}
+
+	// Written next to the final name and renamed, a running instance never reads a partial file
+	boost::filesystem::path path = getPath(key);
+	boost::filesystem::path tempPath = path.string() + ".tmp";
+	{
+		std::ofstream ofs(tempPath.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+		uint32_t storedFormat = format;
+		uint32_t storedLength = static_cast<uint32_t>(written);
+		ofs.write(PROGRAMBINARYCACHE_MAGIC, 8);
+		ofs.write(reinterpret_cast<const char*>(&key), sizeof(key));
+		ofs.write(reinterpret_cast<const char*>(&compileSeconds), sizeof(compileSeconds));
+		ofs.write(reinterpret_cast<const char*>(&storedFormat), sizeof(storedFormat));
+		ofs.write(reinterpret_cast<const char*>(&storedLength), sizeof(storedLength));
+		ofs.write(&binary[0], written);
+
+		if(!ofs)
+		{
+			ci::app::console() << "Shader cache: cannot write " << tempPath.string() << std::endl;
+			return;
+		}
+	}
+
+	boost::system::error_code error;
+	boost::filesystem::rename(tempPath, path, error);
+
+	if(error)
+		boost::filesystem::remove(tempPath, error);
+}
+
+ci::gl::GlslProgRef ProgramBinaryCache::get(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	uint64_t key = m_supported ? makeKey(vertexSource, fragmentSource) : 0;
+
+	if(m_supported)
+	{
+		ci::Timer timer(true);
+		double compileSeconds = 0.0;
+		ci::gl::GlslProgRef program = load(key, &compileSeconds);
+
+		if(program)
+		{
+			++m_hits;
+			m_secondsSaved += compileSeconds - timer.getSeconds();
+			return program;
+		}
+	}
+
+	++m_misses;
+
+	ci::Timer timer(true);
+	ci::gl::GlslProgRef program = compile(vertexSource, fragmentSource);
+	double compileSeconds = timer.getSeconds();
+
+	if(m_supported)
+		store(key, program, compileSeconds);
+
+	return program;
+}
+
+#endif
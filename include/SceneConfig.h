@@ -0,0 +1,447 @@
+#ifndef SCENECONFIG_H
+#define SCENECONFIG_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <exception>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+#include "cinder/Vector.h"
+#include "cinder/Matrix.h"
+#include "cinder/CinderMath.h"
+#include "AssetPath.h"
+#include "MappedFile.h"
+
+// Texture slots of a scene, in the order of the texture units
+enum TextureSlot
+{
+	TEXTURE_DIFFUSE,
+	TEXTURE_NORMAL,
+	TEXTURE_SPECULAR,
+	TEXTURE_AO,
+	TEXTURE_EMISSIVE,
+	TEXTURE_COUNT
+};
+
+static const char* s_textureKeys[TEXTURE_COUNT] = { "Diffuse", "Normal", "Specular", "AO", "Emissive" };
+
+#define SCENECONFIG_MAGIC "MNDLSCN2"
+
+// Thrown with every problem found in a scene file, one per line.
+class SceneConfigExc : public std::exception
+{
+public:
+	SceneConfigExc(const std::string& message) : m_message(message) {}
+	virtual ~SceneConfigExc() throw() {}
+
+	virtual const char* what() const throw()
+	{
+		return m_message.c_str();
+	}
+
+private:
+	std::string m_message;
+};
+
+// One placement of a model file, models listed several times share their geometry.
+struct SceneModel
+{
+	SceneModel() : m_scale(ci::Vec3f::one()) {}
+
+	// Scale, then rotation about x, y and z, then translation
+	ci::Matrix44f getTransform() const
+	{
+		ci::Matrix44f transform = ci::Matrix44f::createTranslation(m_position);
+		transform.rotate(ci::Vec3f(ci::toRadians(m_rotation.x), ci::toRadians(m_rotation.y), ci::toRadians(m_rotation.z)));
+		transform.scale(m_scale);
+		return transform;
+	}
+
+	std::string m_fileName;
+	ci::Vec3f m_position;
+	ci::Vec3f m_rotation; // degrees
+	ci::Vec3f m_scale;
+};
+
+// Scene description read once from an .ini file or its binary form.
+// File names are relative to the assets directory.
+struct SceneConfig
+{
+	SceneConfig();
+
+	// Reads the binary form if fileName starts with its magic, the .ini form otherwise. Throws SceneConfigExc.
+	static SceneConfig load(const boost::filesystem::path& fileName);
+	static SceneConfig parseIni(const boost::filesystem::path& fileName);
+	static SceneConfig loadBinary(const boost::filesystem::path& fileName);
+
+	// Writes the binary form, mapped and read without parsing by loadBinary(). Throws SceneConfigExc.
+	void writeBinary(const boost::filesystem::path& fileName) const;
+
+	std::string m_shaderFileName;
+	std::vector<SceneModel> m_models; // [Model] and every further section named Model..., e.g. [Model2]
+	std::string m_textureFileNames[TEXTURE_COUNT];
+	float m_texturePowers[TEXTURE_COUNT];
+	ci::Vec3f m_matAmbient;
+	ci::Vec3f m_matDiffuse;
+	ci::Vec3f m_matSpecular;
+	float m_matShininess;
+	float m_gamma;
+};
+
+// Binary form, native little endian. Strings are offset and length into the string table at the end.
+struct SceneBinaryString
+{
+	uint32_t m_offset;
+	uint32_t m_length;
+};
+
+struct SceneBinaryModel
+{
+	SceneBinaryString m_fileName;
+	float m_position[3];
+	float m_rotation[3];
+	float m_scale[3];
+};
+
+struct SceneBinaryHeader
+{
+	char m_magic[8];
+	uint32_t m_numModels;
+	uint32_t m_stringsSize;
+	SceneBinaryString m_shaderFileName;
+	SceneBinaryString m_textureFileNames[TEXTURE_COUNT];
+	float m_texturePowers[TEXTURE_COUNT];
+	float m_matAmbient[3];
+	float m_matDiffuse[3];
+	float m_matSpecular[3];
+	float m_matShininess;
+	float m_gamma;
+	// followed by m_numModels SceneBinaryModels and the string table
+};
+
+SceneConfig::SceneConfig()
+{
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+		m_texturePowers[slot] = 1.0f;
+
+	m_matShininess = 0.0f;
+	m_gamma = 1.0f;
+}
+
+// Parses the values of one .ini file, collecting every error instead of stopping at the first
+class SceneIniReader
+{
+public:
+	SceneIniReader(const boost::property_tree::ptree& pt) : m_pt(pt) {}
+
+	std::string getString(const std::string& section, const std::string& key)
+	{
+		boost::optional<const boost::property_tree::ptree&> child = m_pt.get_child_optional(section);
+
+		if(!child)
+			return std::string();
+
+		return child->get<std::string>(key, std::string());
+	}
+
+	// An existing asset, or empty if not set
+	std::string getFileName(const std::string& section, const std::string& key, bool required)
+	{
+		std::string fileName = getString(section, key);
+
+		if(fileName.empty())
+		{
+			if(required)
+				addError(section, key, "missing");
+		}
+		else if(findAssetPath(fileName).empty())
+		{
+			addError(section, key, "asset not found: " + fileName);
+		}
+
+		return fileName;
+	}
+
+	float getFloat(const std::string& section, const std::string& key, float defaultValue)
+	{
+		std::string value = getString(section, key);
+		float result = defaultValue;
+
+		if(!value.empty() && !parseFloats(value, &result, 1))
+			addError(section, key, "not a number: " + value);
+
+		return result;
+	}
+
+	ci::Vec3f getVec3f(const std::string& section, const std::string& key, const ci::Vec3f& defaultValue = ci::Vec3f::zero())
+	{
+		std::string value = getString(section, key);
+		float xyz[3] = { defaultValue.x, defaultValue.y, defaultValue.z };
+
+		if(!value.empty() && !parseFloats(value, xyz, 3))
+			addError(section, key, "not three numbers: " + value);
+
+		return ci::Vec3f(xyz[0], xyz[1], xyz[2]);
+	}
+
+	void addError(const std::string& section, const std::string& key, const std::string& message)
+	{
+		m_errors += section + "." + key + ": " + message + "\n";
+	}
+
+	const std::string& getErrors() const
+	{
+		return m_errors;
+	}
+
+private:
+	// Exactly count numbers separated by blanks, each may end in f as in C
+	static bool parseFloats(const std::string& text, float* result, int count)
+	{
+		const char* p = text.c_str();
+
+		for(int i = 0; i < count; ++i)
+		{
+			char* end;
+			result[i] = static_cast<float>(strtod(p, &end));
+
+			if(end == p)
+				return false;
+
+			p = end;
+
+			if(*p == 'f' || *p == 'F')
+				++p;
+
+			if(*p != '\0' && *p != ' ' && *p != '\t')
+				return false;
+		}
+
+		while(*p == ' ' || *p == '\t')
+			++p;
+
+		return *p == '\0';
+	}
+
+	const boost::property_tree::ptree& m_pt;
+	std::string m_errors;
+};
+
+SceneConfig SceneConfig::load(const boost::filesystem::path& fileName)
+{
+	char magic[8] = { 0 };
+	std::ifstream ifs(fileName.string().c_str(), std::ios_base::binary);
+
+	if(!ifs)
+		throw SceneConfigExc("Cannot open " + fileName.string());
+
+	ifs.read(magic, sizeof(magic));
+
+	if(ifs && memcmp(magic, SCENECONFIG_MAGIC, sizeof(magic)) == 0)
+		return loadBinary(fileName);
+
+	return parseIni(fileName);
+}
+
+SceneConfig SceneConfig::parseIni(const boost::filesystem::path& fileName)
+{
+	boost::property_tree::ptree pt;
+
+	try
+	{
+		boost::property_tree::ini_parser::read_ini(fileName.string(), pt);
+	}
+	catch(const boost::property_tree::ini_parser_error& e)
+	{
+		throw SceneConfigExc(e.what());
+	}
+
+	SceneConfig scene;
+	SceneIniReader reader(pt);
+
+	scene.m_shaderFileName = reader.getString("Shader", "FileName");
+
+	if(scene.m_shaderFileName.empty())
+		reader.addError("Shader", "FileName", "missing");
+
+	// Models in file order, a manifest may list any number of them
+	for(boost::property_tree::ptree::const_iterator it = pt.begin(); it != pt.end(); ++it)
+	{
+		if(it->first.compare(0, 5, "Model") != 0)
+			continue;
+
+		SceneModel model;
+		model.m_fileName = reader.getFileName(it->first, "FileName", true);
+		model.m_position = reader.getVec3f(it->first, "Position", model.m_position);
+		model.m_rotation = reader.getVec3f(it->first, "Rotation", model.m_rotation);
+		model.m_scale = reader.getVec3f(it->first, "Scale", model.m_scale);
+		scene.m_models.push_back(model);
+	}
+
+	if(scene.m_models.empty())
+		reader.addError("Model", "FileName", "missing");
+
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+	{
+		scene.m_textureFileNames[slot] = reader.getFileName("Textures", s_textureKeys[slot], false);
+
+		if(!scene.m_textureFileNames[slot].empty())
+			scene.m_texturePowers[slot] = reader.getFloat("Textures", std::string(s_textureKeys[slot]) + "Power", 1.0f);
+	}
+
+	scene.m_matAmbient = reader.getVec3f("Material", "Ambient");
+	scene.m_matDiffuse = reader.getVec3f("Material", "Diffuse");
+	scene.m_matSpecular = reader.getVec3f("Material", "Specular");
+	scene.m_matShininess = reader.getFloat("Material", "Shininess", 0.0f);
+	scene.m_gamma = reader.getFloat("Material", "Gamma", 1.0f);
+
+	if(!reader.getErrors().empty())
+		throw SceneConfigExc(fileName.string() + ":\n" + reader.getErrors());
+
+	return scene;
+}
+
+static SceneBinaryString addSceneString(const std::string& text, std::string* strings)
+{
+	SceneBinaryString result;
+	result.m_offset = static_cast<uint32_t>(strings->size());
+	result.m_length = static_cast<uint32_t>(text.size());
+	strings->append(text);
+	return result;
+}
+
+void SceneConfig::writeBinary(const boost::filesystem::path& fileName) const
+{
+	SceneBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, SCENECONFIG_MAGIC, sizeof(header.m_magic));
+
+	std::string strings;
+	header.m_numModels = static_cast<uint32_t>(m_models.size());
+	header.m_shaderFileName = addSceneString(m_shaderFileName, &strings);
+
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+	{
+		header.m_textureFileNames[slot] = addSceneString(m_textureFileNames[slot], &strings);
+		header.m_texturePowers[slot] = m_texturePowers[slot];
+	}
+
+	for(int i = 0; i < 3; ++i)
+	{
+		header.m_matAmbient[i] = m_matAmbient[i];
+		header.m_matDiffuse[i] = m_matDiffuse[i];
+		header.m_matSpecular[i] = m_matSpecular[i];
+	}
+
+	header.m_matShininess = m_matShininess;
+	header.m_gamma = m_gamma;
+
+	std::vector<SceneBinaryModel> models(m_models.size());
+
+	for(size_t i = 0; i < m_models.size(); ++i)
+	{
+		models[i].m_fileName = addSceneString(m_models[i].m_fileName, &strings);
+
+		for(int j = 0; j < 3; ++j)
+		{
+			models[i].m_position[j] = m_models[i].m_position[j];
+			models[i].m_rotation[j] = m_models[i].m_rotation[j];
+			models[i].m_scale[j] = m_models[i].m_scale[j];
+		}
+	}
+
+	header.m_stringsSize = static_cast<uint32_t>(strings.size());
+
+	std::ofstream ofs(fileName.string().c_str(), std::ios_base::binary | std::ios_base::trunc);
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	if(!models.empty())
+		ofs.write(reinterpret_cast<const char*>(&models[0]), models.size() * sizeof(SceneBinaryModel));
+
+	ofs.write(strings.data(), strings.size());
+
+	if(!ofs)
+		throw SceneConfigExc("Cannot write " + fileName.string());
+}
+
+static std::string getSceneString(const SceneBinaryString& s, const char* strings, uint32_t stringsSize, bool* valid)
+{
+	if(s.m_offset > stringsSize || s.m_length > stringsSize - s.m_offset)
+	{
+		*valid = false;
+		return std::string();
+	}
+
+	return std::string(strings + s.m_offset, s.m_length);
+}
+
+SceneConfig SceneConfig::loadBinary(const boost::filesystem::path& fileName)
+{
+	MappedFile file(fileName);
+
+	if(!file.isOpen())
+		throw SceneConfigExc("Cannot open " + fileName.string());
+
+	const char* data = static_cast<const char*>(file.getData());
+	const size_t size = file.getSize();
+	SceneBinaryHeader header;
+
+	if(size < sizeof(header))
+		throw SceneConfigExc(fileName.string() + ": truncated scene");
+
+	memcpy(&header, data, sizeof(header));
+
+	if(memcmp(header.m_magic, SCENECONFIG_MAGIC, sizeof(header.m_magic)) != 0)
+		throw SceneConfigExc(fileName.string() + ": not a binary scene");
+
+	if(header.m_numModels == 0)
+		throw SceneConfigExc(fileName.string() + ": no models");
+
+	const size_t modelsSize = static_cast<size_t>(header.m_numModels) * sizeof(SceneBinaryModel);
+
+	if(modelsSize / sizeof(SceneBinaryModel) != header.m_numModels ||
+	   size - sizeof(header) < modelsSize || size - sizeof(header) - modelsSize != header.m_stringsSize)
+		throw SceneConfigExc(fileName.string() + ": truncated scene");
+
+	const char* models = data + sizeof(header);
+	const char* strings = models + modelsSize;
+	bool valid = true;
+
+	SceneConfig scene;
+	scene.m_shaderFileName = getSceneString(header.m_shaderFileName, strings, header.m_stringsSize, &valid);
+	scene.m_models.resize(header.m_numModels);
+
+	for(uint32_t i = 0; i < header.m_numModels; ++i)
+	{
+		SceneBinaryModel model;
+		memcpy(&model, models + i * sizeof(SceneBinaryModel), sizeof(model));
+		scene.m_models[i].m_fileName = getSceneString(model.m_fileName, strings, header.m_stringsSize, &valid);
+		scene.m_models[i].m_position = ci::Vec3f(model.m_position[0], model.m_position[1], model.m_position[2]);
+		scene.m_models[i].m_rotation = ci::Vec3f(model.m_rotation[0], model.m_rotation[1], model.m_rotation[2]);
+		scene.m_models[i].m_scale = ci::Vec3f(model.m_scale[0], model.m_scale[1], model.m_scale[2]);
+	}
+
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+	{
+		scene.m_textureFileNames[slot] = getSceneString(header.m_textureFileNames[slot], strings, header.m_stringsSize, &valid);
+		scene.m_texturePowers[slot] = header.m_texturePowers[slot];
+	}
+
+	scene.m_matAmbient = ci::Vec3f(header.m_matAmbient[0], header.m_matAmbient[1], header.m_matAmbient[2]);
+	scene.m_matDiffuse = ci::Vec3f(header.m_matDiffuse[0], header.m_matDiffuse[1], header.m_matDiffuse[2]);
+	scene.m_matSpecular = ci::Vec3f(header.m_matSpecular[0], header.m_matSpecular[1], header.m_matSpecular[2]);
+	scene.m_matShininess = header.m_matShininess;
+	scene.m_gamma = header.m_gamma;
+
+	if(!valid)
+		throw SceneConfigExc(fileName.string() + ": string outside of the string table");
+
+	return scene;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include "cinder/gl/GlslProg.h"
+#include "ProgramBinaryCache.h"
+
+typedef std::shared_ptr<class ShaderPermutations> ShaderPermutationsRef;
+
+// Variants of one shader specialized with #defines, compiled on first use and cached by permutation key.
+// The key holds a bit per feature define, the light count and whether the skinned vertex shader is used.
+class ShaderPermutations
+{
+public:
+	// Called with every newly linked variant, e.g. to set uniforms that never change.
+	typedef std::function<void(const ci::gl::GlslProgRef&)> SetupFn;
+
+	static ShaderPermutationsRef create(const std::string& vertexSource, const std::string& skinnedVertexSource,
+	                                    const std::string& fragmentSource, const std::vector<std::string>& features,
+	                                    const SetupFn& setup = SetupFn())
+	{
+		return ShaderPermutationsRef(new ShaderPermutations(vertexSource, skinnedVertexSource, fragmentSource, features, setup));
+	}
+
+	static uint32_t makeKey(uint32_t featureMask, int numLights, bool skinned);
+
+	// Returns the variant of key, throws gl::GlslProgCompileExc if it fails to compile.
+	ci::gl::GlslProgRef get(uint32_t key);
+
+	// Loads and stores the linked variants through cache, compiles every variant from source if not set.
+	void setBinaryCache(const ProgramBinaryCacheRef& cache)
+	{
+		m_binaryCache = cache;
+	}
+
+	bool hasSkinnedVariant() const
+	{
+		return !m_skinnedVertexSource.empty();
+	}
+
+	size_t getNumCompiled() const
+	{
+		return m_programs.size();
+	}
+
+	// Returns the #defines of key, as inserted after the #version line.
+	std::string getDefines(uint32_t key) const;
+
+private:
+	ShaderPermutations(const std::string& vertexSource, const std::string& skinnedVertexSource,
+	                   const std::string& fragmentSource, const std::vector<std::string>& features, const SetupFn& setup);
+	ShaderPermutations(ShaderPermutations const&);
+	void operator=(ShaderPermutations const&);
+
+	static std::string insertDefines(const std::string& source, const std::string& defines);
+
+	std::string m_vertexSource;
+	std::string m_skinnedVertexSource;
+	std::string m_fragmentSource;
+	std::vector<std::string> m_features;
+	SetupFn m_setup;
+	ProgramBinaryCacheRef m_binaryCache;
+	std::map<uint32_t, ci::gl::GlslProgRef> m_programs;
+};
+
+#define SHADERPERMUTATIONS_LIGHT_SHIFT 16
+#define SHADERPERMUTATIONS_SKINNED_BIT (1u << 31)
+
+ShaderPermutations::ShaderPermutations(const std::string& vertexSource, const std::string& skinnedVertexSource,
+                                       const std::string& fragmentSource, const std::vector<std::string>& features,
+                                       const SetupFn& setup)
+{
+	m_vertexSource = vertexSource;
+	m_skinnedVertexSource = skinnedVertexSource;
+	m_fragmentSource = fragmentSource;
+	m_features = features;
+	m_setup = setup;
+}
+
+uint32_t ShaderPermutations::makeKey(uint32_t featureMask, int numLights, bool skinned)
+{
+	uint32_t key = featureMask & ((1u << SHADERPERMUTATIONS_LIGHT_SHIFT) - 1);
+	key |= (static_cast<uint32_t>(numLights) & 0xff) << SHADERPERMUTATIONS_LIGHT_SHIFT;
+
+	if(skinned)
+		key |= SHADERPERMUTATIONS_SKINNED_BIT;
+
+	return key;
+}
+
+std::string ShaderPermutations::getDefines(uint32_t key) const
+{
+	std::string defines;
+
+	for(size_t i = 0; i < m_features.size(); ++i)
+	{
+		if(key & (1u << i))
+			defines += "#define " + m_features[i] + "\n";
+	}
+
+	int numLights = (key >> SHADERPERMUTATIONS_LIGHT_SHIFT) & 0xff;
+	defines += "#define NUM_LIGHTS " + std::to_string(static_cast<long long>(numLights)) + "\n";
+
+	if(key & SHADERPERMUTATIONS_SKINNED_BIT)
+		defines += "#define SKINNED\n";
+
+	return defines;
+}
+
+std::string ShaderPermutations::insertDefines(const std::string& source, const std::string& defines)
+{
+	// #version has to stay first, #extension may follow the defines
+	size_t pos = 0;
+
+	if(source.compare(0, 8, "#version") == 0)
+	{
+		pos = source.find('\n');
+		pos = (pos == std::string::npos) ? source.size() : pos + 1;
+	}
+
+	std::string result = source;
+	result.insert(pos, defines);
+	return result;
+}
+
+ci::gl::GlslProgRef ShaderPermutations::get(uint32_t key)
+{
+	std::map<uint32_t, ci::gl::GlslProgRef>::const_iterator it = m_programs.find(key);
+
+	if(it != m_programs.end())
+		return it->second;
+
+	const bool skinned = (key & SHADERPERMUTATIONS_SKINNED_BIT) && hasSkinnedVariant();
+	const std::string defines = getDefines(key);
+	const std::string vertex = insertDefines(skinned ? m_skinnedVertexSource : m_vertexSource, defines);
+	const std::string fragment = insertDefines(m_fragmentSource, defines);
+
+	ci::gl::GlslProgRef program;
+
+	if(m_binaryCache)
+		program = m_binaryCache->get(vertex, fragment);
+	else
+		program = ci::gl::GlslProg::create(vertex.c_str(), fragment.c_str());
+
+	if(m_setup)
+		m_setup(program);
+
+	m_programs[key] = program;
+	return program;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include "cinder/gl/gl.h"
+#include "cinder/gl/GlslProg.h"
+
+typedef std::shared_ptr<class UniformBuffer> UniformBufferRef;
+
+// Uniform buffer holding a std140 block, uploaded only when its contents change.
+class UniformBuffer
+{
+public:
+	static UniformBufferRef create(size_t size)
+	{
+		return UniformBufferRef(new UniformBuffer(size));
+	}
+
+	~UniformBuffer();
+
+	// Uploads size bytes from data unless they equal the last upload, returns true if uploaded.
+	bool update(const void* data);
+	void bind(GLuint binding);
+
+	// Assigns the block blockName of program to binding, returns false if the program has no such block.
+	static bool bindBlock(const ci::gl::GlslProgRef& program, const char* blockName, GLuint binding);
+
+private:
+	UniformBuffer(size_t size);
+	UniformBuffer(UniformBuffer const&);
+	void operator=(UniformBuffer const&);
+
+	GLuint m_buffer;
+	std::vector<char> m_data;
+	bool m_hasData;
+};
+
+UniformBuffer::UniformBuffer(size_t size)
+{
+	m_data.resize(size);
+	m_hasData = false;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &m_buffer);
+}
+
+bool UniformBuffer::update(const void* data)
+{
+	if(m_hasData && memcmp(&m_data[0], data, m_data.size()) == 0)
+		return false;
+
+	memcpy(&m_data[0], data, m_data.size());
+	m_hasData = true;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, m_data.size(), &m_data[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return true;
+}
+
+void UniformBuffer::bind(GLuint binding)
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_buffer);
+}
+
+bool UniformBuffer::bindBlock(const ci::gl::GlslProgRef& program, const char* blockName, GLuint binding)
+{
+	GLuint block = glGetUniformBlockIndex(program->getHandle(), blockName);
+
+	if(block == GL_INVALID_INDEX)
+		return false;
+
+	glUniformBlockBinding(program->getHandle(), block, binding);
+	return true;
+}
+
+#endif
@@ -7,10 +7,17 @@
 #include "cinder/gl/GlslProg.h"
 #include "cinder/gl/Light.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/Timer.h"
 #include "Debug.h"
 #include "FileMonitor.h"
+#include "FileFingerprint.h"
 #include "Config.h"
+#include "SceneConfig.h"
+#include "UniformBuffer.h"
+#include "ShaderPermutations.h"
+#include "ProgramBinaryCache.h"
 #include "AssimpLoader.h"
+#include "Trace.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -21,6 +28,91 @@ using namespace mndl::assimp;
 #define DBG_INFO "Info"
 #define DBG_ERROR "Error"
 
+// Uniform buffer binding of the MeshConstants block, 0 is the bone palette of GPU skinning
+#define MESH_CONSTANTS_BINDING 1
+// Lights enabled while drawing the model, the loop count of the shader variants
+#define MESH_NUM_LIGHTS 2
+// No shader variant selected, the light count of a permutation key is never 0xff
+#define SHADER_KEY_NONE 0xffffffffu
+
+// Shader permutation feature bits, in the order of the defines passed to ShaderPermutations
+enum ShaderFeature
+{
+	SHADER_DIFFUSE = 1 << 0,
+	SHADER_NORMAL = 1 << 1,
+	SHADER_SPECULAR = 1 << 2,
+	SHADER_AO = 1 << 3,
+	SHADER_EMISSIVE = 1 << 4
+};
+
+// std140 layout of the MeshConstants block in mesh.frag
+struct MeshConstants
+{
+	Vec3f materialKa;
+	float gamma;
+	Vec3f materialKd;
+	float materialShininess;
+	Vec3f materialKs;
+	float texEmissivePower;
+
+	float texDiffusePower;
+	float texNormalPower;
+	float texSpecularPower;
+	float texAOPower;
+};
+
+// A file the scene was loaded from, reloaded on its own when it changes
+enum AssetType
+{
+	ASSET_CONFIG,
+	ASSET_MODEL,
+	ASSET_TEXTURE,
+	ASSET_SHADER
+};
+
+struct AssetDependency
+{
+	AssetType m_type;
+	fs::path m_path; // watched once, however many models or texture slots use it
+	FileMonitorRef m_monitor;
+};
+
+// A model file of the scene, imported on a worker thread
+struct ModelLoadTask
+{
+	fs::path m_path;
+	AssimpModelRef m_model;
+	std::string m_error;
+};
+
+static void addUpdateStats(const std::vector< AssimpLoader >& loaders, mndl::assimp::UpdateStats* stats)
+{
+	for(std::vector< AssimpLoader >::const_iterator it = loaders.begin(); it != loaders.end(); ++it)
+	{
+		const mndl::assimp::UpdateStats& loaderStats = it->getUpdateStats();
+		stats->mMeshesSkinned += loaderStats.mMeshesSkinned;
+		stats->mMeshesSkipped += loaderStats.mMeshesSkipped;
+		stats->mMeshesCulled += loaderStats.mMeshesCulled;
+		stats->mVerticesSkinned += loaderStats.mVerticesSkinned;
+		stats->mVerticesSkipped += loaderStats.mVerticesSkipped;
+		stats->mVerticesCulled += loaderStats.mVerticesCulled;
+	}
+}
+
+static void loadModelTask(void* context, size_t task)
+{
+	ModelLoadTask& load = static_cast< ModelLoadTask* >(context)[ task ];
+	MNDL_TRACE_SCOPE("loadModelTask");
+	try
+	{
+		load.m_model = AssimpModel::load(load.m_path, false);
+	}
+	catch(const std::exception& e)
+	{
+		load.m_error = e.what();
+	}
+}
+
 class MeshViewApp : public AppNative
 {
 public:
@@ -37,8 +129,32 @@ public:
 
 private:
 	void loadConfig(const std::string& fileName, bool isReload = false);
+	void saveBinaryConfig();
+	void loadModels(const std::vector< SceneModel >& models);
+	void loadTexture(size_t slot, const std::string& fileName);
+	void addDependency(AssetType type, const fs::path& path, std::vector< AssetDependency >* dependencies);
+	void updateDependencies();
+	void reloadChangedAssets();
+	gl::TextureRef& getTexture(size_t slot);
+	float& getTexturePower(size_t slot);
+	bool& getTextureEnabled(size_t slot);
 	void setupCamera(bool inTheMiddleOfY = false);
 	void loadShader(const std::string& fileName);
+	void setupShader(const gl::GlslProgRef& shader);
+	void updateShader();
+	void fillMeshConstants(MeshConstants* constants) const;
+	void runBenchmarks();
+	void benchmarkUniforms();
+	void benchmarkFileChecks();
+	void benchmarkConfig();
+	void writeTrace();
+	void updateInstances();
+	void updateLoader(AssimpLoader& loader, double time);
+	AxisAlignedBox3f getSceneBounds();
+	SkinningMode getSkinningMode() const
+	{
+		return (m_gpuSkinning && m_shaders && m_shaders->hasSkinnedVariant()) ? SKINNING_GPU : SKINNING_CPU;
+	}
 	bool isInitialized() const
 	{
 		return (m_shader && m_assimpLoader.getNumMeshes() > 0);
@@ -50,6 +166,10 @@ private:
 	gl::Light* m_light1;
 	gl::Light* m_light2;
 	gl::GlslProgRef m_shader;
+	ShaderPermutationsRef m_shaders;
+	ProgramBinaryCacheRef m_programCache;
+	uint32_t m_shaderKey;
+	UniformBufferRef m_meshConstants;
 	gl::TextureRef m_texDiffuse;
 	gl::TextureRef m_texNormal;
 	gl::TextureRef m_texSpecular;
@@ -59,9 +179,7 @@ private:
 	Vec3f m_matDiffuse;
 	Vec3f m_matSpecular;
 	float m_matShininess;
-	FileMonitorRef m_fileMonitorVert;
-	FileMonitorRef m_fileMonitorFrag;
-	FileMonitorRef m_fileMonitorConfig;
+	std::vector< AssetDependency > m_dependencies;
 	params::InterfaceGlRef m_params;
 	bool m_diffuseEnabled;
 	bool m_aoEnabled;
@@ -75,10 +193,27 @@ private:
 	float m_texEmissivePower;
 	float m_gamma;
 	bool m_rotateMesh;
+	bool m_animationEnabled;
+	bool m_skinningEnabled;
+	bool m_skinningOverlap;
+	bool m_gpuSkinning;
+	bool m_bakedAnimation;
+	bool m_cullingEnabled;
+	int m_skinningThreads;
+	bool m_traceEnabled;
+	bool m_traceRecorded; // written at exit if anything has been recorded
 	float m_time;
+	double m_animationTime;
+	int m_numInstances;
 	AssimpLoader m_assimpLoader;
+	std::vector< AssimpLoader > m_instances;
+	std::vector< AssimpLoader > m_sceneLoaders; // models of the scene after the first one, m_assimpLoader
+	RenderQueueRef m_renderQueue;
 	std::string m_configFileName;
 	std::string m_shaderFileName;
+	std::vector< SceneModel > m_models;
+	std::string m_textureFileNames[ TEXTURE_COUNT ];
+	std::map< std::string, std::weak_ptr< gl::Texture > > m_textureCache; // textures in use by file name
 };
 
 void MeshViewApp::prepareSettings(Settings* settings)
@@ -92,6 +227,28 @@ void MeshViewApp::prepareSettings(Settings* settings)
 
 void MeshViewApp::setup()
 {
+	m_animationEnabled = false;
+	m_skinningEnabled = false;
+	m_skinningOverlap = false;
+	m_gpuSkinning = false;
+	m_bakedAnimation = false;
+	m_cullingEnabled = true;
+	m_skinningThreads = std::max<int>(std::thread::hardware_concurrency(), 2) - 1;
+	m_animationTime = 0.0;
+	m_numInstances = 1;
+	m_shaderKey = SHADER_KEY_NONE;
+	m_programCache = ProgramBinaryCache::create(getTemporaryDirectory() / "MeshViewShaderCache");
+	m_renderQueue = RenderQueue::create();
+	m_meshConstants = UniformBuffer::create(sizeof(MeshConstants));
+
+	// Set MESHVIEW_TRACE to trace the loading of the first config as well
+	const char* trace = std::getenv("MESHVIEW_TRACE");
+	m_traceEnabled = trace && *trace && std::string(trace) != "0";
+	m_traceRecorded = m_traceEnabled;
+	Trace::enable(m_traceEnabled);
+	if(m_traceEnabled)
+		Trace::setThreadName("main");
+
 	loadConfig("configs/gaztank.ini");
 
 	setupCamera();
@@ -121,8 +278,11 @@ void MeshViewApp::setup()
 	m_params = params::InterfaceGl::create(getWindow(), "Properties", Vec2i(180, 240));
 	m_params->addText("LMB + drag - rotate");
 	m_params->addText("RMB + drag - zoom");
+	m_params->addText("B - benchmark");
+	m_params->addText("T - write trace");
 	m_params->addSeparator();
 	m_params->addButton("Full screen", [&] { setFullScreen(!isFullScreen()); });
+	m_params->addButton("Save binary config", [&] { saveBinaryConfig(); });
 	m_params->addParam("Auto rotate", &m_rotateMesh);
 	m_params->addSeparator();
 	m_params->addParam("Diffuse", &m_diffuseEnabled);
@@ -132,12 +292,32 @@ void MeshViewApp::setup()
 	m_params->addParam("Emissive", &m_emissiveEnabled);
 	m_params->addSeparator();
 	m_params->addParam("Gamma", &m_gamma, "min=0.0 max=10.0 step=0.1");
+	m_params->addSeparator();
+	m_params->addParam("Animation", &m_animationEnabled);
+	m_params->addParam("Skinning", &m_skinningEnabled);
+	m_params->addParam("Skinning threads", &m_skinningThreads, "min=0 max=32");
+	m_params->addParam("Skinning overlap", &m_skinningOverlap);
+	m_params->addParam("GPU skinning", &m_gpuSkinning);
+	m_params->addParam("Baked animation", &m_bakedAnimation);
+	m_params->addParam("Culling", &m_cullingEnabled);
+	m_params->addParam("Instances", &m_numInstances, "min=1 max=1024");
+	m_params->addParam("Trace", &m_traceEnabled);
 
 	m_time = (float)getElapsedSeconds();
 }
 
 void MeshViewApp::shutdown()
 {
+	if(m_programCache && m_programCache->isSupported())
+	{
+		console() << "Shader cache: " << m_programCache->getNumHits() << " programs loaded, "
+		          << m_programCache->getNumMisses() << " compiled, "
+		          << m_programCache->getSecondsSaved() * 1000.0 << " ms compile time saved" << std::endl;
+	}
+
+	if(m_traceRecorded)
+		writeTrace();
+
 	// Safely delete lights
 	if(m_light1)
 	{
@@ -154,6 +334,9 @@ void MeshViewApp::shutdown()
 
 void MeshViewApp::loadConfig(const std::string& fileName, bool isReload)
 {
+	MNDL_TRACE_SCOPE("loadConfig");
+	Timer timer(true);
+
 	try
 	{
 		if (fs::exists(fileName))
@@ -161,103 +344,369 @@ void MeshViewApp::loadConfig(const std::string& fileName, bool isReload)
 		else
 			m_configFileName = getAssetPath(fileName).string();
 
-		m_fileMonitorConfig = FileMonitor::create(m_configFileName);
-
-		Config cfg(m_configFileName);
-		m_shaderFileName = cfg.getString("Shader", "FileName");
-		loadShader(m_shaderFileName);
+		SceneConfig scene = SceneConfig::load(m_configFileName);
 
-		if (!isReload)
+		// A reload only loads again what the config now names differently
+		if(!isReload || scene.m_shaderFileName != m_shaderFileName)
 		{
-			m_assimpLoader = AssimpLoader(getAssetPath(cfg.getString("Model", "FileName")), false);
-			m_assimpLoader.setAnimation(0);
-			m_assimpLoader.enableTextures(false);
-			m_assimpLoader.enableSkinning(false);
-			m_assimpLoader.enableAnimation(false);
-			m_assimpLoader.enableMaterials(false);
+			m_shaderFileName = scene.m_shaderFileName;
+			loadShader(m_shaderFileName);
 		}
 
-		cfg.setSection("Textures");
+		bool sameFiles = isReload && scene.m_models.size() == m_models.size();
+		for(size_t i = 0; sameFiles && i < m_models.size(); ++i)
+			sameFiles = scene.m_models[ i ].m_fileName == m_models[ i ].m_fileName;
 
-		if(m_texDiffuse)
-			m_texDiffuse = NULL;
-		if (m_texNormal)
-			m_texNormal = NULL;
-		if (m_texSpecular)
-			m_texSpecular = NULL;
-		if(m_texAO)
-			m_texAO = NULL;
-		if(m_texEmissive)
-			m_texEmissive = NULL;
-
-		m_texDiffusePower = 1.0f;
-		m_texNormalPower = 1.0f;
-		m_texSpecularPower = 1.0f;
-		m_texAOPower = 1.0f;
-		m_texEmissivePower = 1.0f;
-
-		m_diffuseEnabled = false;
-		m_normalEnabled = false;
-		m_specularEnabled = false;
-		m_aoEnabled = false;
-		m_emissiveEnabled = false;
-
-		std::string diffuseFileName = cfg.getString("Diffuse");
-		if(diffuseFileName != std::string())
+		if(!sameFiles)
 		{
-			m_texDiffuse = gl::Texture::create(loadImage(loadAsset(diffuseFileName)));
-			m_texDiffusePower = cfg.getFloat("DiffusePower");
-			m_diffuseEnabled = true;
+			loadModels(scene.m_models);
+		}
+		else
+		{
+			// Only moved, the loaders are kept in the order of the models
+			m_models = scene.m_models;
+			m_assimpLoader.setTransform(m_models[ 0 ].getTransform());
+			for(size_t i = 0; i < m_sceneLoaders.size(); ++i)
+				m_sceneLoaders[ i ].setTransform(m_models[ i + 1 ].getTransform());
+			m_instances.clear();
 		}
 
-		std::string normalFileName = cfg.getString("Normal");
-		if (normalFileName != std::string())
+		for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
 		{
-			m_texNormal = gl::Texture::create(loadImage(loadAsset(normalFileName)));
-			m_texNormalPower = cfg.getFloat("NormalPower");
-			m_normalEnabled = true;
+			if(!isReload || scene.m_textureFileNames[ slot ] != m_textureFileNames[ slot ])
+				loadTexture(slot, scene.m_textureFileNames[ slot ]);
+
+			getTexturePower(slot) = scene.m_texturePowers[ slot ];
 		}
 
-		std::string specularFileName = cfg.getString("Specular");
-		if (specularFileName != std::string())
+		m_matAmbient = scene.m_matAmbient;
+		m_matDiffuse = scene.m_matDiffuse;
+		m_matSpecular = scene.m_matSpecular;
+		m_matShininess = scene.m_matShininess;
+		m_gamma = scene.m_gamma;
+	}
+	catch(const std::exception& e)
+	{
+		console() << "Failed to load assets:" << std::endl;
+		console() << e.what();
+	}
+
+	updateDependencies();
+
+	std::string config = toString(timer.getSeconds() * 1000.0) + " ms";
+	console() << (isReload ? "Reloaded config: " : "Loaded config: ") << config << std::endl;
+	DBG("Config", config);
+}
+
+void MeshViewApp::saveBinaryConfig()
+{
+	// Written next to the .ini, loaded from there by dropping it on the window
+	fs::path fileName = fs::path(m_configFileName).replace_extension(".scn");
+
+	try
+	{
+		SceneConfig::load(m_configFileName).writeBinary(fileName);
+		console() << "Saved binary config " << fileName.string() << std::endl;
+		DBG(DBG_INFO, "Saved " + fileName.filename().string());
+	}
+	catch(const std::exception& e)
+	{
+		console() << "Failed to save binary config:" << std::endl;
+		console() << e.what() << std::endl;
+		DBG(DBG_ERROR, "Failed to save binary config");
+	}
+}
+
+void MeshViewApp::loadModels(const std::vector< SceneModel >& models)
+{
+	MNDL_TRACE_SCOPE("loadModels");
+	Timer timer(true);
+
+	// Every file once, models placed several times share their geometry and buffers
+	std::vector< ModelLoadTask > tasks;
+	std::vector< size_t > modelTasks(models.size());
+	for(size_t i = 0; i < models.size(); ++i)
+	{
+		fs::path path = getAssetPath(models[ i ].m_fileName);
+		size_t task = 0;
+		while(task < tasks.size() && tasks[ task ].m_path != path)
+			++task;
+		if(task == tasks.size())
 		{
-			m_texSpecular = gl::Texture::create(loadImage(loadAsset(specularFileName)));
-			m_texSpecularPower = cfg.getFloat("SpecularPower");
-			m_specularEnabled = true;
+			tasks.push_back(ModelLoadTask());
+			tasks.back().m_path = path;
 		}
+		modelTasks[ i ] = task;
+	}
 
-		std::string aoFileName = cfg.getString("AO");
-		if(aoFileName != std::string())
+	if(tasks.empty())
+		return;
+
+	// Imported in parallel, AssimpModel returns the files that did not change since the last load from its cache
+	size_t numThreads = std::min< size_t >(tasks.size(), std::max< unsigned >(std::thread::hardware_concurrency(), 1));
+	WorkerPoolRef pool = WorkerPool::create(numThreads - 1);
+	WorkerJob job;
+	job.set(loadModelTask, &tasks[ 0 ], tasks.size());
+	pool->run(job);
+
+	// The previous scene stays unless every model loaded
+	std::string errors;
+	for(size_t i = 0; i < tasks.size(); ++i)
+	{
+		if(!tasks[ i ].m_model)
+			errors += tasks[ i ].m_path.string() + ": " + tasks[ i ].m_error + "\n";
+	}
+	if(!errors.empty())
+		throw std::runtime_error(errors);
+	double loadTime = timer.getSeconds();
+
+	m_models = models;
+	m_assimpLoader = AssimpLoader(tasks[ modelTasks[ 0 ] ].m_model);
+	m_assimpLoader.setTransform(models[ 0 ].getTransform());
+	m_assimpLoader.setAnimation(0);
+	m_assimpLoader.enableTextures(false);
+	m_assimpLoader.enableSkinning(m_skinningEnabled);
+	m_assimpLoader.enableAnimation(m_animationEnabled);
+	m_assimpLoader.enableSkinningOverlap(m_skinningOverlap);
+	m_assimpLoader.setNumSkinningThreads(m_skinningThreads);
+	m_assimpLoader.enableMaterials(false);
+	m_instances.clear();
+
+	// The other models follow the settings of the first one in updateLoader()
+	m_sceneLoaders.clear();
+	for(size_t i = 1; i < models.size(); ++i)
+	{
+		m_sceneLoaders.push_back(AssimpLoader(tasks[ modelTasks[ i ] ].m_model));
+		m_sceneLoaders.back().setTransform(models[ i ].getTransform());
+	}
+
+	std::string model = toString(timer.getSeconds() * 1000.0) + " ms (" + toString(loadTime * 1000.0) + " ms import), " +
+	                    toString(models.size()) + " models, " + toString(tasks.size()) + " files";
+	console() << "Loaded models: " << model << std::endl;
+	DBG("Models", model);
+}
+
+void MeshViewApp::loadTexture(size_t slot, const std::string& fileName)
+{
+	MNDL_TRACE_SCOPE("loadTexture");
+	Timer timer(true);
+
+	m_textureFileNames[ slot ] = fileName;
+	getTexture(slot) = gl::TextureRef();
+	getTextureEnabled(slot) = false;
+
+	if(fileName == std::string())
+		return;
+
+	// Slots naming the same file share one texture
+	gl::TextureRef cached = m_textureCache[ fileName ].lock();
+	if(cached)
+	{
+		getTexture(slot) = cached;
+		getTextureEnabled(slot) = true;
+		return;
+	}
+
+	try
+	{
+		getTexture(slot) = gl::Texture::create(loadImage(loadAsset(fileName)));
+		getTextureEnabled(slot) = true;
+		m_textureCache[ fileName ] = getTexture(slot);
+
+		std::string texture = toString(timer.getSeconds() * 1000.0) + " ms";
+		console() << "Loaded texture " << fileName << ": " << texture << std::endl;
+		DBG(std::string(s_textureKeys[ slot ]) + " texture", texture);
+	}
+	catch(const std::exception& e)
+	{
+		console() << "Failed to load texture " << fileName << ":" << std::endl;
+		console() << e.what() << std::endl;
+	}
+}
+
+gl::TextureRef& MeshViewApp::getTexture(size_t slot)
+{
+	switch(slot)
+	{
+	case TEXTURE_NORMAL:
+		return m_texNormal;
+	case TEXTURE_SPECULAR:
+		return m_texSpecular;
+	case TEXTURE_AO:
+		return m_texAO;
+	case TEXTURE_EMISSIVE:
+		return m_texEmissive;
+	default:
+		return m_texDiffuse;
+	}
+}
+
+float& MeshViewApp::getTexturePower(size_t slot)
+{
+	switch(slot)
+	{
+	case TEXTURE_NORMAL:
+		return m_texNormalPower;
+	case TEXTURE_SPECULAR:
+		return m_texSpecularPower;
+	case TEXTURE_AO:
+		return m_texAOPower;
+	case TEXTURE_EMISSIVE:
+		return m_texEmissivePower;
+	default:
+		return m_texDiffusePower;
+	}
+}
+
+bool& MeshViewApp::getTextureEnabled(size_t slot)
+{
+	switch(slot)
+	{
+	case TEXTURE_NORMAL:
+		return m_normalEnabled;
+	case TEXTURE_SPECULAR:
+		return m_specularEnabled;
+	case TEXTURE_AO:
+		return m_aoEnabled;
+	case TEXTURE_EMISSIVE:
+		return m_emissiveEnabled;
+	default:
+		return m_diffuseEnabled;
+	}
+}
+
+void MeshViewApp::addDependency(AssetType type, const fs::path& path, std::vector< AssetDependency >* dependencies)
+{
+	for(std::vector< AssetDependency >::const_iterator it = dependencies->begin(); it != dependencies->end(); ++it)
+	{
+		if(it->m_path == path)
+			return;
+	}
+
+	AssetDependency dependency;
+	dependency.m_type = type;
+	dependency.m_path = path;
+
+	// Files watched before keep their monitor and with it changes not handled yet
+	for(std::vector< AssetDependency >::const_iterator it = m_dependencies.begin(); it != m_dependencies.end(); ++it)
+	{
+		if(it->m_path == path)
 		{
-			m_texAO = gl::Texture::create(loadImage(loadAsset(aoFileName)));
-			m_texAOPower = cfg.getFloat("AOPower");
-			m_aoEnabled = true;
+			dependency.m_monitor = it->m_monitor;
+			break;
 		}
+	}
+	if(!dependency.m_monitor)
+		dependency.m_monitor = FileMonitor::create(path);
+
+	dependencies->push_back(dependency);
+}
+
+void MeshViewApp::updateDependencies()
+{
+	// The config names the model, the textures and the shader, the shader its stages
+	std::vector< AssetDependency > dependencies;
+	addDependency(ASSET_CONFIG, m_configFileName, &dependencies);
+	for(size_t i = 0; i < m_models.size(); ++i)
+		addDependency(ASSET_MODEL, getAssetPath(m_models[ i ].m_fileName), &dependencies);
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+	{
+		if(m_textureFileNames[ slot ] != std::string())
+			addDependency(ASSET_TEXTURE, getAssetPath(m_textureFileNames[ slot ]), &dependencies);
+	}
+	const char* shaderStages[] = { ".vert", ".frag", "_skinned.vert" };
+	for(size_t i = 0; i < sizeof(shaderStages) / sizeof(shaderStages[0]); ++i)
+	{
+		fs::path stage = getAssetPath(m_shaderFileName + shaderStages[ i ]);
+		if(!stage.empty())
+			addDependency(ASSET_SHADER, stage, &dependencies);
+	}
 
-		std::string emissiveFileName = cfg.getString("Emissive");
-		if(emissiveFileName != std::string())
+	m_dependencies.swap(dependencies);
+}
+
+void MeshViewApp::reloadChangedAssets()
+{
+	MNDL_TRACE_SCOPE("reloadChangedAssets");
+
+	// Every changed file is asked for first, the reloads rebuild the dependencies
+	bool configChanged = false;
+	bool modelChanged = false;
+	bool shaderChanged = false;
+	std::vector< fs::path > texturesChanged;
+	for(std::vector< AssetDependency >::const_iterator it = m_dependencies.begin(); it != m_dependencies.end(); ++it)
+	{
+		if(!it->m_monitor->hasChanged())
+			continue;
+
+		switch(it->m_type)
 		{
-			m_texEmissive = gl::Texture::create(loadImage(loadAsset(emissiveFileName)));
-			m_texEmissivePower = cfg.getFloat("EmissivePower");
-			m_emissiveEnabled = true;
+		case ASSET_CONFIG:
+			configChanged = true;
+			break;
+		case ASSET_MODEL:
+			modelChanged = true;
+			break;
+		case ASSET_TEXTURE:
+			texturesChanged.push_back(it->m_path);
+			break;
+		case ASSET_SHADER:
+			shaderChanged = true;
+			break;
 		}
+	}
+
+	if(configChanged)
+		loadConfig(m_configFileName, true);
 
-		cfg.setSection("Material");
-		m_matAmbient = cfg.getVec3f("Ambient");
-		m_matDiffuse = cfg.getVec3f("Diffuse");
-		m_matSpecular = cfg.getVec3f("Specular");
-		m_matShininess = cfg.getFloat("Shininess");
-		m_gamma = cfg.getFloat("Gamma");
+	if(modelChanged)
+	{
+		try
+		{
+			loadModels(m_models);
+		}
+		catch(const std::exception& e)
+		{
+			console() << "Failed to reload models:" << std::endl;
+			console() << e.what();
+		}
 	}
-	catch(const std::exception& e)
+
+	// Slots showing a changed file load it again, the first one past the cache
+	for(size_t i = 0; i < texturesChanged.size(); ++i)
 	{
-		console() << "Failed to load assets:" << std::endl;
-		console() << e.what();
+		bool reloaded = false;
+		for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+		{
+			if(m_textureFileNames[ slot ] == std::string() || getAssetPath(m_textureFileNames[ slot ]) != texturesChanged[ i ])
+				continue;
+
+			if(!reloaded)
+				m_textureCache.erase(m_textureFileNames[ slot ]);
+			reloaded = true;
+			loadTexture(slot, m_textureFileNames[ slot ]);
+		}
 	}
+
+	if(shaderChanged)
+	{
+		Timer timer(true);
+		loadShader(m_shaderFileName);
+		updateShader();
+
+		std::string shader = toString(timer.getSeconds() * 1000.0) + " ms";
+		console() << "Reloaded shader " << m_shaderFileName << ": " << shader << std::endl;
+		DBG("Shader", shader);
+	}
+
+	if(configChanged || modelChanged || shaderChanged)
+		updateDependencies();
 }
 
 void MeshViewApp::loadShader(const std::string& fileName)
 {
+	MNDL_TRACE_SCOPE("loadShader");
+
 	DBG_REMOVE(DBG_INFO);
 	DBG_REMOVE(DBG_ERROR);
 
@@ -266,37 +715,430 @@ void MeshViewApp::loadShader(const std::string& fileName)
 		std::string vertexFile = fileName + ".vert";
 		std::string fragmentFile = fileName + ".frag";
 
-		m_fileMonitorVert = FileMonitor::create(getAssetPath(vertexFile));
-		m_fileMonitorFrag = FileMonitor::create(getAssetPath(fragmentFile));
-		m_shader = gl::GlslProg::create(loadAsset(vertexFile), loadAsset(fragmentFile));
+		// Optional vertex shader blending the bones, used for GPU skinning
+		std::string skinnedVertexSource;
+		std::string skinnedVertexFile = fileName + "_skinned.vert";
+		if(!getAssetPath(skinnedVertexFile).empty())
+			skinnedVertexSource = loadString(loadAsset(skinnedVertexFile));
+
+		// Variants are compiled on first use, in the order of ShaderFeature
+		std::vector<std::string> features;
+		features.push_back("DIFFUSE_MAP");
+		features.push_back("NORMAL_MAP");
+		features.push_back("SPECULAR_MAP");
+		features.push_back("AO_MAP");
+		features.push_back("EMISSIVE_MAP");
+
+		m_shaders = ShaderPermutations::create(loadString(loadAsset(vertexFile)), skinnedVertexSource,
+		                                       loadString(loadAsset(fragmentFile)), features,
+		                                       [this](const gl::GlslProgRef& shader) { setupShader(shader); });
+		m_shaders->setBinaryCache(m_programCache);
+
+		// The programs of the previous shader are deleted with it
+		m_renderQueue->forgetPrograms();
+	}
+	catch(const std::exception& e)
+	{
+		console() << "Shader load error:" << std::endl;
+		console() << e.what() << std::endl;
+		DBG(DBG_ERROR, std::string(e.what()));
+		return;
+	}
+
+	// The variant of the current toggles is compiled by the next update
+	m_shaderKey = SHADER_KEY_NONE;
+}
+
+void MeshViewApp::updateShader()
+{
+	if(!m_shaders)
+		return;
+
+	uint32_t features = 0;
+	features |= m_diffuseEnabled ? SHADER_DIFFUSE : 0;
+	features |= m_normalEnabled ? SHADER_NORMAL : 0;
+	features |= m_specularEnabled ? SHADER_SPECULAR : 0;
+	features |= m_aoEnabled ? SHADER_AO : 0;
+	features |= m_emissiveEnabled ? SHADER_EMISSIVE : 0;
+	// the skinned variant blends the bones on the GPU
+	bool skinned = m_skinningEnabled && getSkinningMode() == SKINNING_GPU;
+	uint32_t key = ShaderPermutations::makeKey(features, MESH_NUM_LIGHTS, skinned);
+
+	if(key == m_shaderKey)
+		return;
+
+	// A variant that fails to compile is not retried until the toggles or the sources change
+	m_shaderKey = key;
+
+	try
+	{
+		m_shader = m_shaders->get(key);
 		const std::string log = m_shader->getShaderLog(m_shader->getHandle());
 
+		DBG_REMOVE(DBG_INFO);
 		if(log != std::string())
-			DBG(DBG_INFO, m_shader->getShaderLog(m_shader->getHandle()));
+			DBG(DBG_INFO, log);
+		DBG_REMOVE(DBG_ERROR);
 	}
 	catch(gl::GlslProgCompileExc& e)
 	{
-		console() << "Shader load or compile error:" << std::endl;
-		console() << e.what() << std::endl;
+		console() << "Shader compile error:" << std::endl;
+		console() << m_shaders->getDefines(key) << e.what() << std::endl;
 		DBG(DBG_ERROR, std::string(e.what()));
 	}
+
+	DBG("Shader variants", static_cast< int >(m_shaders->getNumCompiled()));
+	if(m_programCache->isSupported())
+	{
+		DBG("Shader cache", toString(m_programCache->getNumHits()) + " hits, " +
+		    toString(m_programCache->getNumMisses()) + " compiled, " +
+		    toString(static_cast< int >(m_programCache->getSecondsSaved() * 1000.0)) + " ms saved");
+	}
 }
 
-void MeshViewApp::update()
+void MeshViewApp::setupShader(const gl::GlslProgRef& shader)
 {
-	// Track the time
-	float elapsed = (float) getElapsedSeconds() - m_time;
-	m_time += elapsed;
+	// The texture units never change, the other constants come from the uniform buffer
+	shader->bind();
+	shader->uniform("texDiffuse", 0);
+	shader->uniform("texNormal", 1);
+	shader->uniform("texSpecular", 2);
+	shader->uniform("texAO", 3);
+	shader->uniform("texEmissive", 4);
+	shader->unbind();
+
+	if(!UniformBuffer::bindBlock(shader, "MeshConstants", MESH_CONSTANTS_BINDING))
+		DBG(DBG_ERROR, std::string("Shader has no MeshConstants block"));
+}
 
-	if (m_fileMonitorConfig->hasChanged())
+void MeshViewApp::fillMeshConstants(MeshConstants* constants) const
+{
+	*constants = MeshConstants();
+	constants->materialKa = m_matAmbient;
+	constants->gamma = m_gamma;
+	constants->materialKd = m_matDiffuse;
+	constants->materialShininess = m_matShininess;
+	constants->materialKs = m_matSpecular;
+	constants->texEmissivePower = m_texEmissivePower;
+	constants->texDiffusePower = m_texDiffusePower;
+	constants->texNormalPower = m_texNormalPower;
+	constants->texSpecularPower = m_texSpecularPower;
+	constants->texAOPower = m_texAOPower;
+}
+
+void MeshViewApp::benchmarkUniforms()
+{
+	// The constants as they were set every frame before the uniform buffer, a name lookup per uniform
+	static const char* uniformNames[] =
 	{
-		loadConfig(m_configFileName, true);
+		"texDiffuse", "texNormal", "texSpecular", "texAO", "texEmissive",
+		"texDiffusePower", "texNormalPower", "texSpecularPower", "texAOPower", "texEmissivePower",
+		"diffuseEnabled", "normalEnabled", "specularEnabled", "aoEnabled", "emissiveEnabled",
+		"material.Ka", "material.Kd", "material.Ks", "material.Shininess", "gamma"
+	};
+	const size_t numUniforms = sizeof(uniformNames) / sizeof(uniformNames[0]);
+	const int iterations = 10000;
+
+	m_shader->bind();
+
+	Timer timer(true);
+	for(int i = 0; i < iterations; ++i)
+	{
+		for(size_t n = 0; n < numUniforms; ++n)
+			m_shader->uniform(uniformNames[ n ], 1.0f);
+	}
+	double byName = timer.getSeconds();
+
+	// Unchanged constants only cost the comparison with the last upload
+	MeshConstants constants;
+	fillMeshConstants(&constants);
+	m_meshConstants->update(&constants);
+	timer.start();
+	for(int i = 0; i < iterations; ++i)
+	{
+		fillMeshConstants(&constants);
+		m_meshConstants->update(&constants);
+		m_meshConstants->bind(MESH_CONSTANTS_BINDING);
 	}
+	double unchanged = timer.getSeconds();
 
-	if(m_fileMonitorVert->hasChanged() || m_fileMonitorFrag->hasChanged())
+	timer.start();
+	for(int i = 0; i < iterations; ++i)
 	{
-		loadShader(m_shaderFileName);
+		fillMeshConstants(&constants);
+		constants.gamma += static_cast< float >(i & 1);
+		m_meshConstants->update(&constants);
+		m_meshConstants->bind(MESH_CONSTANTS_BINDING);
+	}
+	double changed = timer.getSeconds();
+
+	m_shader->unbind();
+
+	// Leave the actual values in the buffer
+	fillMeshConstants(&constants);
+	m_meshConstants->update(&constants);
+
+	std::string uniforms = toString(byName * 1.0e6 / iterations) + " us by name, " +
+	                       toString(unchanged * 1.0e6 / iterations) + " us unchanged, " +
+	                       toString(changed * 1.0e6 / iterations) + " us changed";
+	console() << "Uniforms per frame: " << uniforms << std::endl;
+	DBG("Uniforms", uniforms);
+}
+
+void MeshViewApp::benchmarkFileChecks()
+{
+	// The config, the model and its textures, as checked for changes when inotify is not available
+	std::vector< fs::path > files;
+	files.push_back(m_configFileName);
+	for(size_t i = 0; i < m_models.size(); ++i)
+		files.push_back(getAssetPath(m_models[ i ].m_fileName));
+	for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+	{
+		if(m_textureFileNames[ slot ] != std::string())
+			files.push_back(getAssetPath(m_textureFileNames[ slot ]));
+	}
+
+	const int iterations = 10;
+	double crcTotal = 0.0;
+	double stampTotal = 0.0;
+	double hashTotal = 0.0;
+	for(size_t i = 0; i < files.size(); ++i)
+	{
+		if(!fs::exists(files[ i ]))
+			continue;
+
+		// Full CRC32 through 1 KB reads, the check FileMonitor used to run every interval
+		Timer timer(true);
+		int crc = 0;
+		for(int n = 0; n < iterations; ++n)
+			crc += crcFile(files[ i ]);
+		double crcTime = timer.getSeconds() / iterations;
+
+		// Metadata only, all an unchanged file costs
+		timer.start();
+		uint64_t size = 0;
+		for(int n = 0; n < iterations * 100; ++n)
+			size += FileStamp::get(files[ i ]).m_size;
+		double stampTime = timer.getSeconds() / (iterations * 100);
+
+		// Mapped XXH64, once the metadata has changed
+		timer.start();
+		uint64_t hash = 0;
+		for(int n = 0; n < iterations; ++n)
+			hash += hashFile(files[ i ]);
+		double hashTime = timer.getSeconds() / iterations;
+
+		console() << files[ i ].filename().string() << " (" << fs::file_size(files[ i ]) / 1024 << " KB): crc "
+		          << crcTime * 1000.0 << " ms, stat " << stampTime * 1.0e6 << " us, hash " << hashTime * 1000.0 << " ms"
+		          << " [" << (crc ^ static_cast< int >(size ^ hash)) << "]" << std::endl;
+
+		crcTotal += crcTime;
+		stampTotal += stampTime;
+		hashTotal += hashTime;
+	}
+
+	std::string fileChecks = toString(crcTotal * 1000.0) + " ms crc, " + toString(stampTotal * 1.0e6) + " us stat, " +
+	                         toString(hashTotal * 1000.0) + " ms hash [" + toString(files.size()) + " files]";
+	console() << "File checks: " << fileChecks << std::endl;
+	DBG("File checks", fileChecks);
+}
+
+void MeshViewApp::benchmarkConfig()
+{
+	const int iterations = 100;
+	fs::path binaryFileName = getTemporaryDirectory() / "MeshViewBenchmark.scn";
+
+	try
+	{
+		// Property tree lookups of every value, as the config used to be read
+		Timer timer(true);
+		float sum = 0.0f;
+		for(int i = 0; i < iterations; ++i)
+		{
+			Config cfg(m_configFileName);
+			sum += cfg.getString("Shader", "FileName").size() + cfg.getString("Model", "FileName").size();
+			cfg.setSection("Textures");
+			for(size_t slot = 0; slot < TEXTURE_COUNT; ++slot)
+				sum += cfg.getString(s_textureKeys[ slot ]).size() + cfg.getFloat(std::string(s_textureKeys[ slot ]) + "Power");
+			cfg.setSection("Material");
+			sum += cfg.getVec3f("Ambient").x + cfg.getVec3f("Diffuse").x + cfg.getVec3f("Specular").x;
+			sum += cfg.getFloat("Shininess") + cfg.getFloat("Gamma");
+		}
+		double lookups = timer.getSeconds() / iterations;
+
+		// Parsed and validated once into SceneConfig
+		timer.start();
+		for(int i = 0; i < iterations; ++i)
+			sum += SceneConfig::parseIni(m_configFileName).m_gamma;
+		double parsed = timer.getSeconds() / iterations;
+
+		// Mapped binary form
+		SceneConfig::parseIni(m_configFileName).writeBinary(binaryFileName);
+		timer.start();
+		for(int i = 0; i < iterations; ++i)
+			sum += SceneConfig::loadBinary(binaryFileName).m_gamma;
+		double binary = timer.getSeconds() / iterations;
+		fs::remove(binaryFileName);
+
+		std::string config = toString(lookups * 1.0e6) + " us lookups, " +
+		                     toString(parsed * 1.0e6) + " us parsed, " +
+		                     toString(binary * 1.0e6) + " us binary";
+		console() << "Config read: " << config << " (" << sum << ")" << std::endl;
+		DBG("Config read", config);
+	}
+	catch(const std::exception& e)
+	{
+		console() << "Config benchmark failed:" << std::endl;
+		console() << e.what() << std::endl;
+	}
+}
+
+void MeshViewApp::runBenchmarks()
+{
+	if(!isInitialized())
+		return;
+
+	double verticesPerSecond = m_assimpLoader.benchmarkSkinning();
+	std::string skinning = toString(verticesPerSecond / 1.0e6) + " Mverts/s [" + getSkinningKernelName() + "]";
+	console() << "Skinning: " << skinning << std::endl;
+	DBG("Skinning", skinning);
+
+	if(m_assimpLoader.getBakedAnimation())
+	{
+		std::string baked = toString(m_assimpLoader.benchmarkBakedPlayback() / 1.0e6) + " Mverts/s";
+		console() << "Baked playback: " << baked << std::endl;
+		DBG("Baked playback", baked);
+	}
+
+	// Channel evaluation on the calling thread alone up to all worker threads
+	WorkerPoolRef workerPool = m_assimpLoader.getWorkerPool();
+	size_t maxThreads = std::max< size_t >(std::thread::hardware_concurrency(), 2) - 1;
+	std::string animation;
+	for(size_t numThreads = 0; numThreads <= maxThreads; ++numThreads)
+	{
+		m_assimpLoader.setNumSkinningThreads(numThreads);
+		double channelsPerMs = m_assimpLoader.benchmarkAnimation();
+		console() << "Animation [" << numThreads + 1 << " threads]: " << channelsPerMs << " channels/ms" << std::endl;
+		animation += (animation.empty() ? "" : ", ") + toString(static_cast< int >(channelsPerMs));
+	}
+	m_assimpLoader.setWorkerPool(workerPool);
+	DBG("Animation", animation + " channels/ms [1-" + toString(maxThreads + 1) + " threads]");
+
+	double charactersPerMs = m_assimpLoader.benchmarkCrowd();
+	std::string crowd = toString(charactersPerMs) + " characters/ms [" +
+	                    toString(m_assimpLoader.getNumSkinningThreads() + 1) + " threads]";
+	console() << "Crowd: " << crowd << std::endl;
+	DBG("Crowd", crowd);
+
+	benchmarkUniforms();
+	benchmarkFileChecks();
+	benchmarkConfig();
+}
+
+void MeshViewApp::writeTrace()
+{
+	// Open in chrome://tracing or ui.perfetto.dev
+	fs::path fileName = getTemporaryDirectory() / "MeshViewTrace.json";
+	size_t numEvents = Trace::write(fileName.string());
+	console() << "Trace: " << numEvents << " events written to " << fileName.string() << std::endl;
+	DBG("Trace", toString(numEvents) + " events, " + fileName.filename().string());
+}
+
+void MeshViewApp::updateInstances()
+{
+	// The loaded model is the first instance, the others share its geometry and buffers
+	size_t numInstances = static_cast< size_t >(std::max(m_numInstances, 1)) - 1;
+	if(m_instances.size() != numInstances)
+	{
+		m_instances.resize(std::min(m_instances.size(), numInstances));
+		while(m_instances.size() < numInstances)
+			m_instances.push_back(AssimpLoader(m_assimpLoader.getModel()));
+
+		// Lay the instances out on a grid next to the first one
+		Vec3f size = m_assimpLoader.getBoundingBox().getSize();
+		float spacing = std::max(size.x, size.z) * 1.25f;
+		size_t columns = static_cast< size_t >(ceil(sqrt(static_cast< float >(numInstances + 1))));
+		for(size_t i = 0; i < m_instances.size(); ++i)
+		{
+			size_t cell = i + 1;
+			m_instances[ i ].setTransform(Matrix44f::createTranslation(
+			                                  Vec3f((cell % columns) * spacing, 0.0f, (cell / columns) * spacing)) *
+			                              m_assimpLoader.getTransform());
+		}
+	}
+
+	// Every instance plays the animation a quarter second after the previous one
+	for(size_t i = 0; i < m_instances.size(); ++i)
+		updateLoader(m_instances[ i ], m_animationTime + (i + 1) * 0.25);
+
+	// The other models of the scene play their own first clip in step with the first model
+	for(size_t i = 0; i < m_sceneLoaders.size(); ++i)
+		updateLoader(m_sceneLoaders[ i ], m_animationTime);
+}
+
+void MeshViewApp::updateLoader(AssimpLoader& loader, double time)
+{
+	loader.setWorkerPool(m_assimpLoader.getWorkerPool());
+	loader.enableAnimation(m_animationEnabled);
+	loader.enableSkinning(m_skinningEnabled, getSkinningMode());
+	loader.enableSkinningOverlap(m_skinningOverlap);
+
+	// The baked clip belongs to the model of the first loader
+	if(loader.getModel() == m_assimpLoader.getModel())
+		loader.setBakedAnimation(m_assimpLoader.getBakedAnimation());
+	else
+		loader.setBakedAnimation(BakedAnimationRef());
+
+	if(m_cullingEnabled)
+		loader.setCullingFrustum(Frustumf(m_camera), m_matrix);
+	else
+		loader.disableCulling();
+
+	double duration = loader.getNumAnimations() > 0 ? loader.getAnimationDuration(0) : 0.0;
+	if(duration > 0.0)
+		time = fmod(time, duration);
+	loader.setTime(time);
+	loader.update();
+}
+
+AxisAlignedBox3f MeshViewApp::getSceneBounds()
+{
+	// Current poses, animated meshes may leave their rest bounds
+	AxisAlignedBox3f bounds = m_assimpLoader.getSkinnedBoundingBox().transformed(m_assimpLoader.getTransform());
+	Vec3f min = bounds.getMin();
+	Vec3f max = bounds.getMax();
+	for(size_t i = 0; i < m_sceneLoaders.size(); ++i)
+	{
+		AxisAlignedBox3f box = m_sceneLoaders[ i ].getSkinnedBoundingBox().transformed(m_sceneLoaders[ i ].getTransform());
+		min.x = std::min(min.x, box.getMin().x);
+		min.y = std::min(min.y, box.getMin().y);
+		min.z = std::min(min.z, box.getMin().z);
+		max.x = std::max(max.x, box.getMax().x);
+		max.y = std::max(max.y, box.getMax().y);
+		max.z = std::max(max.z, box.getMax().z);
 	}
+	return AxisAlignedBox3f(min, max);
+}
+
+void MeshViewApp::update()
+{
+	if(m_traceEnabled != Trace::isEnabled())
+	{
+		Trace::enable(m_traceEnabled);
+		m_traceRecorded = m_traceRecorded || m_traceEnabled;
+	}
+
+	MNDL_TRACE_SCOPE("MeshViewApp::update");
+
+	// Track the time
+	float elapsed = (float) getElapsedSeconds() - m_time;
+	m_time += elapsed;
+
+	// Reload only the files that changed
+	reloadChangedAssets();
+
+	// Switch to the shader variant of the current feature toggles
+	updateShader();
 
 	if(m_rotateMesh)
 	{
@@ -306,13 +1148,75 @@ void MeshViewApp::update()
 
 	if(isInitialized())
 	{
-		m_assimpLoader.setTime(elapsed);
+		m_assimpLoader.enableAnimation(m_animationEnabled);
+		m_assimpLoader.enableSkinning(m_skinningEnabled, getSkinningMode());
+		m_assimpLoader.enableSkinningOverlap(m_skinningOverlap);
+		m_assimpLoader.setNumSkinningThreads(m_skinningThreads);
+
+		// Skin only what the camera sees, the model is drawn with m_matrix
+		if(m_cullingEnabled)
+			m_assimpLoader.setCullingFrustum(Frustumf(m_camera), m_matrix);
+		else
+			m_assimpLoader.disableCulling();
+
+		if(m_animationEnabled && m_assimpLoader.getNumAnimations() > 0)
+		{
+			double duration = m_assimpLoader.getAnimationDuration(0);
+			m_animationTime += elapsed;
+			if(duration > 0.0)
+				m_animationTime = fmod(m_animationTime, duration);
+		}
+
+		m_assimpLoader.setTime(m_animationTime);
+
+		// Bake the first clip once and play it back instead of skinning
+		if(m_bakedAnimation && !m_assimpLoader.getBakedAnimation() &&
+		        m_assimpLoader.getNumAnimations() > 0 && m_assimpLoader.getRig()->getPaletteSize() > 0)
+		{
+			BakedAnimationRef baked = BakedAnimation::create(m_assimpLoader.getModel(), 0);
+			m_assimpLoader.setBakedAnimation(baked);
+
+			size_t floatSize = baked->getNumFrames() * baked->getNumVertices() * SkinnedBuffers::kStride * sizeof(float);
+			DBG("Baked", toString(baked->getNumFrames()) + " frames, " + toString(baked->getMemorySize() / 1024) +
+			    " KB (" + toString(floatSize / 1024) + " KB as floats)");
+		}
+		else if(!m_bakedAnimation && m_assimpLoader.getBakedAnimation())
+		{
+			m_assimpLoader.setBakedAnimation(BakedAnimationRef());
+			DBG_REMOVE("Baked");
+		}
+
+		// Work of the previous frame, including the meshes skinned by draw when they came into view
+		mndl::assimp::UpdateStats stats = m_assimpLoader.getUpdateStats();
+		addUpdateStats(m_instances, &stats);
+		addUpdateStats(m_sceneLoaders, &stats);
+
 		m_assimpLoader.update();
+
+		updateInstances();
+
+		if(m_skinningEnabled)
+		{
+			DBG("Skinning time", toString(m_assimpLoader.getSkinningTime() * 1000.0) + " ms");
+			DBG("Skinned", toString(stats.mMeshesSkinned) + " meshes, " + toString(stats.mVerticesSkinned) + " verts" +
+			    (getSkinningMode() == SKINNING_GPU ? " [GPU]" : " [CPU]"));
+			DBG("Skinning skipped", toString(stats.mMeshesSkipped) + " meshes, " + toString(stats.mVerticesSkipped) + " verts");
+			DBG("Skinning culled", toString(stats.mMeshesCulled) + " meshes, " + toString(stats.mVerticesCulled) + " verts");
+		}
+		else
+		{
+			DBG_REMOVE("Skinning time");
+			DBG_REMOVE("Skinned");
+			DBG_REMOVE("Skinning skipped");
+			DBG_REMOVE("Skinning culled");
+		}
 	}
 }
 
 void MeshViewApp::draw()
 {
+	MNDL_TRACE_SCOPE("MeshViewApp::draw");
+
 	// Clear the window
 	gl::clear();
 	gl::color(Color::white());
@@ -342,46 +1246,53 @@ void MeshViewApp::draw()
 		if(m_texEmissive)
 			m_texEmissive->bind(4);
 
-		// Bind shader
-		m_shader->bind();
-		m_shader->uniform("texDiffuse", 0);
-		m_shader->uniform("texNormal", 1);
-		m_shader->uniform("texSpecular", 2);
-		m_shader->uniform("texAO", 3);
-		m_shader->uniform("texEmissive", 4);
-		m_shader->uniform("texDiffusePower", m_texDiffusePower);
-		m_shader->uniform("texNormalPower", m_texNormalPower);
-		m_shader->uniform("texSpecularPower", m_texSpecularPower);
-		m_shader->uniform("texAOPower", m_texAOPower);
-		m_shader->uniform("texEmissivePower", m_texEmissivePower);
-		m_shader->uniform("diffuseEnabled", m_diffuseEnabled);
-		m_shader->uniform("normalEnabled", m_normalEnabled);
-		m_shader->uniform("specularEnabled", m_specularEnabled);
-		m_shader->uniform("aoEnabled", m_aoEnabled);
-		m_shader->uniform("emissiveEnabled", m_emissiveEnabled);
-
-		m_shader->uniform("material.Ka", m_matAmbient);
-		m_shader->uniform("material.Kd", m_matDiffuse);
-		m_shader->uniform("material.Ks", m_matSpecular);
-		m_shader->uniform("material.Shininess", m_matShininess);
-		m_shader->uniform("gamma", m_gamma);
+		// CPU time of the shader setup and the draw calls
+		Timer drawTimer(true);
+
+		// Bind the variant of the enabled features, selected by update()
+		gl::GlslProgRef shader = m_shader;
+		shader->bind();
+
+		// Upload the constants only when a value has changed
+		MeshConstants constants;
+		fillMeshConstants(&constants);
+		m_meshConstants->update(&constants);
+		m_meshConstants->bind(MESH_CONSTANTS_BINDING);
 
 		// Enable lights
 		m_light1->enable();
 		m_light2->enable();
 
-		// Render model
+		// Render the scene, the meshes of every model and instance sorted by state
+		m_renderQueue->clear();
 		gl::pushModelView();
 		gl::multModelView(m_matrix);
-		m_assimpLoader.draw();
+		m_assimpLoader.submit(*m_renderQueue, shader->getHandle());
+		for(std::vector< AssimpLoader >::iterator it = m_instances.begin(); it != m_instances.end(); ++it)
+			it->submit(*m_renderQueue, shader->getHandle());
+		for(std::vector< AssimpLoader >::iterator it = m_sceneLoaders.begin(); it != m_sceneLoaders.end(); ++it)
+			it->submit(*m_renderQueue, shader->getHandle());
 		gl::popModelView();
 
+		// The state set above, restored after drawing without asking GL
+		RenderBaseState baseState;
+		baseState.mProgram = shader->getHandle();
+		baseState.mTextureEnabled = static_cast< bool >(m_texDiffuse);
+		baseState.mTextureId = m_texDiffuse ? m_texDiffuse->getId() : 0;
+		m_renderQueue->draw(baseState);
+		DBG("Draw CPU", toString(drawTimer.getSeconds() * 1000.0) + " ms");
+
+		const mndl::assimp::RenderStats& renderStats = m_renderQueue->getStats();
+		DBG("Draw calls", static_cast< int >(renderStats.mDrawCalls));
+		DBG("State changes", static_cast< int >(renderStats.mStateChanges));
+		DBG("State changes saved", static_cast< int >(renderStats.mStateChangesSaved));
+
 		// Disable lights
 		m_light1->disable();
 		m_light2->disable();
 
 		// Unbind shader
-		m_shader->unbind();
+		shader->unbind();
 
 		// Unbind textures
 		gl::disable(m_texDiffuse->getTarget());
@@ -448,6 +1359,16 @@ void MeshViewApp::keyDown(KeyEvent event)
 			setupCamera(true);
 			break;
 		}
+		case KeyEvent::KEY_b:
+		{
+			runBenchmarks();
+			break;
+		}
+		case KeyEvent::KEY_t:
+		{
+			writeTrace();
+			break;
+		}
 	}
 }
 
@@ -461,7 +1382,8 @@ void MeshViewApp::setupCamera(bool inTheMiddleOfY)
 {
 	m_camera.setNearClip(0.1f);
 	m_camera.setFarClip(10000.0f);
-	AxisAlignedBox3f bbox = m_assimpLoader.getBoundingBox();
+	// Frame every model of the scene
+	AxisAlignedBox3f bbox = getSceneBounds();
 	Vec3f size = bbox.getSize();
 	float max = size.x;
 	max = max < size.y ? size.y : max;